@@ -7,24 +7,34 @@
 #include <cstddef>
 #include <memory>
 #include <utility> // std::pair
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "square_channel.hpp"
 #include "wave_channel.hpp"
 #include "noise_channel.hpp"
 #include "raw_audio.hpp"
 #include "speaker.hpp"
+#include "spsc_queue.hpp"
 
 namespace qtboy
 {
 
 class Speaker;
+class State_writer;
+class State_reader;
 
 class Apu
 {
     public:
     explicit Apu();
+    ~Apu();
 
     void tick(std::size_t cycles);
+    // Tick the APU from the last synced CPU cycle up to now.
+    void catch_up(uint64_t now);
     int samples_queued();
     uint8_t read_reg(uint16_t adr);
     void write_reg(uint8_t b, uint16_t adr);
@@ -33,9 +43,22 @@ class Apu
     void set_speaker(std::shared_ptr<Speaker> s);
     void reset();
 
+    // Not const: in threaded mode the worker has to be drained so its channel state can be saved.
+    void save_state(State_writer &w);
+    void load_state(State_reader &r);
+
     // When disabled, all samples are reduced to 0 before being pushed to speaker.
     void toggle_sound(bool b);
 
+    // When disabled, no samples are generated or sent to the speaker at all (e.g. for frames
+    // that are emulated but never shown). The emulated state is the same either way.
+    void set_audio_output(bool b);
+
+    // Enable/disable running channel synthesis on a separate worker thread. When enabled,
+    // write_reg() only logs the write with a cycle timestamp and the worker replays the log
+    // against its own copy of the channels to generate samples.
+    void set_threaded(bool b);
+
     public:
 
     static constexpr int SAMPLE_RATE {65536};
@@ -51,6 +74,35 @@ class Apu
     // 4.93MHz/44100
     static constexpr int DOWNSAMPLE_FREQ {4194304/SAMPLE_RATE};
 
+    // A register write logged for the synthesis worker. adr == 0 only advances the worker's
+    // clock to cycle. output is whether the cycles since the previous record were emulated with
+    // audio output: the worker keeps the channels running but drops the samples if not.
+    struct Register_write
+    {
+        uint64_t cycle;
+        uint16_t adr;
+        uint8_t b;
+        bool output;
+    };
+
+    // How many cycles can be ticked before the worker is told to catch up (~1ms).
+    static constexpr uint64_t SYNC_PERIOD {4096};
+
+    void start_worker();
+    void stop_worker();
+    // Park the worker and apply the rest of the log on the calling (emulation) thread, so
+    // synth_ can be used until resume_worker(). The worker thread itself keeps running.
+    void pause_worker();
+    void resume_worker();
+    void log_write(const Register_write &w);
+    // Replay all logged writes against synth_. Returns false if the log was empty.
+    bool replay_writes();
+    // Copy everything that affects sample generation from a.
+    void copy_synthesis_state(const Apu &a);
+    // Save/load the same state copy_synthesis_state() copies.
+    void save_synthesis_state(State_writer &w) const;
+    void load_synthesis_state(State_reader &r);
+
     std::shared_ptr<Speaker> speaker_ {nullptr};
     Square_channel square1_ {};
     Square_channel square2_ {};
@@ -63,7 +115,24 @@ class Apu
     uint8_t downsample_cnt_ {DOWNSAMPLE_FREQ};
     int frame_sequence_cnt {8192};
     uint8_t frame_sequencer_ {0};
-
+    uint64_t synced_ {0}; // CPU cycle the APU has been ticked up to
+    bool audio_output_ {true};
+
+    // Threaded synthesis: the channels above only hold the registers the guest reads back,
+    // while synth_ (owned by worker_) generates the samples.
+    bool threaded_ {false};
+    std::unique_ptr<Apu> synth_ {nullptr};
+    Spsc_queue<Register_write, 4096> writes_ {};
+    std::thread worker_;
+    std::atomic<bool> worker_exit_ {false};
+    bool worker_paused_ {false}; // asked to park by pause_worker() (guarded by worker_mutex_)
+    bool worker_parked_ {false}; // parked, not touching synth_ (guarded by worker_mutex_)
+    std::mutex worker_mutex_; // only for the flags above and worker_cv_
+    // wakes the idle worker when it has to park or exit, and pause_worker() once it has parked
+    std::condition_variable worker_cv_;
+    uint64_t cycles_ {0}; // cycles ticked on the emulation thread (in either mode)
+    uint64_t logged_cycles_ {0}; // cycle of the last record sent to the worker
+    uint64_t synth_cycles_ {0}; // cycle synth_ has been ticked to (by the worker, unless paused)
 
 };
 
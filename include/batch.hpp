@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace qtboy
+{
+
+// Batch runs for compatibility and regression sweeps over ROM libraries.
+//
+// A manifest lists one job per line: the ROM path, then tab-separated key=value fields.
+//
+//     roms/tetris.gb	frames=3600
+//     roms/pokemon_gold.gbc	movie=movies/intro.qbm	timeout=30	expect=0f1588585db18afd
+//
+// frames: frames to run (default: the length of the movie)
+// movie: input movie to play (see Movie), recorded on the same ROM
+// timeout: wall-clock seconds the job may take
+// hang_frames: frames without a picture, with the PC stuck in one place, that count as a hang
+//              (0 disables hang detection)
+// expect: state hash (hex) the job has to end on to pass
+//
+// Relative paths are relative to the manifest. Empty lines and lines starting with '#' are
+// skipped.
+
+// The cartridge clock of every job starts at 2000-01-01 00:00 UTC (seconds since the epoch),
+// so that results don't depend on when the sweep runs. Headless runs and Gameboy_pool start
+// there too, so their results can be compared with a sweep's.
+constexpr int64_t BATCH_START_TIME {946684800};
+
+struct Batch_job
+{
+    std::string rom {};
+    std::string movie {};
+    size_t frames {0};
+    double timeout {60};
+    unsigned hang_frames {600};
+    std::optional<uint64_t> expect {};
+};
+
+struct Batch_result
+{
+    enum class Status {Pass, Fail, Error, Timeout, Hang};
+
+    Batch_job job {};
+    Status status {Status::Error};
+    std::string message {}; // why the job didn't pass
+    size_t frames_run {0};
+    uint64_t frame_hash {0}; // hash of the last frame presented
+    uint64_t state_hash {0}; // Gameboy::state_hash() at the end
+    double ms {0}; // wall time
+};
+
+// Read the jobs in the manifest at path. Fields not given on a line are taken from defaults.
+// Throws std::runtime_error if the file can't be read or a line is malformed.
+std::vector<Batch_job> read_manifest(const std::string &path, const Batch_job &defaults = {});
+
+// Run a job on its own Gameboy, with save files disabled and the cartridge clock running on
+// emulated time, so that a job always ends on the same hashes. Never throws; errors are
+// reported in the result.
+Batch_result run_job(const Batch_job &job);
+
+// Run the jobs on a Work_stealing_pool with the given number of threads (0: one per core).
+// Each ROM is loaded once and shared by all of its jobs. Results are in the order of jobs.
+std::vector<Batch_result> run_batch(const std::vector<Batch_job> &jobs, unsigned threads = 0);
+
+const char *to_string(Batch_result::Status s);
+
+// Write the results as a JSON report.
+void write_report(std::ostream &out, const std::vector<Batch_result> &results, double wall_ms,
+                  unsigned threads);
+
+}
@@ -15,10 +15,16 @@
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Cartridge
 {
 	public:
     explicit Cartridge(std::istream &is);
+    // The ROM data can be shared between cartridges since it is never written to. clock is
+    // where the real-time clock (if any) gets the time from (see set_clock()).
+    explicit Cartridge(std::shared_ptr<const Rom> rom, std::function<int64_t()> clock = {});
     Cartridge(const Cartridge &) = delete;
     Cartridge(Cartridge &&) = default;
     Cartridge &operator=(const Cartridge &) = delete;
@@ -33,16 +39,22 @@ class Cartridge
     std::vector<uint8_t> dump_ram() const;
     bool is_cgb() const;
     std::string title() const;
+    uint16_t checksum() const; // global checksum from the cartridge header
+    std::shared_ptr<const Rom> rom() const { return rom_; }
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
+    // see Memory_bank_controller::set_clock()
+    void set_clock(std::function<int64_t()> clock);
 	
 	private:
-    Rom rom_;
+    std::shared_ptr<const Rom> rom_;
     std::optional<External_ram> ram_ {std::nullopt};
 
     std::unique_ptr<Memory_bank_controller> mbc_ {nullptr};
     std::string title_ {};
     bool has_battery_ {false};
 
-	void init_mbc();
+	void init_mbc(std::function<int64_t()> clock);
 	void init_info();
 	void init_ram();
 };
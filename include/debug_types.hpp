@@ -47,7 +47,7 @@ const std::array<std::string, 11> Memory_range_names
 struct Cpu_dump
 {
     uint16_t af, bc, de, hl, sp, pc;
-    uint32_t cycles;
+    uint64_t cycles;
     bool ime;
     std::array<uint8_t, 3> next_ops;
 };
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "graphic_types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace qtboy
+{
+
+// Lossless coding of 160x144 RGB555 frames against the previous one, used for streaming (see
+// Frame_stream_server) and recording (see Recorder). Game Boy frames have few colours and
+// change little from one to the next, so this usually takes a few hundred bytes to a few KB.
+//
+// An encoded frame is (integers little-endian):
+//
+//     u16 number of colours n, then n RGB555 colours (red in bits 10-14)
+//     runs covering the frame's pixels, row by row, each starting with an opcode byte:
+//         0x00-0x7f: (opcode & 0x7f) + 1 pixels unchanged since the previous frame
+//         0x80-0xff: (opcode & 0x7f) + 1 pixels of the colour whose index is the byte after
+//                    the opcode
+//
+// A frame coded without a previous frame has no unchanged runs. If a frame has more than 256
+// colours, n is 0 and its raw pixels follow instead of runs.
+class Frame_encoder
+{
+    public:
+    static constexpr size_t PIXELS {160 * 144};
+
+    // Append frame (PIXELS colours) to out, coded against prev (nullptr for none).
+    void encode(const Color *frame, const Color *prev, std::vector<uint8_t> &out);
+
+    private:
+    std::vector<uint16_t> index_ = std::vector<uint16_t>(0x10000); // colour -> palette index
+    std::vector<uint32_t> stamp_ = std::vector<uint32_t>(0x10000); // frame index_ is valid for
+    uint32_t stamp_now_ {0};
+    std::vector<Color> colours_ {}; // palette of the frame being encoded
+};
+
+// Decode a frame written by Frame_encoder::encode() (size bytes) into frame. prev is the
+// previous frame (nullptr for none), and may be the same as frame. Returns false if the data
+// is malformed.
+bool decode_frame(const uint8_t *data, size_t size, const Color *prev, Color *frame);
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "frame_tap.hpp"
+
+#include <cstdint>
+
+namespace qtboy
+{
+
+// Renderer that keeps the last presented frame and nothing else, for running without a
+// screen (headless and batch runs, the C API, Gameboy_pool). The frame is drawn into a back
+// buffer that is copied to the front one when the frame is presented, so frame() never shows
+// half of the next frame.
+class Frame_sink : public Frame_tap
+{
+    public:
+    void present_screen() override
+    {
+        front_ = back_;
+        ++frames_;
+    }
+
+    // The last frame presented (all colour 0 before the first).
+    const Frame &frame() const { return front_; }
+    // Number of frames presented.
+    uint64_t frames() const { return frames_; }
+
+    private:
+    Frame front_ {};
+    uint64_t frames_ {0};
+};
+
+}
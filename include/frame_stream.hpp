@@ -0,0 +1,106 @@
+#pragma once
+
+#include "frame_tap.hpp"
+#include "frame_codec.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace qtboy
+{
+
+class Gameboy;
+class Socket_library;
+
+// TCP server streaming the frames of one Gameboy, e.g. to watch an instance on a headless
+// node live, and taking joypad input back over the same connection.
+//
+// Like Shared_memory_export, it sits in front of the real renderer (if any) and passes
+// everything on. When the PPU presents a frame, it is copied for the server thread only if a
+// client is connected and the server isn't busy with the previous one, so the emulation
+// thread never waits on the network. The server sends the latest frame at most max_fps times
+// a second, and skips frames that didn't change. Sockets never block: a viewer that hasn't
+// taken in the last frame yet is skipped, without holding up the others.
+//
+// Protocol (integers are little-endian). On connecting, the server sends the 8-byte hello
+// "QBS1" u16 width, u16 height. Each frame then comes as u32 size, followed by size bytes:
+// u64 frame number (frames presented since the server started), then the frame coded by
+// Frame_encoder against the last one sent to that client (the first one against none). Each
+// byte the client sends is its new joypad state (Joypad::state() layout), applied with
+// Gameboy::press()/release().
+class Frame_stream_server : public Frame_tap
+{
+    public:
+    struct Options
+    {
+        std::string address {"127.0.0.1"}; // "0.0.0.0" to accept remote viewers
+        uint16_t port {0}; // 0: any free port (see port())
+        unsigned max_fps {60};
+        bool accept_input {true};
+    };
+
+    struct Stats
+    {
+        unsigned clients {0};
+        uint64_t frames_sent {0}; // to all clients
+        uint64_t bytes_sent {0};
+        uint64_t raw_bytes {0}; // what the frames sent would have taken uncompressed
+    };
+
+    // Start listening. Throws std::runtime_error if the address can't be bound.
+    Frame_stream_server(Gameboy &gb, const Options &options, Renderer *next = nullptr);
+    ~Frame_stream_server();
+    Frame_stream_server(const Frame_stream_server &) = delete;
+    Frame_stream_server &operator=(const Frame_stream_server &) = delete;
+
+    void present_screen() override;
+
+    // Port the server listens on.
+    uint16_t port() const { return port_; }
+    Stats stats() const;
+
+    private:
+    struct Client
+    {
+        std::intptr_t socket;
+        std::vector<Color> last {}; // last frame sent (empty before the first one)
+        std::vector<uint8_t> unsent {}; // rest of the last message, the socket was full
+        uint8_t input {0};
+    };
+
+    // Server thread: accept clients, read their input and send them frames.
+    void serve();
+    // Send as much of client.unsent as its socket takes without waiting. Returns false if the
+    // connection is gone.
+    bool send_unsent(Client &client);
+    // Encode the message for frame to client (see the protocol above) into out_.
+    void encode(const Frame &frame, uint64_t number, const Client &client);
+    void apply_input(Client &client, uint8_t input);
+
+    Gameboy &gb_;
+    const Options options_;
+    std::unique_ptr<Socket_library> sockets_;
+    std::intptr_t listener_ {-1};
+    uint16_t port_ {0};
+
+    std::mutex frame_mutex_; // guards latest_ and latest_number_
+    Frame latest_ {};
+    uint64_t latest_number_ {0}; // 0: no frame yet
+    uint64_t presented_ {0};
+
+    std::vector<Client> clients_ {};
+    std::atomic<unsigned> client_count_ {0};
+    std::atomic<uint64_t> frames_sent_ {0}, bytes_sent_ {0}, raw_bytes_ {0};
+    std::vector<uint8_t> out_ {}; // message being encoded
+    Frame_encoder encoder_ {};
+
+    std::atomic<bool> stop_ {false};
+    std::thread thread_;
+};
+
+}
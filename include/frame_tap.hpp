@@ -0,0 +1,49 @@
+#pragma once
+
+#include "renderer.hpp"
+#include "graphic_types.hpp"
+
+#include <array>
+
+namespace qtboy
+{
+
+// Renderer that sits in front of another one (if any): it keeps a copy of the frame being
+// drawn in back_ and passes everything on to next. Renderers that export, record or keep the
+// frames derive from it and take back_ when the frame is presented, before calling
+// Frame_tap::present_screen().
+class Frame_tap : public Renderer
+{
+    public:
+    static constexpr unsigned WIDTH {160}, HEIGHT {144};
+    using Frame = std::array<Color, WIDTH * HEIGHT>;
+
+    explicit Frame_tap(Renderer *next = nullptr)
+        : next_ {next}
+    {}
+
+    void draw_texture(const Texture &t, unsigned x, unsigned y) override
+    {
+        if (y < HEIGHT)
+        {
+            for (unsigned i = 0; i < t.width() && x + i < WIDTH; ++i)
+                back_[y * WIDTH + x + i] = t.pixel(i);
+        }
+        if (next_)
+            next_->draw_texture(t, x, y);
+    }
+
+    void present_screen() override
+    {
+        if (next_)
+            next_->present_screen();
+    }
+
+    protected:
+    Frame back_ {}; // frame being drawn
+
+    private:
+    Renderer *next_;
+};
+
+}
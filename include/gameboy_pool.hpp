@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ppu.hpp"
+
+namespace qtboy
+{
+
+class Gameboy;
+
+// N instances of the same ROM stepped in lockstep, e.g. as the environments of a
+// reinforcement learning run.
+//
+// Each worker thread owns a contiguous slice of the instances (created on that thread, and
+// pinned to one core where supported) and steps only those, so a step() is one wake-up and
+// one wait per thread, with no allocation. Results go straight into arrays provided by the
+// caller, laid out instance after instance.
+class Gameboy_pool
+{
+    public:
+    static constexpr size_t FRAME_PIXELS {160 * 144};
+
+    struct Options
+    {
+        unsigned threads {0}; // 0: one per core (never more than instances)
+        bool pin_threads {true}; // pin worker i to core i
+        // Bytes read from the memory bus after each step (see Step_output::ram)
+        std::vector<uint16_t> ram_addresses {};
+        // Called on a worker after each step with the instance's ram_addresses bytes; returns
+        // true when its episode is over. Must be safe to call from several threads at once.
+        std::function<bool(const uint8_t *ram)> done {};
+        // Downsampled output of the last frame of each step (see Ppu::Observation_format)
+        Ppu::Observation_format observation {};
+    };
+
+    // Where step() writes its results. Any of them can be nullptr to skip it.
+    struct Step_output
+    {
+        uint16_t *frames {nullptr}; // size() * FRAME_PIXELS RGB555 pixels, the last frame of each
+        uint8_t *ram {nullptr}; // size() * ram_addresses.size() bytes
+        uint8_t *done {nullptr}; // size() flags
+        // size() * observation.width * observation.height bytes
+        uint8_t *observations {nullptr};
+    };
+
+    // Create size instances running the ROM at path (loaded once and shared), with save files
+    // off and the cartridge clock on emulated time so that every run is reproducible. Throws
+    // std::runtime_error if the ROM can't be loaded.
+    Gameboy_pool(const std::string &path, size_t size, Options options);
+    Gameboy_pool(const std::string &path, size_t size);
+    ~Gameboy_pool();
+    Gameboy_pool(const Gameboy_pool &) = delete;
+    Gameboy_pool &operator=(const Gameboy_pool &) = delete;
+
+    size_t size() const { return envs_.size(); }
+    unsigned threads() const { return threads_; }
+
+    // Run frames frames on every instance, instance i holding the buttons in inputs[i]
+    // (Joypad::state() layout). An instance whose episode was over at the previous step is
+    // reset first, so the caller sees its last frame once, with done set. Frames are only
+    // drawn if out.frames is set.
+    void step(const uint8_t *inputs, unsigned frames, const Step_output &out);
+
+    // State instances are reset to (by default, the state right after power-on). Throws
+    // std::runtime_error if it isn't a state of the same ROM.
+    void set_start_state(const uint8_t *buf, size_t size);
+
+    // Reset every instance, or instance i, to the start state.
+    void reset();
+    void reset(size_t i);
+
+    // Direct access to an instance, e.g. to set it up. Not to be used during step().
+    Gameboy &instance(size_t i);
+
+    private:
+    struct Env;
+
+    // Run fn(first, last) on every worker for its slice of instances and wait for all of
+    // them. Rethrows the first exception thrown by a worker.
+    void run_on_workers(const std::function<void(size_t, size_t)> &fn);
+    void work(unsigned id);
+    void stop_workers();
+
+    std::vector<std::unique_ptr<Env>> envs_;
+    std::vector<uint8_t> start_state_;
+    const std::vector<uint16_t> ram_addresses_;
+    const std::function<bool(const uint8_t *)> done_;
+    const size_t observation_size_;
+
+    unsigned threads_ {0};
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_, done_cv_;
+    const std::function<void(size_t, size_t)> *task_ {nullptr};
+    uint64_t generation_ {0}; // bumped for each task
+    unsigned running_ {0}; // workers still on the current task
+    bool exiting_ {false};
+    std::exception_ptr error_ {};
+};
+
+}
@@ -2,6 +2,7 @@
 #define GRAPHICS_H
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
 #include <vector>
 
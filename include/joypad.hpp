@@ -9,6 +9,9 @@ namespace qtboy
 
 class Processor;
 
+class State_writer;
+class State_reader;
+
 class Joypad
 {
     public:
@@ -21,9 +24,17 @@ class Joypad
 
     void press(Input);
     void release(Input);
+    // All inputs as one byte: buttons (A, B, Select, Start) in bits 0-3, directions (Right,
+    // Left, Up, Down) in bits 4-7. A set bit is a pressed input.
+    uint8_t state() const;
+    void set_state(uint8_t s);
+    // Bit of an input in state()
+    static uint8_t mask(Input i);
     uint8_t read_reg();
     void write_reg(uint8_t b);
     void reset();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     private:
     void update_button(Input, bool pressed);
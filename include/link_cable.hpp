@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace qtboy
+{
+
+// What one end of the link cable tells the other at each sync point (see Serial).
+struct Link_message
+{
+    uint8_t sb {0xff}; // contents of the shift register (SB)
+    bool master_done {false}; // an internal clock transfer finished and waits for the peer's byte
+    bool slave_ready {false}; // a transfer was started on the external clock
+    bool busy {false}; // a transfer is in progress or armed (SC bit 7)
+};
+
+// One end of a link cable. Both ends meet at sync points: sync() blocks until the other end
+// reaches its own, then returns its message. The emulated time between two sync points is
+// the same on both ends, so the two machines stay within one sync window of each other.
+class Link_cable
+{
+    public:
+    virtual ~Link_cable() = default;
+
+    // Meet the other end. Returns false (without waiting any longer) if the other end is or
+    // gets disconnected, or if this end is interrupted. After an interruption, the next sync()
+    // goes on with the same meeting (ours is what the interrupted call passed).
+    virtual bool sync(const Link_message &ours, Link_message &theirs) = 0;
+
+    // Unplug this end. Wakes up the other end if it is waiting in sync().
+    virtual void disconnect() = 0;
+
+    // False once either end is disconnected.
+    virtual bool connected() const = 0;
+
+    // While b is true, sync() on this end returns false at once, e.g. to stop the thread
+    // waiting in it without unplugging the cable. The other end keeps waiting for this one.
+    virtual void set_interrupted(bool b) = 0;
+};
+
+// Cable between two instances in the same process, each running on its own thread.
+std::pair<std::shared_ptr<Link_cable>, std::shared_ptr<Link_cable>> make_local_link();
+
+// Cable to another process over TCP. The "host" end waits for the other one to connect on
+// address (only this machine by default; "0.0.0.0" for any network interface).
+// Both throw std::runtime_error if no connection can be made.
+std::shared_ptr<Link_cable> listen_link(uint16_t port, const std::string &address = "127.0.0.1");
+std::shared_ptr<Link_cable> connect_link(const std::string &host, uint16_t port);
+
+}
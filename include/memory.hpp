@@ -8,15 +8,19 @@
 
 #include "cartridge.hpp"
 #include "debug_types.hpp"
+#include "model.hpp"
 
 namespace qtboy
 {
 
 class Timer;
+class Serial;
 class Ppu;
 class Joypad;
 class Apu;
 class Processor;
+class State_writer;
+class State_reader;
 
 
 class Memory
@@ -29,13 +33,13 @@ class Memory
     struct Dump;
 
     // References to other components are needed to access their internal registers.
-    explicit Memory(Processor &c, Ppu &p, Timer &t, Joypad &j, Apu &a);
+    explicit Memory(Processor &c, Ppu &p, Timer &t, Joypad &j, Apu &a, Serial &s);
 
     // Read a byte from a specified address.
-    uint8_t read(uint16_t adr) const;
+    uint8_t read(uint16_t adr) const { return (this->*read_)(adr); }
 
     // Write a byte to a specified address.
-    void write(uint8_t b, uint16_t adr);
+    void write(uint8_t b, uint16_t adr) { (this->*write_)(b, adr); }
 
     // The PPU needs the following VRAM read/write methods
     // to be able to pull data from multiple VRAM banks at once.
@@ -46,11 +50,21 @@ class Memory
     // Write to a specified VRAM bank (including ones not currently mapped in memory).
     void vram_write(uint8_t b, uint8_t bank, uint16_t adr);
 
+    // Read OAM directly (i is the offset from 0xfe00). Unlike read(), this isn't blocked by
+    // an OAM DMA.
+    uint8_t oam_read(uint8_t i) const { return oam_[i]; }
+
     // Create and load a cartridge from a specified input stream pointing to a valid ROM file.
     Cartridge *load_cartridge(std::istream &is);
 
-    // Enable/disable CGB mode. This is done automatically when loading a CGB cartridge
-    // but can also be disabled manually to force DMG mode.
+    // Create and load a cartridge using already loaded (possibly shared) ROM data.
+    Cartridge *load_cartridge(std::shared_ptr<const Rom> rom);
+
+    // ROM data of the loaded cartridge (nullptr if none is loaded).
+    std::shared_ptr<const Rom> rom() const;
+
+    // Enable/disable CGB mode. This selects the read()/write() specialization for the model, so it
+    // must be called after loading a cartridge (Gameboy::load_cartridge() does this).
     void enable_cgb(bool is_cgb);
 
     // Reset all components to their initial states.
@@ -62,6 +76,17 @@ class Memory
     // Copy a memory dump into memory.
     void load_memory(const Dump &dump);
 
+    // Save/load everything in memory, including DMA state and the cartridge's RAM and MBC.
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
+
+    // Global checksum of the loaded cartridge (0 if none is loaded).
+    uint16_t rom_checksum() const;
+
+    // Set where the cartridge's real-time clock (if any) gets the time from. An empty function
+    // means the system clock. It also applies to cartridges loaded later.
+    void set_clock(std::function<int64_t()> clock);
+
     // Dump the currently mapped regions of memory.
     std::unordered_map<std::string, Memory_range> dump_mapped() const;
 
@@ -77,7 +102,16 @@ class Memory
     // Check if any data has been written to SRAM.
     bool sram_changed() const;
 
+    // The banks of work RAM the machine has, one after the other (wram_size() bytes: two banks
+    // on the DMG, all eight on the CGB).
+    const uint8_t *wram() const { return wram_.data(0); }
+    size_t wram_size() const { return cgb_mode_ ? wram_.size() : 2 * Work_ram::BANK_SIZE; }
+    // High RAM (ff80-fffe)
+    const uint8_t *hram() const { return hram_.data(); }
+    size_t hram_size() const { return hram_.size(); }
+
     void hblank_dma(); // called by PPU during HBLANK
+    bool hdma_active() const { return hdma_active_; }
 
     // Enable or disable debug mode (enables or disables the callback on memory write).
     void set_debug_mode(bool);
@@ -91,16 +125,28 @@ class Memory
     std::vector<Memory_byte> log(); // get latest memory changes
 
     private:
+    template <Model M> uint8_t read_impl(uint16_t adr) const;
+    template <Model M> void write_impl(uint8_t b, uint16_t adr);
     void set_ram_size();
     void init_io();
     void oam_dma_transfer(uint8_t b);
     void vram_dma_transfer(uint8_t b); // CGB only
     void general_dma(uint8_t hdma_len);
     void dma_copy(); // used by HDMA and GDMA
+    // Copy len bytes from the memory mapped at src into out, skipping the checks done by read().
+    // The block must not cross a 4KB boundary.
+    void bus_copy(uint16_t src, uint8_t *out, uint16_t len) const;
+    // Returns true if an OAM DMA is using the bus adr is on (the CPU can't access it).
+    bool dma_conflict(uint16_t adr) const;
+    uint8_t dma_index() const; // OAM byte currently being transferred
     void update_log(uint8_t b, uint16_t adr);
+    // Bring the PPU/APU up to the current CPU cycle before their state is accessed.
+    void sync_ppu() const;
+    void sync_apu() const;
 
     private:
     std::unique_ptr<Cartridge> cart_ {nullptr};
+    std::function<int64_t()> clock_ {}; // handed to the cartridge (see set_clock())
     Video_ram vram_ {2}; // 2 banks of 8KB VRAM in CGB
     Work_ram wram_ {8}; // 8 banks of 4KB RAM in CGB
     std::array<uint8_t, 0xa0> oam_ {};
@@ -111,9 +157,17 @@ class Memory
     Timer &timer_; // to access hardware registers
     Joypad &joypad_; // to access hardware registers
     Apu &apu_; // access hardware registers
+    Serial &serial_; // access hardware registers
     uint8_t ie_ {};
     bool cgb_mode_ {false};
+    // specializations of read()/write() for the current model, chosen in enable_cgb()
+    uint8_t (Memory::*read_)(uint16_t) const {&Memory::read_impl<Model::Dmg>};
+    void (Memory::*write_)(uint8_t, uint16_t) {&Memory::write_impl<Model::Dmg>};
     bool hdma_active_ {false};
+    // OAM DMA window: source address, and the cycles the transfer started and ends at
+    uint16_t dma_src_ {0};
+    uint64_t dma_start_ {0};
+    uint64_t dma_end_ {0};
     uint16_t hdma_src_ {0};
     uint16_t hdma_dest_ {0};
     uint8_t hdma_len_ {0xff};
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <vector>
 #include <functional>
+#include <ctime>
 
 #include "rom.hpp"
 #include "ram.hpp"
@@ -10,6 +11,9 @@
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Memory_bank_controller
 {
 	public:
@@ -21,13 +25,19 @@ class Memory_bank_controller
     // for MBCs with built-in RAM (MBC2)
     virtual std::vector<uint8_t> dump_ram() const { return {}; }
     virtual void load_sram(const std::vector<uint8_t> &) { return; }
+    // Banking registers (and built-in RAM/RTC) for save states. MBC-less carts have none.
+    virtual void save_state(State_writer &) const {}
+    virtual void load_state(State_reader &) {}
+    // Source of the current time (seconds since the epoch) for MBCs with a real-time clock.
+    // An empty function means the system clock.
+    virtual void set_clock(std::function<int64_t()>) {}
     virtual ~Memory_bank_controller() = default;
 };
 
 class Mbc1 : public Memory_bank_controller
 {
 	public:
-    explicit Mbc1(Rom *rom, std::optional<External_ram> *ram);
+    explicit Mbc1(const Rom *rom, std::optional<External_ram> *ram);
     Mbc1(const Mbc1 &) = delete;
     Mbc1 &operator=(const Mbc1 &) = delete;
     ~Mbc1() override = default;
@@ -36,6 +46,8 @@ class Mbc1 : public Memory_bank_controller
 	void write(uint8_t b, uint16_t adr) override;
     void load_sram(const std::vector<uint8_t> &sram) override;
     std::vector<uint8_t> dump_ram() const override;
+    void save_state(State_writer &w) const override;
+    void load_state(State_reader &r) override;
     const char *type() const override { return "MBC1"; }
     uint8_t rom_bank() const override { return rom_bank_; }
     uint8_t ram_bank() const override { return ram_bank_; }
@@ -44,7 +56,7 @@ class Mbc1 : public Memory_bank_controller
     void adjust_rom_bank();
 
 	private:
-    Rom *rom_;
+    const Rom *rom_;
     std::optional<External_ram> *ram_;
 	uint8_t ram_bank_ {0};
     uint8_t rom_bank_ {1};
@@ -57,7 +69,7 @@ class Mbc1 : public Memory_bank_controller
 class Mbc2 : public Memory_bank_controller
 {
     public:
-    explicit Mbc2(Rom *rom);
+    explicit Mbc2(const Rom *rom);
     Mbc2(const Mbc2 &) = delete;
     Mbc2 &operator=(const Mbc2 &) = delete;
     ~Mbc2() override = default;
@@ -66,11 +78,13 @@ class Mbc2 : public Memory_bank_controller
     void write(uint8_t b, uint16_t adr) override;
     void load_sram(const std::vector<uint8_t> &sram) override;
     std::vector<uint8_t> dump_ram() const override;
+    void save_state(State_writer &w) const override;
+    void load_state(State_reader &r) override;
     const char *type() const override { return "MBC2"; }
     uint8_t rom_bank() const override { return rom_bank_; }
 
     private:
-    Rom *rom_;
+    const Rom *rom_;
     uint8_t rom_bank_ {1};
     std::vector<uint8_t> ram_;
     bool ram_enable_ {false};
@@ -80,7 +94,9 @@ class Mbc2 : public Memory_bank_controller
 class Mbc3 : public Memory_bank_controller
 {
     public:
-    explicit Mbc3(Rom *rom, std::optional<External_ram> *ram);
+    // The RTC starts counting from the current time of clock (see set_clock()).
+    explicit Mbc3(const Rom *rom, std::optional<External_ram> *ram,
+                  std::function<int64_t()> clock = {});
     Mbc3(const Mbc3 &) = delete;
     Mbc3 &operator=(const Mbc3 &) = delete;
     ~Mbc3() override = default;
@@ -89,6 +105,9 @@ class Mbc3 : public Memory_bank_controller
     void write(uint8_t b, uint16_t adr) override final;
     void load_sram(const std::vector<uint8_t> &sram) override;
     std::vector<uint8_t> dump_ram() const override;
+    void save_state(State_writer &w) const override;
+    void load_state(State_reader &r) override;
+    void set_clock(std::function<int64_t()> clock) override { clock_ = std::move(clock); }
     const char *type() const override { return "MBC3"; }
     uint8_t rom_bank() const override { return rom_bank_; }
     uint8_t ram_bank() const override { return ram_bank_; }
@@ -97,9 +116,10 @@ class Mbc3 : public Memory_bank_controller
 
     private:
     void update_rtc() const;
+    std::time_t now() const;
 
 	private:
-    Rom *rom_;
+    const Rom *rom_;
     std::optional<External_ram> *ram_;
     bool ram_rtc_enable_ {false};
 	bool ram_timer_enable_ {false};
@@ -113,12 +133,13 @@ class Mbc3 : public Memory_bank_controller
         std::array<uint8_t, 5> base_regs, latched_regs;
         bool latched;
     } rtc_;
+    std::function<int64_t()> clock_ {};
 };
 
 class Mbc5 : public Memory_bank_controller
 {
 	public:
-    explicit Mbc5(Rom *rom, std::optional<External_ram> *ram);
+    explicit Mbc5(const Rom *rom, std::optional<External_ram> *ram);
     Mbc5(const Mbc5 &) = delete;
     Mbc5 &operator=(const Mbc5 &) = delete;
     ~Mbc5() override = default;
@@ -127,12 +148,14 @@ class Mbc5 : public Memory_bank_controller
     void write(uint8_t b, uint16_t adr) override final;
     void load_sram(const std::vector<uint8_t> &sram) override;
     std::vector<uint8_t> dump_ram() const override;
+    void save_state(State_writer &w) const override;
+    void load_state(State_reader &r) override;
     const char *type() const override { return "MBC5"; }
     uint8_t rom_bank() const override { return rom_bank_; }
     uint8_t ram_bank() const override { return ram_bank_; }
 	
 	private:
-    Rom *rom_;
+    const Rom *rom_;
     std::optional<External_ram> *ram_;
 	bool ram_enable_ {false};
     uint8_t ram_bank_ {0};
@@ -0,0 +1,13 @@
+#ifndef MODEL_HPP
+#define MODEL_HPP
+
+namespace qtboy
+{
+
+// Hardware model being emulated. The hot paths of Memory and Ppu are compiled once per model,
+// so that DMG games don't pay for CGB-only checks.
+enum class Model { Dmg, Cgb };
+
+}
+
+#endif // MODEL_HPP
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qtboy
+{
+
+// A recorded run: the state it starts from and the joypad input of every frame after it.
+// Replaying it on the same ROM reproduces the run exactly (see Gameboy::play_movie()). The
+// cartridge's real-time clock follows emulated time from start_time during both.
+struct Movie
+{
+    uint64_t rom_hash {0}; // Rom::hash() of the ROM it was recorded on
+    int64_t start_time {0}; // time of day (seconds since the epoch) the run starts at
+    std::vector<uint8_t> start_state {}; // save state the run starts from
+    std::vector<uint8_t> inputs {}; // Joypad::state() applied at the start of each frame
+
+    // Write the movie to a file. Throws std::runtime_error on failure.
+    void save(const std::string &path) const;
+
+    // Read a movie written by save(). Throws std::runtime_error if the file can't be read or
+    // isn't a movie.
+    static Movie load(const std::string &path);
+};
+
+}
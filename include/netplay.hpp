@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace qtboy
+{
+
+class Gameboy;
+class Socket_library;
+
+// Datagram socket bound to a local port that talks to a single peer. Nothing blocks.
+//
+// For testing, outgoing packets can be put through a simulated bad network: each one is held
+// back for latency +/- jitter milliseconds (so they can arrive out of order) and dropped with
+// probability loss.
+class Udp_transport
+{
+    public:
+    // Throws std::runtime_error if the socket can't be bound or the host can't be resolved.
+    Udp_transport(uint16_t local_port, const std::string &remote_host, uint16_t remote_port);
+    ~Udp_transport();
+    Udp_transport(const Udp_transport &) = delete;
+    Udp_transport &operator=(const Udp_transport &) = delete;
+
+    void set_conditions(unsigned latency_ms, unsigned jitter_ms, double loss);
+
+    void send(const uint8_t *data, size_t len);
+
+    // Copy the next packet received from the peer into buf. Returns its size, or 0 if none
+    // is waiting.
+    size_t receive(uint8_t *buf, size_t size);
+
+    private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Held_packet
+    {
+        Clock::time_point due;
+        std::vector<uint8_t> data;
+    };
+
+    void send_now(const uint8_t *data, size_t len);
+    // Send the held packets that are due.
+    void flush();
+
+    std::unique_ptr<Socket_library> sockets_;
+    std::intptr_t socket_ {-1};
+    uint32_t remote_ip_ {0}; // network byte order
+    uint16_t remote_port_ {0}; // network byte order
+    unsigned latency_ms_ {0}, jitter_ms_ {0};
+    double loss_ {0};
+    std::vector<Held_packet> held_ {};
+    std::mt19937 rng_ {std::random_device{}()};
+};
+
+// Two players sharing one machine over the network, GGPO style.
+//
+// Both sides run the same machine; each frame's input is both players' joypad states OR'd
+// together. Local input is applied input_delay frames late and sent to the peer right away.
+// The remote input of frames that haven't arrived yet is predicted to be the last one
+// received. When the real input turns out different, the machine goes back to the state
+// saved before the first mispredicted frame and runs the frames since again (without video
+// or audio output), so a late packet costs a few frames of re-simulation instead of a stall.
+// Only if the peer falls more than max_rollback frames behind does advance() wait.
+//
+// The host sends its state to the guest when the session starts, and the cartridge's
+// real-time clock follows emulated time on both, so the two machines start and stay the
+// same. Every packet also carries the hash of the latest frame both sides know the inputs
+// of, to detect desyncs. Both machines must have the same byte order.
+class Rollback_session
+{
+    public:
+    struct Stats
+    {
+        uint64_t frame {0}; // frames run
+        uint64_t confirmed_frame {0}; // frames whose inputs are known from both players
+        uint64_t rollbacks {0};
+        uint64_t resimulated_frames {0};
+        unsigned max_rollback_depth {0};
+        uint64_t stalls {0}; // calls to advance() that waited for the peer
+        bool desynced {false};
+    };
+
+    // gb must have the same ROM loaded on both sides. max_rollback is at most 32 frames and
+    // input_delay at most 16.
+    Rollback_session(Gameboy &gb, Udp_transport &net, bool host,
+                     unsigned max_rollback = 8, unsigned input_delay = 1);
+
+    // Exchange the starting state. Call until it returns true before calling advance().
+    // Throws std::runtime_error if the peer has another ROM loaded.
+    bool synchronize();
+
+    // Run the next frame with the local player's input (Joypad::state() layout). Returns
+    // false without running anything if the peer is too far behind; call again later.
+    bool advance(uint8_t local_input);
+
+    // Handle incoming packets (rolling back if needed) and send the local inputs the peer
+    // doesn't have yet, without running a new frame.
+    void poll();
+
+    // Time the real-time clock of both machines started at (seconds since the epoch).
+    int64_t start_time() const { return start_time_; }
+
+    Stats stats() const { return stats_; }
+
+    private:
+    static constexpr unsigned RING_SIZE {128}; // frames of history kept
+
+    void receive();
+    void handle_packet(const uint8_t *data, size_t len);
+    void send_inputs();
+    void send_ready();
+    // Go back to the first mispredicted frame and run again up to frame_.
+    void rollback();
+    // Run frame f from the current state, saving the state before it first.
+    void simulate(uint64_t f);
+    void check_desync();
+    // Frames known from both players (and run with the right inputs once rollback() is done)
+    uint64_t confirmed() const;
+
+    Gameboy &gb_;
+    Udp_transport &net_;
+    const bool host_;
+    const unsigned max_rollback_;
+    const unsigned input_delay_;
+
+    bool synced_ {false};
+    int64_t start_time_ {0};
+    std::vector<uint8_t> start_state_ {};
+    std::vector<bool> chunks_received_ {};
+    uint64_t rom_hash_ {0};
+
+    uint64_t frame_ {0}; // next frame to run
+    uint64_t local_known_ {0}; // local inputs known (input_delay_ ahead of frame_)
+    uint64_t remote_known_ {0}; // consecutive remote inputs received
+    uint64_t remote_ack_ {0}; // local inputs the peer has received
+    uint64_t rollback_from_ {UINT64_MAX}; // first frame run with a wrong prediction
+    std::array<uint8_t, RING_SIZE> local_ {};
+    std::array<uint8_t, RING_SIZE> remote_ {};
+    std::array<uint8_t, RING_SIZE> predicted_ {}; // remote input each frame was run with
+    std::array<uint64_t, RING_SIZE> hashes_ {}; // state hash after each frame
+    std::vector<std::vector<uint8_t>> states_; // state before each frame
+    uint64_t peer_check_frame_ {UINT64_MAX}; // hash of a frame sent by the peer
+    uint64_t peer_check_hash_ {0};
+
+    Stats stats_ {};
+    std::vector<uint8_t> packet_ {}; // scratch for outgoing packets
+};
+
+}
@@ -2,11 +2,15 @@
 #define NOISE_CHANNEL_HPP
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
 
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Noise_channel
 {
     public:
@@ -16,6 +20,8 @@ class Noise_channel
     uint8_t output();
     void length_tick();
     void envelope_tick();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     private:
     void restart_sound();
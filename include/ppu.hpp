@@ -1,12 +1,14 @@
 #ifndef PPU_HPP
 #define PPU_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <bitset>
 #include <vector>
 
 #include "graphic_types.hpp"
+#include "model.hpp"
 
 namespace qtboy
 {
@@ -14,6 +16,8 @@ namespace qtboy
 class Renderer;
 class Processor;
 class Memory;
+class State_writer;
+class State_reader;
 
 class Ppu
 {
@@ -35,18 +39,63 @@ class Ppu
     enum class Layer { Background, Window, Sprite};
     enum class Color_correction { None, Fast, Proper };
 
+    // Secondary output for machine consumers (e.g. the observations of a reinforcement
+    // learning agent): the frame downsampled to width x height while its scanlines are drawn,
+    // one byte per pixel, row by row.
+    //
+    // Luminance: average luminance of each box of pixels (0 black, 255 white).
+    // Palette_index: palette * 4 + colour of the pixel at the centre of each box. Palettes
+    //                0-7 are the background ones and 8-15 the object ones (on the DMG, BGP
+    //                is 0, OBP0 8 and OBP1 9); a blanked background is BLANK_INDEX.
+    enum class Observation_mode { Luminance, Palette_index };
+    struct Observation_format
+    {
+        unsigned width {0}, height {0}; // 0 disables the output
+        Observation_mode mode {Observation_mode::Luminance};
+    };
+    static constexpr uint8_t BLANK_INDEX {64};
+
     Ppu(Memory &m,
         Processor &p,
         Renderer *r = nullptr);
     void reset();
     void enable_cgb(bool is_cgb);
     void step(size_t cycles);
+    // Step the PPU from the last synced CPU cycle up to now.
+    void catch_up(uint64_t now);
+    // CPU cycle at which the PPU next needs to be caught up because it may raise an interrupt.
+    uint64_t next_event() const { return next_event_; }
+    // Recompute next_event(). Needed whenever something outside the PPU changes what it has to
+    // signal (e.g. HDMA being started).
+    void schedule_event();
     int mode() const;
     int clock() const;
     bool enabled() const;
     uint8_t read_reg(uint16_t adr);
     void write_reg(uint8_t b, uint16_t adr);
     void set_renderer(Renderer *r);
+    Renderer *renderer() const { return renderer_; }
+    // When disabled, scanlines aren't drawn and nothing is sent to the renderer. The emulated
+    // state is the same either way.
+    void set_video_output(bool b) { video_output_ = b; }
+    // Number of frames completed (VBLANKs entered) since reset.
+    uint64_t frames() const { return frames_; }
+    // Number of frames sent to the renderer since the PPU was created. Safe to read from
+    // another thread.
+    uint64_t presented() const { return presented_.load(std::memory_order_relaxed); }
+    // Set the observation output up (see Observation_format). Throws std::runtime_error if
+    // it is larger than the screen.
+    void set_observation(const Observation_format &f);
+    const Observation_format &observation_format() const { return observation_format_; }
+    // Observe the next frame that starts. Only observed frames pay for the output; they are
+    // drawn even when video output is disabled.
+    void request_observation() { observation_requested_ = true; }
+    // True from request_observation() until a frame has been observed in full.
+    bool observation_pending() const { return observation_requested_; }
+    // The last frame observed in full (width * height bytes).
+    const uint8_t *observation() const { return observation_.data(); }
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     // debug
     Palette get_bg_palette(uint8_t idx) const;
@@ -66,19 +115,32 @@ class Ppu
     void write(uint8_t b, uint16_t adr);
     uint8_t read_vram(uint8_t bank, uint16_t adr) const;
     void write_vram(uint8_t b, uint8_t bank, uint16_t adr);
-    void render_scanline();
-    void render_layer_line(Texture &tex, Layer l);
+    // The rendering functions are specialized for each hardware model. The specialization of
+    // render_scanline() to use is picked in enable_cgb().
+    template <Model M> void render_scanline();
+    template <Model M> void render_layer_line(Texture &tex, Layer l);
     // (x,y): coordinate in VRAM tilemap to get pixel from
     // (tex_x, tex_y): pixel to draw in Texture
+    // source: if not null, receives palette * 4 + colour of the pixel at tex_x
+    template <Model M>
     void render_layer_pixel(Texture &tex, Layer l, uint8_t x, uint8_t y,
-                            uint8_t tex_x, uint8_t tex_y) const;
-    void render_sprite_line(Texture &tex);
-    void order_sprites(std::array<Sprite, 10> &s) const;
+                            uint8_t tex_x, uint8_t tex_y, uint8_t *source = nullptr) const;
+    template <Model M> void render_sprite_line(Texture &tex);
+    template <Model M> void order_sprites(std::array<Sprite, 10> &s) const;
+    template <Model M> Palette bg_palette(uint8_t idx) const;
+    template <Model M> Palette sprite_palette(uint8_t idx) const;
     void load_sprites();
-    void oam_scan(); // mode 2
-    void vram_read(); // mode 3
-    void hblank(); // mode 0
-    void vblank(); // mode 1
+    // Add the line in line_source_ to the observation.
+    void observe_line();
+    // Recompute luminance_ from the current palettes.
+    void update_luminance();
+    // Update what render_scanline() would have without drawing (when there's no video output).
+    void skip_scanline();
+    // The mode handlers return true if the PPU moved on to the next mode.
+    bool oam_scan(); // mode 2
+    bool vram_read(); // mode 3
+    bool hblank(); // mode 0
+    bool vblank(); // mode 1
     void check_stat();
 
     public: // options
@@ -89,7 +151,12 @@ class Ppu
     Memory &memory_;
     Processor &cpu_;
     Renderer *renderer_;
+    bool video_output_ {true};
+    uint64_t frames_ {0};
+    std::atomic<uint64_t> presented_ {0};
     int clock_ {0};
+    uint64_t synced_ {0}; // CPU cycle the PPU has been stepped up to
+    uint64_t next_event_ {0};
     uint8_t window_line_ {0}; // keep track of how many window lines were drawn
     uint8_t lcdc_ {0x90}, stat_ {0x00}; // ff40, ff41
     uint8_t scy_ {0}, scx_ {0}; // ff42, ff43
@@ -102,11 +169,34 @@ class Ppu
 
     // CGB registers
     bool cgb_mode_ {false};
+    void (Ppu::*render_scanline_)() {&Ppu::render_scanline<Model::Dmg>};
     std::array<uint8_t, 0x40> bgpd_ {}; // background palette data
     std::array<uint8_t, 0x40> obpd_ {}; // object palette data
     uint8_t bgpi_ {0}; // ff68
     uint8_t obpi_ {0}; // ff6a
 
+    // Observation output (see set_observation())
+    struct Observation_line
+    {
+        uint8_t row; // output row the line falls in
+        uint8_t height; // lines in that row
+        bool sampled; // the line Palette_index samples for the row
+        bool last; // last line of the row
+    };
+    Observation_format observation_format_ {};
+    std::vector<uint8_t> observation_ {};
+    std::vector<uint8_t> observation_back_ {}; // the frame being observed
+    bool observation_requested_ {false};
+    bool frame_start_ {true}; // no line of the current frame has been drawn yet
+    bool observing_ {false}; // the frame being drawn is observed
+    bool palettes_changed_ {true}; // luminance_ is out of date
+    std::array<uint8_t, 160> line_source_ {}; // palette * 4 + colour of each pixel of the line
+    std::array<uint8_t, BLANK_INDEX + 1> luminance_ {}; // of each line_source_ value
+    std::array<uint8_t, 160> observation_column_ {}; // output column of each pixel
+    std::array<Observation_line, 144> observation_lines_ {};
+    std::vector<uint8_t> observation_widths_ {}; // pixels in each output column
+    std::vector<uint8_t> observation_samples_ {}; // pixel Palette_index samples for each column
+    std::vector<uint32_t> observation_sums_ {}; // luminance of the current row so far
 
 
 };
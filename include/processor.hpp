@@ -13,6 +13,9 @@
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Processor
 {
     public:
@@ -31,6 +34,8 @@ class Processor
     void step();
     void reset(bool force_dmg = false);
     Cpu_dump dump() const noexcept;
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
     void request_interrupt(Interrupt i);
     void toggle_double_speed();
 
@@ -40,10 +45,7 @@ class Processor
     uint16_t hl() const noexcept { return hl_; }
     uint16_t sp() const noexcept { return sp_; }
     uint16_t pc() const noexcept { return pc_; }
-    uint32_t cycles() const noexcept { return cycles_; }
-    // Manually add cycles to cycle count. This is useful for OAM DMA transfers: they need to take
-    // 160 machine cycles (640 clock cycles).
-    void add_cycles(uint32_t c);
+    uint64_t cycles() const noexcept { return cycles_; }
     bool stopped() const noexcept { return stpd_; }
     bool halted() const noexcept { return hltd_; }
     bool double_speed() const noexcept { return double_speed_; }
@@ -61,7 +63,7 @@ class Processor
     };
 
     Register_pair af_, bc_, de_, hl_, sp_, pc_;
-    uint32_t cycles_ {0};
+    uint64_t cycles_ {0};
     bool stpd_ {false};
     bool hltd_ {false};
     bool use_branch_cycles_ {false};
@@ -0,0 +1,120 @@
+#ifndef QTBOY_H
+#define QTBOY_H
+
+/*
+ * C interface to the emulator core, for use from other languages (Python's ctypes, Rust's FFI,
+ * ...). Build it as a shared library with `make libqtboy.so`.
+ *
+ * An instance is only driven from the calling thread: qtboy_step_frames() runs the frames
+ * right away and returns when they are done. Instances are independent, so several can run
+ * on different threads. Functions that can fail return a negative value (or 0 for sizes) and
+ * leave a message for qtboy_last_error().
+ *
+ * The framebuffer and RAM pointers point into the instance itself and stay valid until it is
+ * destroyed, so they only need to be fetched once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define QTBOY_API __declspec(dllexport)
+#else
+#define QTBOY_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a function is added or changes. */
+#define QTBOY_API_VERSION 2
+
+#define QTBOY_SCREEN_WIDTH 160
+#define QTBOY_SCREEN_HEIGHT 144
+
+/* Joypad bits for qtboy_step_frames() */
+#define QTBOY_A 0x01
+#define QTBOY_B 0x02
+#define QTBOY_SELECT 0x04
+#define QTBOY_START 0x08
+#define QTBOY_RIGHT 0x10
+#define QTBOY_LEFT 0x20
+#define QTBOY_UP 0x40
+#define QTBOY_DOWN 0x80
+
+/* Observation modes for qtboy_set_observation() */
+#define QTBOY_OBSERVE_LUMINANCE 0
+#define QTBOY_OBSERVE_PALETTE_INDEX 1
+
+typedef struct qtboy_gb qtboy_gb;
+
+/* QTBOY_API_VERSION of the library, to check against the header it was built with. */
+QTBOY_API uint32_t qtboy_api_version(void);
+
+/* Create an instance with no ROM loaded. Save files are off (see qtboy_set_save_dir()).
+ * Returns NULL if out of memory. */
+QTBOY_API qtboy_gb *qtboy_create(void);
+QTBOY_API void qtboy_destroy(qtboy_gb *gb);
+
+/* Message for the last call on gb that failed (empty if none did). */
+QTBOY_API const char *qtboy_last_error(const qtboy_gb *gb);
+
+/* Directory to read and write .sav files in, or NULL/"" to disable them. Takes effect on the
+ * next qtboy_load_rom(). */
+QTBOY_API void qtboy_set_save_dir(qtboy_gb *gb, const char *dir);
+
+/* Load the ROM file at path and power on. Instances that load the same file share one copy
+ * of it. Returns 0, or -1 on error. */
+QTBOY_API int qtboy_load_rom(qtboy_gb *gb, const char *path);
+
+/* Hold the buttons in input (QTBOY_* bits) and run n frames. Returns 0, or -1 on error. */
+QTBOY_API int qtboy_step_frames(qtboy_gb *gb, uint32_t n, uint8_t input);
+
+/* Last complete frame: QTBOY_SCREEN_WIDTH * QTBOY_SCREEN_HEIGHT RGB555 pixels (red in bits
+ * 10-14, blue in bits 0-4), row by row. */
+QTBOY_API const uint16_t *qtboy_framebuffer_ptr(const qtboy_gb *gb);
+
+/* Also write a width x height downsampled version of the last frame of each
+ * qtboy_step_frames() call (which then runs on to the end of that frame), one byte per
+ * pixel: with QTBOY_OBSERVE_LUMINANCE, the average luminance of each box of pixels; with
+ * QTBOY_OBSERVE_PALETTE_INDEX, palette * 4 + colour of its centre pixel (background palettes
+ * 0-7, object palettes 8-15, 64 for a blanked background). 0x0 turns it off. Frames in
+ * between cost nothing extra. Returns 0, or -1 on error (larger than the screen, or unknown
+ * mode). */
+QTBOY_API int qtboy_set_observation(qtboy_gb *gb, uint32_t width, uint32_t height, int mode);
+
+/* The last observation: width * height bytes, row by row. Valid until the next call to
+ * qtboy_set_observation(). */
+QTBOY_API const uint8_t *qtboy_observation_ptr(const qtboy_gb *gb);
+
+/* Work RAM: c000-dfff, followed on the CGB by banks 2-7. *size receives its size in bytes
+ * (0x2000 on the DMG, 0x8000 on the CGB). Read-only: write with qtboy_write_memory() so that
+ * the state hash sees the change. */
+QTBOY_API const uint8_t *qtboy_ram_ptr(const qtboy_gb *gb, size_t *size);
+
+/* Read or write a byte on the memory bus, as the CPU would. Without a ROM loaded, reads give
+ * 0xff and writes are ignored. */
+QTBOY_API uint8_t qtboy_read_memory(qtboy_gb *gb, uint16_t adr);
+QTBOY_API void qtboy_write_memory(qtboy_gb *gb, uint16_t adr, uint8_t b);
+
+/* Size in bytes of a save state of the loaded ROM (0 if none is loaded). */
+QTBOY_API size_t qtboy_state_size(const qtboy_gb *gb);
+
+/* Write the machine state to buf. Returns the number of bytes written, or 0 on error (no ROM
+ * loaded, or size < qtboy_state_size()). */
+QTBOY_API size_t qtboy_save_state(qtboy_gb *gb, void *buf, size_t size);
+
+/* Restore a state written by qtboy_save_state() for the same ROM. Returns 0, or -1 on error
+ * (the machine is then left untouched). */
+QTBOY_API int qtboy_load_state(qtboy_gb *gb, const void *buf, size_t size);
+
+/* 64-bit hash of the machine state: equal hashes mean the machines will run the same. 0 on
+ * error (no ROM loaded). */
+QTBOY_API uint64_t qtboy_state_hash(qtboy_gb *gb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QTBOY_H */
@@ -0,0 +1,77 @@
+#ifndef QTBOY_SHM_H
+#define QTBOY_SHM_H
+
+/*
+ * Layout of the shared memory region written by qtboy::Shared_memory_export, for readers in
+ * other processes. Open it with shm_open(name, O_RDONLY) and map sizeof(struct qtboy_shm)
+ * bytes (see qtboy_shm_read() below, or follow the same protocol in another language).
+ *
+ * The region is a seqlock: seq is odd while a frame is being published and goes up by 2 with
+ * each one. A reader copies what it needs between two reads of seq and starts over if they
+ * differ or are odd, so readers never slow the emulator down and any number of them can
+ * read at once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QTBOY_SHM_MAGIC 0x4d485351u /* "QSHM" */
+#define QTBOY_SHM_VERSION 1
+
+#define QTBOY_SHM_WIDTH 160
+#define QTBOY_SHM_HEIGHT 144
+#define QTBOY_SHM_WRAM_MAX 0x8000
+#define QTBOY_SHM_HRAM_MAX 0x80
+
+struct qtboy_shm
+{
+    /* Set once the region is ready (magic last) */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t wram_size; /* bytes used in wram: 0x2000 on the DMG, 0x8000 on the CGB */
+    uint32_t hram_size;
+
+    uint64_t seq;
+    /* Everything below is only consistent when read under seq */
+    uint64_t frame; /* number of frames published (0: none yet) */
+    uint16_t pixels[QTBOY_SHM_WIDTH * QTBOY_SHM_HEIGHT]; /* RGB555, red in bits 10-14 */
+    uint8_t wram[QTBOY_SHM_WRAM_MAX]; /* c000-dfff, followed on the CGB by banks 2-7 */
+    uint8_t hram[QTBOY_SHM_HRAM_MAX]; /* ff80-fffe */
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+/* Copy a consistent snapshot of the region into out. Returns 0, or -1 if the region isn't
+ * ready or no consistent copy could be made in tries attempts (the writer kept publishing). */
+static inline int qtboy_shm_read(const struct qtboy_shm *shm, struct qtboy_shm *out,
+                                 unsigned tries)
+{
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != QTBOY_SHM_MAGIC)
+        return -1;
+    while (tries--)
+    {
+        const uint64_t before = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        __builtin_memcpy(out, shm, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == before)
+        {
+            out->seq = before;
+            return 0;
+        }
+    }
+    return -1;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QTBOY_SHM_H */
@@ -8,6 +8,9 @@
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 template <uint16_t bank_sz>
 class Ram
 {
@@ -19,15 +22,32 @@ class Ram
 
 	uint8_t read(uint8_t bank, uint16_t adr) const;
     void write(uint8_t b, uint8_t bank, uint16_t adr);
+    // direct access to the bytes of a bank (for block copies)
+    const uint8_t *data(uint8_t bank) const;
+    // direct access for writing len bytes at adr
+    uint8_t *data(uint8_t bank, uint16_t adr, uint16_t len);
     void load(const std::vector<uint8_t> &load);
     std::vector<uint8_t> dump(uint8_t bank) const; // dump one bank
     std::vector<uint8_t> dump() const; // dump all banks
 	void resize(uint8_t nbanks);
     size_t size() const;
     void reset();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r); // the number of banks must match
+    // Hash of the contents. Only the pages written since the last call are hashed again.
+    uint64_t hash() const;
 	
 	private:
+    static constexpr uint16_t PAGE_SIZE {0x100};
+    static constexpr uint16_t PAGES_PER_BANK {bank_sz / PAGE_SIZE};
+
+    void mark_dirty(uint8_t bank, uint16_t adr) { dirty_[bank * PAGES_PER_BANK + adr / PAGE_SIZE] = 1; }
+    void mark_all_dirty();
+
     std::vector<Bank> data_ {};
+    // per page: set when written, and the hash of its contents when it was last clean
+    mutable std::vector<uint8_t> dirty_ {};
+    mutable std::vector<uint64_t> page_hashes_ {};
 	
 };
 
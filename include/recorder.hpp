@@ -0,0 +1,152 @@
+#pragma once
+
+#include "frame_tap.hpp"
+#include "speaker.hpp"
+#include "frame_codec.hpp"
+#include "spsc_queue.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace qtboy
+{
+
+// Records the video and audio output of a Gameboy to files.
+//
+// Like Shared_memory_export, it sits in front of the real renderer (if any) and passes
+// everything on; install speaker() with Gameboy::set_speaker() to record audio too, which it
+// passes on to next_speaker. The emulation (and audio) threads only copy frames and sample
+// batches into lock-free queues: a writer thread converts, compresses and writes them. A
+// frame identical to the previous one isn't copied, only recorded as a repeat. If the writer
+// falls behind, a frame is recorded as a repeat of the previous one, or not at all once the
+// queue is full (and audio is lost), rather than stalling the emulation, unless
+// Options::lossless is set.
+//
+// Formats:
+//   Y4m_wav: the frames as an uncompressed YUV 4:4:4 Y4M video at path (BT.601, about 59.7
+//            fps), and the audio as an unsigned 8-bit stereo 65536 Hz WAV next to it (path
+//            with the extension replaced by .wav). Any video player can read them.
+//   Delta:   a single lossless .qbv file, usually over 10 times smaller. It starts with the
+//            header "QBV1" u16 width, u16 height, u32 fps numerator, u32 fps denominator,
+//            u32 sample rate, u8 channels, u8 bits per sample, followed by records of u8 type,
+//            u32 size and size bytes (integers little-endian):
+//              'F': a frame coded by Frame_encoder against the previous one, or against
+//                   none (a key frame, to seek to) for the first frame and then for the
+//                   first one at least KEY_INTERVAL frames after the last key frame
+//              'R': the previous frame again (size 0)
+//              'A': unsigned 8-bit stereo samples
+class Recorder : public Frame_tap
+{
+    public:
+    enum class Format
+    {
+        Y4m_wav,
+        Delta
+    };
+
+    struct Options
+    {
+        Format format {Format::Y4m_wav};
+        // Wait for the writer instead of dropping frames and audio, for runs that aren't
+        // real time (e.g. headless)
+        bool lossless {false};
+    };
+
+    struct Stats
+    {
+        uint64_t frames {0}; // presented
+        uint64_t repeats {0}; // of those, identical to the previous one
+        // of those, recorded as a repeat of the last frame or not at all because the writer
+        // was behind
+        uint64_t dropped {0};
+        uint64_t audio_dropped {0}; // bytes of samples lost because the writer was behind
+        uint64_t bytes_written {0};
+        bool ok {true}; // false if a write failed (e.g. disk full)
+    };
+
+    static constexpr unsigned KEY_INTERVAL {600};
+
+    // Create the output file(s) and start the writer thread. Throws std::runtime_error if a
+    // file can't be created.
+    Recorder(const std::string &path, const Options &options, Renderer *next = nullptr,
+             std::shared_ptr<Speaker> next_speaker = nullptr);
+    // Stops the recording (see stop()).
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    // Format for a file name: Delta for .qbv, Y4m_wav otherwise.
+    static Format format_for(const std::string &path);
+
+    void present_screen() override;
+
+    // Speaker that records the samples queued to it. It must be removed from the Gameboy
+    // before the Recorder is destroyed.
+    std::shared_ptr<Speaker> speaker() const { return speaker_; }
+
+    // Write out everything queued, finish the files and stop the writer. Frames and audio
+    // coming in after this are only passed on.
+    void stop();
+
+    Stats stats() const;
+
+    private:
+    class Tap;
+
+    struct Audio_chunk
+    {
+        uint16_t size {0};
+        std::array<uint8_t, 1024> data {};
+    };
+
+    static constexpr unsigned SLOTS {32};
+    static constexpr int16_t REPEAT {-1}; // in filled_: the previous frame again
+
+    void queue_audio(const Raw_audio &a);
+
+    // Writer thread.
+    void write_loop();
+    void write_frame(int16_t slot);
+    void write_audio(const Audio_chunk &chunk);
+    void write_record(char type, const uint8_t *data, size_t size);
+    void write(const void *data, size_t size);
+    void finish();
+
+    const Options options_;
+    std::shared_ptr<Speaker> speaker_; // a Tap
+    std::ofstream video_;
+    std::ofstream audio_file_; // Y4m_wav only
+    std::atomic<bool> stopped_ {false};
+
+    // emulation thread
+    Frame last_ {}; // last frame recorded
+    bool has_last_ {false};
+
+    // emulation thread -> writer thread
+    std::vector<Frame> slots_ = std::vector<Frame>(SLOTS);
+    Spsc_queue<int16_t, SLOTS> free_ {}; // slots the emulation thread can fill
+    Spsc_queue<int16_t, SLOTS * 2> filled_ {}; // slots to write, or REPEAT
+    Spsc_queue<Audio_chunk, 256> audio_ {};
+
+    // writer thread
+    Frame prev_ {}; // last frame written
+    uint64_t written_ {0}; // frames
+    uint64_t next_key_ {0}; // Delta: first frame that can be a key frame
+    std::vector<uint8_t> out_ {}; // Delta: record being written; Y4m_wav: converted frame
+    Frame_encoder encoder_ {};
+    uint64_t audio_size_ {0};
+
+    std::atomic<uint64_t> frames_ {0}, repeats_ {0}, dropped_ {0}, audio_dropped_ {0};
+    std::atomic<uint64_t> bytes_written_ {0};
+    std::atomic<bool> failed_ {false};
+    std::atomic<bool> stop_ {false};
+    std::thread thread_;
+};
+
+}
@@ -3,23 +3,33 @@
 
 #include <thread>
 #include <functional>
-#include <atomic>
 #include <mutex>
+#include <condition_variable>
 
+// A thread that runs the same task every time queue() is called, sleeping in between.
 class Reusable_thread
 {
     public:
     explicit Reusable_thread();
     explicit Reusable_thread(std::function<void()> fn);
+    // Finishes a queued task, then joins the thread.
+    ~Reusable_thread();
+    Reusable_thread(const Reusable_thread &) = delete;
+    Reusable_thread &operator=(const Reusable_thread &) = delete;
 
+    // Replace the task. Waits for a queued task to finish first.
     void set_task(std::function<void()> fn);
+    // Run the task once. Does nothing if it is already queued.
     void queue();
+    // Block until the queued task has finished.
+    void wait();
 
     private:
     std::thread thread_;
-    std::atomic<bool> has_work_ {false}, exiting_ {false};
+    bool has_work_ {false}, exiting_ {false};
     std::function<void()> callback_;
-    std::mutex callback_mutex_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
 };
 
 #endif // REUSABLE_THREAD_H
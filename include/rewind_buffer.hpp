@@ -0,0 +1,100 @@
+#ifndef REWIND_BUFFER_HPP
+#define REWIND_BUFFER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace qtboy
+{
+
+// Keeps a history of save states within a fixed memory budget.
+//
+// Only the most recent state is kept whole. Every older state is stored as the XOR of itself
+// with the state after it, compressed by collapsing runs of zeros (most of the machine doesn't
+// change between two snapshots). Going back one snapshot XORs the newest delta into the current
+// state, so the oldest deltas can be thrown away whenever the budget runs out.
+//
+// Compression happens on a worker thread. The emulation thread saves a state straight into
+// staging() and hands it over with commit(), so all it pays for is the save itself.
+class Rewind_buffer
+{
+    public:
+    struct Stats
+    {
+        std::size_t snapshots {0}; // states that can be rewound to
+        std::size_t bytes_used {0}; // compressed bytes in the ring
+        double compression_ratio {0}; // uncompressed/compressed size of the stored deltas
+        double seconds {0}; // emulated time covered by the history
+    };
+
+    // state_size: size of one save state. budget: bytes available for compressed deltas.
+    // frames_per_snapshot: how often states are pushed (only used for Stats::seconds).
+    Rewind_buffer(std::size_t state_size, std::size_t budget, unsigned frames_per_snapshot);
+    ~Rewind_buffer();
+    Rewind_buffer(const Rewind_buffer &) = delete;
+    Rewind_buffer &operator=(const Rewind_buffer &) = delete;
+
+    // Buffer to save the next state into, or nullptr if the worker is still compressing the
+    // previous one (the snapshot should then be skipped). Never blocks.
+    uint8_t *staging();
+
+    // Hand the state written to staging() over to the worker.
+    void commit();
+
+    // Copy the most recent state into out and drop it from the history. Returns false if the
+    // history is empty.
+    bool pop(uint8_t *out);
+
+    // Drop the whole history.
+    void clear();
+
+    Stats stats() const;
+
+    private:
+    // A compressed delta in ring_.
+    struct Entry
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    void work();
+    // Store the delta between latest_ and staging_, then make staging_ the latest state.
+    void push_delta();
+    // Store delta_ (compressed size n) in the ring, evicting the oldest entries to make room.
+    void store(std::size_t n);
+    // XOR the compressed delta at src into state.
+    void apply_delta(const uint8_t *src, std::size_t n, uint8_t *state) const;
+    // Zero-run encode delta_ into scratch_. Returns the encoded size.
+    std::size_t compress();
+
+    const std::size_t state_size_;
+    const unsigned frames_per_snapshot_;
+
+    std::vector<uint8_t> staging_; // written by the emulation thread
+    std::vector<uint8_t> latest_; // newest state, whole
+    bool have_latest_ {false};
+    std::vector<uint8_t> delta_; // scratch for latest_ ^ staging_
+    std::vector<uint8_t> scratch_; // scratch for the compressed delta
+    std::vector<uint8_t> ring_;
+    std::deque<Entry> entries_; // oldest first
+    std::size_t raw_bytes_ {0}; // uncompressed size of the stored deltas
+    std::size_t packed_bytes_ {0}; // compressed size of the stored deltas
+
+    // staged_ is true from commit() until the worker has consumed staging_
+    std::atomic<bool> staged_ {false};
+    std::atomic<bool> exit_ {false};
+    mutable std::mutex mutex_; // guards everything the worker touches
+    std::condition_variable cv_;
+    std::thread worker_;
+};
+
+}
+
+#endif // REWIND_BUFFER_HPP
@@ -3,26 +3,51 @@
 #include <array>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include "debug_types.hpp"
 
 namespace qtboy
 {
 
+// Read-only cartridge ROM, split into 16 KB banks.
+//
+// A ROM opened from a file is memory-mapped where possible, so banks are read straight from
+// the page cache (shared with every other process that maps the same file) instead of being
+// copied up front. Images read from a stream, or whose size isn't a whole number of banks,
+// are copied into memory instead.
 class Rom
 {	
 	public:
 	constexpr static auto Bank_size = 0x4000;
-	using Bank = std::array<uint8_t, Bank_size>; // 16 KB
     explicit Rom() = default;
 	explicit Rom(std::istream &is);
+    Rom(const Rom &) = delete;
+    Rom &operator=(const Rom &) = delete;
+    ~Rom();
+
+    // Open the ROM file at path, mapping it if possible. Returns nullptr if the file can't be
+    // opened.
+    static std::shared_ptr<const Rom> open(const std::string &path);
 	
-	uint8_t read(uint8_t bank, uint16_t adr) const;
-    std::vector<uint8_t> dump(uint8_t bank) const;
+	uint8_t read(uint16_t bank, uint16_t adr) const;
+    std::vector<uint8_t> dump(uint16_t bank) const;
     std::vector<uint8_t> dump() const;
+    size_t size() const; // bytes held in memory (or mapped)
+    size_t banks() const { return banks_; }
+    uint64_t hash() const; // hash64() of the whole image
+    bool is_mapped() const { return map_ != nullptr; }
 	
 	private:
-	std::vector<Bank> data_;
+    // Copy the whole stream, padding a partial trailing bank with 0xff.
+    void load(std::istream &is);
+
+    const uint8_t *data_ {nullptr}; // start of bank 0
+    size_t banks_ {0};
+    std::vector<uint8_t> buffer_ {}; // owns data_ when the ROM isn't mapped
+    void *map_ {nullptr};
+    size_t map_size_ {0};
 };
 	
 }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+
+#include "rom.hpp"
+
+namespace qtboy
+{
+
+// Hands out ROM images shared by every instance that loads the same file.
+//
+// A ROM is never written to, so there is no reason for 64 instances of the same game to hold
+// 64 copies of it. The registry only keeps weak references: an image is freed as soon as the
+// last cartridge using it goes away, and loaded again the next time it's asked for.
+class Rom_registry
+{
+    public:
+    struct Image_usage
+    {
+        std::string path;
+        size_t bytes {0}; // size of the image in memory
+        long users {0}; // number of cartridges sharing it
+    };
+
+    // The registry used by Gameboy::load_cartridge().
+    static Rom_registry &instance();
+
+    // Get the image of the ROM file at path, loading it if no one holds it yet. A file that
+    // changed on disk since it was loaded is loaded again. Returns nullptr if the file can't be
+    // opened.
+    std::shared_ptr<const Rom> load(const std::string &path);
+
+    // Images currently alive.
+    std::vector<Image_usage> images() const;
+
+    private:
+    struct Entry
+    {
+        std::weak_ptr<const Rom> rom;
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry> entries_; // keyed by canonical path
+};
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "link_cable.hpp"
+
+namespace qtboy
+{
+
+class Processor;
+
+class State_writer;
+class State_reader;
+
+// Serial port (SB ff01, SC ff02).
+//
+// Like the timer, nothing is ticked: a transfer on the internal clock just schedules the cycle
+// at which its 8 bits are done. With no cable plugged in, the bits shifted in are all 1s.
+//
+// With a cable, both ends run in windows of emulated cycles and meet at the end of each one
+// (see Link_cable). A finished internal clock transfer waits for the next meeting to swap
+// bytes with the other end, whose transfer (if armed on the external clock) completes at the
+// same meeting. Windows are short while either end has a transfer going, so bytes go through
+// about as fast as on hardware, and long otherwise, so idle machines rarely wait on each
+// other.
+class Serial
+{
+    public:
+    // Default sync windows in CPU cycles: about one byte at the normal clock speed while a
+    // transfer is going, a frame otherwise.
+    static constexpr uint32_t ACTIVE_WINDOW {4096};
+    static constexpr uint32_t IDLE_WINDOW {70224};
+
+    explicit Serial(Processor &p);
+
+    // Handle a finished transfer or sync point. Only needs to be called once the CPU cycle
+    // count has reached next_event().
+    void update();
+    uint64_t next_event() const { return next_event_; }
+    uint8_t read(uint16_t adr) const;
+    void write(uint8_t b, uint16_t adr);
+    // The fast clock (SC bit 1) only exists on the CGB.
+    void enable_cgb(bool b) { cgb_ = b; }
+
+    // Plug in a cable (nullptr unplugs it).
+    void set_link(std::shared_ptr<Link_cable> link);
+    void set_sync_window(uint32_t active, uint32_t idle);
+
+    void reset();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
+
+    private:
+    static constexpr uint64_t NEVER {std::numeric_limits<uint64_t>::max()};
+
+    // End a transfer with the byte shifted in.
+    void complete(uint8_t in);
+    // Meet the other end of the cable.
+    void sync();
+    void schedule() { next_event_ = transfer_end_ < sync_at_ ? transfer_end_ : sync_at_; }
+
+    Processor &cpu_;
+    bool cgb_ {false};
+    uint8_t sb_ {0}, sc_ {0};
+    uint64_t transfer_end_ {NEVER}; // cycle at which an internal clock transfer is done
+    bool master_done_ {false}; // an internal clock transfer is done but the peer isn't met yet
+    uint64_t next_event_ {NEVER};
+
+    std::shared_ptr<Link_cable> link_ {};
+    uint64_t sync_at_ {NEVER};
+    uint32_t active_window_ {ACTIVE_WINDOW}, idle_window_ {IDLE_WINDOW};
+};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "frame_tap.hpp"
+
+#include <string>
+
+struct qtboy_shm;
+
+namespace qtboy
+{
+
+class Gameboy;
+
+// Publishes the latest completed frame, the work RAM and high RAM and a frame counter of a
+// Gameboy in a named POSIX shared memory region (laid out as in qtboy_shm.h), so that other
+// processes on the same host can watch it without linking against the emulator.
+//
+// It sits between the PPU and the real renderer: install it with Gameboy::set_renderer() and
+// it passes everything on to next (if any). Each frame is published once, under a seqlock,
+// when the PPU presents it, so the cost is a few copies per frame whatever the number of
+// readers. Frames that aren't drawn (see Gameboy::set_output()) aren't published.
+class Shared_memory_export : public Frame_tap
+{
+    public:
+    // Create (or take over) the region called name (e.g. "/qtboy"). Throws
+    // std::runtime_error if it can't be created, or on systems without shm_open().
+    Shared_memory_export(const std::string &name, const Gameboy &gb, Renderer *next = nullptr);
+    // Unmaps and unlinks the region. Readers that have it mapped keep their copy.
+    ~Shared_memory_export();
+    Shared_memory_export(const Shared_memory_export &) = delete;
+    Shared_memory_export &operator=(const Shared_memory_export &) = delete;
+
+    void present_screen() override;
+
+    const std::string &name() const { return name_; }
+
+    private:
+    std::string name_;
+    const Gameboy &gb_;
+    qtboy_shm *shm_ {nullptr};
+};
+
+}
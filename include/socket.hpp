@@ -0,0 +1,58 @@
+#pragma once
+
+// Portable bits of BSD sockets/Winsock shared by the link cable, netplay and frame streaming.
+// Only included by their .cpp files: it pulls in the platform's socket headers.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace qtboy
+{
+
+#ifdef _WIN32
+using Socket = SOCKET;
+constexpr Socket NO_SOCKET {INVALID_SOCKET};
+#else
+using Socket = int;
+constexpr Socket NO_SOCKET {-1};
+#endif
+
+// Flags for send(): a peer that went away must not kill the process with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS {MSG_NOSIGNAL};
+#else
+constexpr int SEND_FLAGS {0};
+#endif
+
+void close_socket(Socket s);
+
+// Make send() and recv() on s return instead of waiting. Returns false on failure.
+bool set_nonblocking(Socket s);
+
+// True if the last send() or recv() on a non-blocking socket failed only because it would
+// have had to wait.
+bool would_block();
+
+// Keeps the socket library initialised while any instance exists (Winsock needs it, elsewhere
+// it does nothing). Throws std::runtime_error if it can't be initialised.
+class Socket_library
+{
+    public:
+    Socket_library();
+    ~Socket_library();
+    Socket_library(const Socket_library &) = delete;
+    Socket_library &operator=(const Socket_library &) = delete;
+};
+
+}
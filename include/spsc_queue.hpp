@@ -0,0 +1,64 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace qtboy
+{
+
+// Fixed-capacity, lock-free queue for exactly one producer thread and one consumer thread.
+// N must be a power of 2.
+template <typename T, std::size_t N>
+class Spsc_queue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Spsc_queue capacity must be a power of 2");
+
+    public:
+    // Push an item onto the queue. Returns false (and drops the item) if the queue is full.
+    // Must only be called by the producer thread.
+    bool push(const T &item)
+    {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == N)
+            return false;
+        buf_[tail & (N - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop the oldest item into out. Returns false if the queue is empty.
+    // Must only be called by the consumer thread.
+    bool pop(T &out)
+    {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        out = buf_[head & (N - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    std::size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t capacity() { return N; }
+
+    private:
+    std::array<T, N> buf_ {};
+    // keep the producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<std::size_t> head_ {0};
+    alignas(64) std::atomic<std::size_t> tail_ {0};
+};
+
+}
+
+#endif // SPSC_QUEUE_HPP
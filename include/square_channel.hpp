@@ -2,11 +2,15 @@
 #define CHANNEL_HPP
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
 
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Square_channel
 {
     public:
@@ -17,6 +21,8 @@ class Square_channel
     void length_tick();
     void envelope_tick();
     void sweep_tick();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     private:
     uint16_t freq();
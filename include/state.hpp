@@ -0,0 +1,102 @@
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace qtboy
+{
+
+// Save states are flat little binary streams. Every component writes its fields in a fixed
+// order with save_state() and reads them back in the same order with load_state(). Nothing is
+// allocated while saving or loading; the buffer is provided by the caller.
+
+// Current version of the save state format. Bump this whenever a component's fields change.
+constexpr uint16_t STATE_VERSION {2};
+
+class State_writer
+{
+    public:
+    // With buf == nullptr nothing is written, only the number of bytes needed is counted.
+    explicit State_writer(uint8_t *buf = nullptr, std::size_t size = 0)
+        : buf_ {buf}, size_ {size}
+    {}
+
+    template <typename T>
+    void put(const T &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "can only put plain values");
+        put_bytes(&v, sizeof(T));
+    }
+
+    void put_bytes(const void *p, std::size_t n)
+    {
+        if (buf_)
+        {
+            if (n > size_ - pos_)
+                throw std::runtime_error {"Save state buffer is too small"};
+            std::memcpy(buf_ + pos_, p, n);
+        }
+        pos_ += n;
+    }
+
+    // Number of bytes written (or counted) so far.
+    std::size_t size() const { return pos_; }
+
+    // In digest mode, large memory regions write a hash of their contents instead of the
+    // contents themselves. Such a stream identifies a state (see Gameboy::state_hash()) but
+    // can't be loaded.
+    void set_digest(bool b) { digest_ = b; }
+    bool digest() const { return digest_; }
+
+    private:
+    uint8_t *buf_;
+    std::size_t size_;
+    std::size_t pos_ {0};
+    bool digest_ {false};
+};
+
+class State_reader
+{
+    public:
+    State_reader(const uint8_t *buf, std::size_t size)
+        : buf_ {buf}, size_ {size}
+    {}
+
+    template <typename T>
+    void get(T &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "can only get plain values");
+        get_bytes(&v, sizeof(T));
+    }
+
+    template <typename T>
+    T get()
+    {
+        T v {};
+        get(v);
+        return v;
+    }
+
+    void get_bytes(void *p, std::size_t n)
+    {
+        if (n > size_ - pos_)
+            throw std::runtime_error {"Save state is truncated"};
+        std::memcpy(p, buf_ + pos_, n);
+        pos_ += n;
+    }
+
+    std::size_t size() const { return pos_; }
+
+    private:
+    const uint8_t *buf_;
+    std::size_t size_;
+    std::size_t pos_ {0};
+};
+
+}
+
+#endif // STATE_HPP
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+
+namespace qtboy
+{
+
+// Fast non-cryptographic 64-bit hash (MurmurHash64A).
+inline uint64_t hash64(const void *data, size_t len, uint64_t seed = 0)
+{
+    constexpr uint64_t m {0xc6a4a7935bd1e995ull};
+    constexpr int r {47};
+    const auto *p = static_cast<const uint8_t *>(data);
+    uint64_t h {seed ^ (len * m)};
+    for (const uint8_t *end {p + (len & ~size_t {7})}; p != end; p += 8)
+    {
+        uint64_t k;
+        std::memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (len & 7)
+    {
+        uint64_t k {0};
+        std::memcpy(&k, p, len & 7);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Writes one state hash per frame to a file, to check later that two runs went the same way
+// (see first_divergence()). The file is a 8 byte header followed by little endian 64-bit hashes.
+class Hash_recorder
+{
+    public:
+    // Throws std::runtime_error if path can't be opened for writing.
+    explicit Hash_recorder(const std::string &path);
+
+    void record(uint64_t hash);
+    uint64_t frames() const { return frames_; }
+
+    private:
+    std::ofstream out_;
+    uint64_t frames_ {0};
+};
+
+// Compare two files written by Hash_recorder. Returns the first frame whose hash differs (a
+// stream that ends early diverges where it ends), or nothing if both runs are identical.
+// Throws std::runtime_error if a file can't be read or isn't a hash stream.
+std::optional<uint64_t> first_divergence(const std::string &path_a, const std::string &path_b);
+
+}
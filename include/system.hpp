@@ -7,6 +7,7 @@
 #include <condition_variable>
 #include <atomic>
 #include <memory>
+#include <chrono>
 
 #include "processor.hpp"
 #include "memory.hpp"
@@ -14,10 +15,16 @@
 #include "renderer.hpp"
 #include "debug_types.hpp"
 #include "timer.hpp"
+#include "serial.hpp"
+#include "link_cable.hpp"
 #include "joypad.hpp"
 #include "apu.hpp"
 #include "speaker.hpp"
 #include "debugger.hpp"
+#include "rewind_buffer.hpp"
+#include "reusable_thread.hpp"
+#include "state_hash.hpp"
+#include "movie.hpp"
 
 namespace qtboy
 {
@@ -61,19 +68,187 @@ class Gameboy
     // Run the CPU for cyc cycles.
     size_t execute(size_t cyc);
 
+    // Run n frames right away on the calling thread (as run_concurrently() would, without
+    // throttling). Throws std::runtime_error if no ROM is loaded.
+    void run_frames(size_t n);
+
     // Press a specified input on the joypad.
     void press(Joypad::Input i);
 
     // Release a specified input on the joypad.
     void release(Joypad::Input i);
 
+    // Start recording a movie from the current state. From now on, input from press() and
+    // release() only reaches the game at the start of a frame, so that it can be replayed
+    // at exactly the same point. Throws std::runtime_error if no ROM is loaded.
+    void start_movie_recording();
+
+    // Stop recording and return the movie (empty if none was being recorded).
+    Movie stop_movie_recording();
+
+    // Load the movie's start state and replay its input, one entry per frame; live input is
+    // ignored until it ends. Loading another state or rewinding during playback makes it
+    // diverge. Throws std::runtime_error if it was recorded on another ROM.
+    void play_movie(const Movie &m);
+
+    // Returns true while a movie is being played back.
+    bool movie_playing() const;
+
+    // Plug a link cable into the serial port (nullptr unplugs it). Once plugged in, the two
+    // machines only run as fast as the slower one: while one is stopped, the other waits for
+    // it at the next sync point. The cable stays plugged in until it is replaced or the
+    // Gameboy is destroyed.
+    void set_link(std::shared_ptr<Link_cable> cable);
+
+    // Number of CPU cycles between two sync points of the link cable while a transfer is
+    // going (active) and otherwise (idle). Longer windows mean less waiting on the other
+    // machine but more latency for each byte. Both ends must use the same values.
+    void set_link_window(uint32_t active, uint32_t idle);
+
+    // Set all joypad inputs at once (see Joypad::state()).
+    void set_input(uint8_t s);
+
+    // Enables or disables video and audio output, e.g. while frames that were already shown
+    // are run again. Not to be combined with run-ahead, which controls output itself.
+    void set_output(bool b);
+
+    // Set up the downsampled observation output (see Ppu::Observation_format). Only the frame
+    // that starts in the last frame's worth of cycles of each run_frames() call is observed,
+    // and the call runs on until that frame is complete (for less than a frame more), so
+    // frames skipped in between cost nothing extra. Throws std::runtime_error if the format is
+    // larger than the screen.
+    void set_observation(const Ppu::Observation_format &f);
+
+    // The observation of the last frame run by run_frames() (width * height bytes). The
+    // pointer stays valid until set_observation() is called again.
+    const uint8_t *observation() const;
+
+    // Make the cartridge's real-time clock read start_time (seconds since the epoch) plus the
+    // emulated time since this call, instead of the system clock, so that it runs the same on
+    // every machine. nullopt goes back to the system clock. When called before loading a ROM,
+    // the cartridge's clock also starts counting from start_time.
+    void set_emulated_rtc(std::optional<int64_t> start_time);
+
+    // Rom::hash() of the loaded ROM (0 if none is loaded).
+    uint64_t rom_hash() const;
+
     // Enables or disables CPU throttling (unlimited FPS)
     void set_throttle(bool b);
 
     void toggle_sound(bool b);
 
+    // Enables or disables generating audio samples on a separate thread. The emulation thread
+    // then only logs APU register writes.
+    void set_threaded_audio(bool b);
+
     void set_force_dmg(bool b);
 
+    // Directory .sav files are read from when a ROM is loaded and written to on exit
+    // ("saves" by default). An empty path disables save files, e.g. for reproducible runs.
+    void set_save_dir(const std::string &dir);
+
+    // Enables or disables catch-up synchronisation. Instead of being stepped after every CPU
+    // instruction, the PPU and APU are only brought up to date when their registers, VRAM or
+    // OAM are accessed, when the PPU may raise an interrupt, and at the end of execute().
+    void set_catch_up(bool b);
+
+    // Size in bytes of a save state of the loaded ROM. It doesn't change while the ROM is loaded.
+    size_t state_size() const;
+
+    // Serialize the whole machine into buf. Returns the number of bytes written. Throws
+    // std::runtime_error if size is less than state_size().
+    size_t save_state(uint8_t *buf, size_t size);
+
+    // Restore a state written by save_state(). Throws std::runtime_error (leaving the machine
+    // untouched) if the state is from another ROM or version of the format.
+    void load_state(const uint8_t *buf, size_t size);
+
+    // Enables or disables rewinding. While enabled, a save state is kept every interval frames,
+    // using at most budget bytes of memory for the history.
+    void set_rewind(bool b, size_t budget = 64 << 20, unsigned interval = 2);
+
+    // While b is true, the emulator steps backwards through the rewind history (one snapshot
+    // per frame) instead of running forward.
+    void set_rewinding(bool b);
+
+    // Size, compression ratio and length of the rewind history.
+    Rewind_buffer::Stats rewind_stats() const;
+
+    // Enables run-ahead when frames > 0: after each frame, the next frames are emulated
+    // speculatively with the current input and only the last one is shown, hiding that many
+    // frames of the game's input lag. The machine then goes back to the real frame. With
+    // on_worker, the speculative frames run on a second instance on another thread.
+    void set_run_ahead(unsigned frames, bool on_worker = false);
+
+    // Create an independent copy of the machine in its current state, e.g. to explore several
+    // inputs from the same point. The copy shares the (read-only) ROM data with this instance
+    // instead of reloading it, has no renderer or speaker and never writes save files.
+    // Throws std::runtime_error if no ROM is loaded.
+    std::unique_ptr<Gameboy> clone();
+
+    // 64-bit hash of the whole machine state: two machines with the same hash will run the
+    // same from here on. Only the RAM pages written since the last call are hashed again, so
+    // it is cheap enough to call every frame.
+    uint64_t state_hash();
+
+    // Write the state hash after every frame run by run_concurrently() to the file at path
+    // (see Hash_recorder). An empty path stops recording. Throws std::runtime_error if the
+    // file can't be opened.
+    void set_hash_recording(const std::string &path);
+
+    struct Memory_usage
+    {
+        size_t private_bytes {0}; // machine state and buffers owned by this instance
+        size_t rom_bytes {0}; // size of the ROM image, shared by rom_users instances
+        long rom_users {0};
+    };
+
+    // Memory held by this instance. The ROM image is shared with every instance that loaded
+    // the same file (see Rom_registry::images() for the totals per image).
+    Memory_usage memory_usage() const;
+
+    // Wall time spent in each part of the machine since profiling was enabled.
+    struct Profile
+    {
+        std::chrono::nanoseconds cpu {0}; // instructions and memory accesses
+        std::chrono::nanoseconds ppu {0};
+        std::chrono::nanoseconds apu {0};
+        std::chrono::nanoseconds timers {0}; // timer and serial port
+    };
+
+    // Enables or disables profiling (and resets the profile). Only one instruction in
+    // PROFILE_INTERVAL is timed and the times are scaled up, so that the clock reads don't
+    // skew the run being measured. With catch-up synchronisation, PPU and APU work triggered
+    // by memory accesses counts as CPU time.
+    void set_profiling(bool b);
+    Profile profile() const;
+    static constexpr unsigned PROFILE_INTERVAL {64};
+
+    // Performance of the emulation thread started by run_concurrently(), e.g. to diagnose
+    // stutter. Rates and times are averages over the last METRICS_PERIOD.
+    struct Metrics
+    {
+        double speed {0}; // emulated time per wall-clock time (1: full speed)
+        double fps {0}; // frames emulated per second
+        double ips {0}; // CPU instructions per second
+        // Wall time per frame running the CPU (with the timers), PPU and APU, sampled as with
+        // set_profiling(), and waiting for the audio buffer to drain, in ms
+        double cpu_ms {0}, ppu_ms {0}, apu_ms {0}, sync_ms {0};
+        int audio_queued {0}; // samples in the speaker's buffer after the last frame
+        // Frames emulated without a new picture being presented (LCD off, run-ahead worker
+        // behind, ...) since the metrics were enabled
+        uint64_t frames_skipped {0};
+    };
+
+    // Enables or disables the metrics (and resets them). While enabled, the emulation thread
+    // updates a few counters once per frame and times the components like set_profiling().
+    void set_metrics(bool b);
+
+    // Latest metrics. Never waits for the emulation thread, so it can be polled from a GUI
+    // timer; each field is consistent, but they may come from two consecutive periods.
+    Metrics metrics() const;
+    static constexpr std::chrono::milliseconds METRICS_PERIOD {500};
+
     // Get the total number of cycles ran by the CPU.
     size_t cycles() const;
 
@@ -83,6 +258,14 @@ class Gameboy
     // Returns true if the emulator is not paused nor stopped.
     bool is_running() const;
 
+    // Work RAM: c000-dfff, followed on the CGB by banks 2-7 (size bytes in all). The pointer
+    // stays valid as long as the Gameboy. Only read through it; writes must go through
+    // memory_write() so that state_hash() sees them.
+    const uint8_t *work_ram(size_t &size) const;
+
+    // High RAM: ff80-fffe (size bytes), on the same terms as work_ram().
+    const uint8_t *high_ram(size_t &size) const;
+
     // memory read/write functions passed as callbacks to CPU
     uint8_t memory_read(uint16_t adr);
     void memory_write(uint8_t b, uint16_t adr);
@@ -147,13 +330,67 @@ class Gameboy
     // Runs the emulator. This is passed to emu_thread_ in run_concurrently().
     void run();
 
+    // save_state()/load_state() without locking mutex_ (for use from the emulation thread)
+    void write_state(State_writer &w);
+    void read_state(State_reader &r);
+
+    // (Re)create rewind_ for the loaded ROM.
+    void create_rewind_buffer();
+
+    // Called by run() after each frame while the metrics are enabled. presented is what
+    // presented_frames() returned before the frame.
+    void update_metrics(uint64_t presented);
+
+    // Frames presented by the PPU, including the run-ahead instance's.
+    uint64_t presented_frames() const;
+
+    // Called by run() after each frame: take a snapshot, or step back if rewinding.
+    void rewind_frame();
+
+    // Run until the PPU finishes a frame (or for a frame's worth of cycles with the LCD off).
+    size_t run_frame();
+
+    // Run one real frame plus the speculative ones (see set_run_ahead()).
+    void run_ahead_frame();
+
+    // Load a cartridge with the given ROM data and set the machine up for it.
+    void insert_rom(std::shared_ptr<const Rom> rom);
+
+    // Create a secondary instance with the same ROM and options (in its power-on state).
+    std::unique_ptr<Gameboy> make_sibling() const;
+
+    // One iteration of run(): apply movie input, run a frame, then rewind and hash recording.
+    void emulate_frame();
+
+    // Apply (and record) the input of the next movie frame.
+    void movie_frame();
+
+    // set_emulated_rtc() without locking mutex_
+    void use_emulated_clock(std::optional<int64_t> start_time);
+
+    // state_hash() without locking mutex_
+    uint64_t hash_state();
+
+    // Create ahead_ and ahead_thread_ for the loaded ROM.
+    void create_run_ahead_instance();
+
+    // Make the link cable (if any) let go of the emulation thread, or hold it again.
+    void interrupt_link(bool b);
+
     private:
-    // Title of currently loaded ROM
+    // Title and path of currently loaded ROM
     std::string rom_title_ {};
+    std::string rom_path_ {};
+
+    // Set on instances used internally (e.g. for run-ahead). They never write save files.
+    bool secondary_ {false};
 
     // Flag indicated if ROM is loaded (using load_cartridge())
     bool rom_loaded_ {false};
 
+    // Size of a save state of the loaded ROM (computed in load_cartridge())
+    size_t state_size_ {0};
+
     // Flag indicating if CGB mode is enabled. CGB mode is automatically turned on if a CGB
     // ROM is loaded (and force_dmg_ is false).
     bool cgb_mode_ {!force_dmg_};
@@ -167,6 +404,45 @@ class Gameboy
     // Option to enable/disable CPU throttling
     std::atomic<bool> throttle_ {true};
 
+    // Option to only synchronise the PPU and APU with the CPU when needed (see set_catch_up())
+    bool catch_up_ {false};
+
+    // Rewind options and history (see set_rewind())
+    bool rewind_enabled_ {false};
+    size_t rewind_budget_ {0};
+    unsigned rewind_interval_ {1};
+    std::unique_ptr<Rewind_buffer> rewind_;
+    std::atomic<bool> rewinding_ {false};
+    unsigned rewind_frames_ {0}; // frames since the last snapshot
+    std::vector<uint8_t> rewind_state_; // last state stepped back to
+    bool rewind_state_valid_ {false};
+
+    // Run-ahead options and state (see set_run_ahead())
+    unsigned run_ahead_ {0};
+    bool run_ahead_worker_ {false};
+    std::vector<uint8_t> run_ahead_state_; // state of the real frame
+    std::unique_ptr<Gameboy> ahead_; // instance running the speculative frames on_worker
+    std::unique_ptr<Reusable_thread> ahead_thread_; // runs ahead_ (destroyed first)
+
+    // Scratch state used by clone()
+    std::vector<uint8_t> clone_state_;
+
+    // Movie being recorded or played (see start_movie_recording() and play_movie())
+    enum class Movie_state {None, Recording, Playing};
+    std::atomic<Movie_state> movie_state_ {Movie_state::None};
+    Movie movie_ {};
+    size_t movie_pos_ {0}; // next frame to play
+    std::atomic<uint8_t> live_input_ {0}; // inputs currently held (Joypad::state() layout)
+
+    // Link cable plugged in the serial port (guarded by link_mutex_, since the emulation
+    // thread may be waiting on it with mutex_ held)
+    std::shared_ptr<Link_cable> link_ {};
+    std::mutex link_mutex_;
+
+    // Digest stream for state_hash() and the optional per-frame recording of it
+    std::vector<uint8_t> hash_buf_;
+    std::unique_ptr<Hash_recorder> hash_recorder_;
+
     // Thread for running concurrent emulation
     std::thread emu_thread_;
 
@@ -188,6 +464,33 @@ class Gameboy
     // Assigned by the return value of debug_callback_ to indicate if emulation should break
     bool debug_break_ {false};
 
+    // Sampled time per component (see set_profiling())
+    bool profiling_ {false};
+    unsigned profile_count_ {0}; // instructions since the last timed one
+    Profile profile_ {};
+
+    // Metrics (see set_metrics()). The window is only touched by the emulation thread (or
+    // with mutex_ held); the results are published in metrics_out_ for metrics().
+    struct Metrics_window
+    {
+        std::chrono::steady_clock::time_point start {};
+        uint64_t cycles {0}, instructions {0};
+        unsigned frames {0};
+        std::chrono::nanoseconds sync {0};
+        Profile profile {}; // profile_ at start
+    };
+    struct Published_metrics
+    {
+        std::atomic<double> speed {0}, fps {0}, ips {0};
+        std::atomic<double> cpu_ms {0}, ppu_ms {0}, apu_ms {0}, sync_ms {0};
+        std::atomic<int> audio_queued {0};
+        std::atomic<uint64_t> frames_skipped {0};
+    };
+    bool metrics_ {false};
+    Metrics_window metrics_window_ {};
+    Published_metrics metrics_out_ {};
+    uint64_t instructions_ {0}; // run by the CPU, for Metrics::ips
+
 
 	Processor cpu_ 
 	{
@@ -202,10 +505,11 @@ class Gameboy
         cpu_
     };
     Timer timer_ {cpu_}; // reference to CPU so timer can request Timer interrupt
+    Serial serial_ {cpu_}; // reference to CPU so serial can request Serial interrupt
     Joypad joypad_ {cpu_}; // reference to CPU so joypad can request Joypad interrupt
     Apu apu_ {};
     // references to other components so that memory bus can access their internal registers
-    Memory memory_ { cpu_, ppu_, timer_, joypad_, apu_};
+    Memory memory_ { cpu_, ppu_, timer_, joypad_, apu_, serial_};
 };
 
 
@@ -1,32 +1,50 @@
 #pragma once
 
 #include <cstdint>
+#include <limits>
 
 namespace qtboy
 {
 
 class Processor;
 
+class State_writer;
+class State_reader;
+
+// DIV and TIMA are not ticked. Their values are derived from the CPU cycle count when read, and
+// the only scheduled work is the next TIMA overflow.
 class Timer
 {
     public:
     Timer(Processor &p);
 
-    void update(std::size_t cycles);
+    // Process the TIMA overflows that are due. Only needs to be called once the CPU cycle count
+    // has reached next_event().
+    void update();
+    // CPU cycle at which TIMA next overflows.
+    uint64_t next_event() const { return overflow_cycle_; }
     uint8_t read(uint16_t adr);
     void write(uint8_t b, uint16_t adr);
     void reset();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     private:
-    void tima_overflow();
+    // Number of TIMA increments between the cycles from and to.
+    uint64_t increments(uint64_t from, uint64_t to) const;
+    // Bring tima_ up to date with the current cycle.
+    void rebase();
+    void schedule_overflow();
 
     private:
+    static constexpr uint64_t NEVER {std::numeric_limits<uint64_t>::max()};
+
     Processor &cpu_;
-    int div_ticks_ {0};
-    int tima_ticks_ {0};
+    uint64_t div_base_ {0}; // cycle at which the internal 16-bit divider was last 0
+    uint64_t tima_base_ {0}; // cycle at which tima_ was last brought up to date
+    uint64_t overflow_cycle_ {NEVER};
     uint8_t tima_ {0}, tma_ {0}; // TIMA ff05, ff06
     uint8_t tac_ {0}; // ff07
-    uint16_t div_ {0};
     static constexpr uint16_t FREQUENCIES[] {1024, 16, 64, 256};
 };
 
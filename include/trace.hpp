@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace qtboy
+{
+
+// Timing probes around the emulator's main pieces of work (CPU batches, scanlines, APU
+// batches, DMAs, save writes, frame presentation), recorded for a window of frames and
+// exported as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev) with one track
+// per thread, e.g. to find where a frame's time goes or where the emulation and GUI threads
+// wait on each other.
+//
+// Outside of a recording, a probe costs one relaxed atomic load. While recording, each thread
+// writes its events into its own ring buffer (no locking), keeping the last RING_SIZE.
+// When a thread exits, the next thread with the same name goes on with its ring (and track).
+class Trace
+{
+    public:
+    // Record the count frames (0: until stop()) that end after the next skip frames. Frames
+    // are counted by frame_end(), across all instances. Clears the previous recording; call
+    // it while no trace is active.
+    static void start(unsigned count, unsigned skip = 0);
+
+    // End the recording now.
+    static void stop();
+
+    // True from start() until the window of frames is over or stop() is called.
+    static bool active() { return active_.load(std::memory_order_relaxed); }
+
+    // True while probes record.
+    static bool recording() { return recording_.load(std::memory_order_relaxed); }
+
+    // Called by the emulator when a frame ends: moves the window along and records the frame
+    // as an event of its own.
+    static void frame_end();
+
+    // Name of the calling thread's track (a string literal, or one that outlives the trace).
+    static void set_thread_name(const char *name);
+
+    // Write the events recorded as a trace-event JSON object. Call it when no trace is
+    // active. The second form throws std::runtime_error if the file can't be written.
+    static void write_json(std::ostream &out);
+    static void write_json(const std::string &path);
+
+    static constexpr size_t RING_SIZE {1 << 16};
+
+    private:
+    friend class Trace_scope;
+
+    // Nanoseconds on the steady clock.
+    static uint64_t now();
+    static void record(const char *name, uint64_t start, uint64_t end);
+
+    static std::atomic<bool> active_;
+    static std::atomic<bool> recording_;
+};
+
+// Records the time between its construction and destruction as an event called name (a
+// string literal), if a trace is recording and on is true.
+class Trace_scope
+{
+    public:
+    explicit Trace_scope(const char *name, bool on = true)
+        : name_ {name}, start_ {on && Trace::recording() ? Trace::now() : 0}
+    {
+    }
+
+    ~Trace_scope()
+    {
+        if (start_)
+            Trace::record(name_, start_, Trace::now());
+    }
+
+    Trace_scope(const Trace_scope &) = delete;
+    Trace_scope &operator=(const Trace_scope &) = delete;
+
+    private:
+    const char *name_;
+    const uint64_t start_; // 0: not recording
+};
+
+}
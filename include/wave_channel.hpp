@@ -2,11 +2,15 @@
 #define WAVE_CHANNEL_HPP
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
 
 namespace qtboy
 {
 
+class State_writer;
+class State_reader;
+
 class Wave_channel
 {
     public:
@@ -15,6 +19,8 @@ class Wave_channel
     void tick(size_t cycles);
     uint8_t output();
     void length_tick();
+    void save_state(State_writer &w) const;
+    void load_state(State_reader &r);
 
     private:
     uint16_t freq();
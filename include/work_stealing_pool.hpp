@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qtboy
+{
+
+// Fixed set of worker threads, each with its own queue of tasks.
+//
+// submit() deals tasks out to the queues in turn. A worker takes the newest task from its own
+// queue, and when that runs dry, steals the oldest one from another worker's. Tasks of very
+// different lengths (a ROM that runs for an hour next to one that fails on load) then still
+// keep every thread busy until the end, without all of them fighting over a single queue.
+// Workers claim tasks with an atomic counter and only take the queues' own locks; the
+// pool-wide mutex is only for going to sleep when there is nothing to do.
+class Work_stealing_pool
+{
+    public:
+    // threads == 0 uses one thread per core.
+    explicit Work_stealing_pool(unsigned threads = 0);
+    // Waits for the queued tasks, then joins the workers.
+    ~Work_stealing_pool();
+    Work_stealing_pool(const Work_stealing_pool &) = delete;
+    Work_stealing_pool &operator=(const Work_stealing_pool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished. If a task threw, the first exception is
+    // rethrown here (the other tasks still run).
+    void wait();
+
+    unsigned threads() const { return static_cast<unsigned>(workers_.size()); }
+    // Number of tasks run by a worker other than the one they were given to.
+    size_t steals() const { return steals_; }
+
+    private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work(size_t id);
+    // Claim one of the queued tasks. Returns false if there are none.
+    bool claim();
+    // Take a task from queue id, or steal one. Returns false if every queue is empty.
+    bool take(size_t id, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_ {0}; // queue the next submitted task goes to
+
+    std::atomic<size_t> queued_ {0}; // tasks sitting in a queue and not claimed
+    std::atomic<size_t> unfinished_ {0}; // tasks submitted and not finished
+    std::atomic<size_t> steals_ {0};
+
+    // Guards exiting_ and error_. queued_ is raised, and the end of the last unfinished task
+    // notified, with it held, so that a worker or wait() going to sleep can't miss it.
+    std::mutex mutex_;
+    std::condition_variable work_cv_, done_cv_;
+    bool exiting_ {false};
+    std::exception_ptr error_ {};
+};
+
+}
@@ -0,0 +1,322 @@
+// Headless runner: runs a ROM as fast as possible with no video or audio output and reports
+// how fast the emulator went. This is the standard throughput benchmark. With --batch, runs
+// the jobs of a manifest (see batch.hpp) on every core and writes a JSON report instead.
+
+#include "system.hpp"
+#include "batch.hpp"
+#include "frame_stream.hpp"
+#include "recorder.hpp"
+#include "shared_memory_export.hpp"
+#include "trace.hpp"
+#include "frame_sink.hpp"
+#include "speaker.hpp"
+#include "graphic_types.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace qtboy;
+
+namespace
+{
+
+constexpr double CLOCK_HZ {4194304.0};
+constexpr double CYCLES_PER_FRAME {70224.0};
+
+// Drops every sample. Never reports queued samples, so nothing waits on it.
+class Null_speaker : public Speaker
+{
+    public:
+    void queue_samples(const Raw_audio &) override {}
+    int samples_queued() override { return 0; }
+    void clear_samples() override {}
+};
+
+// Write an RGB555 frame as a binary PPM.
+void write_ppm(const std::string &path, const Frame_sink::Frame &frame)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error {"Could not open " + path};
+    out << "P6\n" << Frame_sink::WIDTH << ' ' << Frame_sink::HEIGHT << "\n255\n";
+    for (Color c : frame)
+    {
+        // expand 5-bit channels to 8 bits
+        auto expand = [](unsigned v) { return static_cast<char>((v << 3) | (v >> 2)); };
+        const char px[3] {expand((c >> 10) & 0x1f), expand((c >> 5) & 0x1f), expand(c & 0x1f)};
+        out.write(px, 3);
+    }
+}
+
+void usage()
+{
+    std::cerr << "usage: qtboy ROM [options]\n"
+                 "       qtboy --batch MANIFEST [--jobs N] [--timeout S] [--report FILE]\n"
+                 "  --frames N         run N frames (default 3600)\n"
+                 "  --cycles N         run N CPU cycles instead\n"
+                 "  --dmg              run CGB games in DMG mode\n"
+                 "  --catch-up         catch-up PPU/APU synchronisation\n"
+                 "  --threaded-audio   generate audio samples on a second thread\n"
+                 "  --no-profile       don't time the components\n"
+                 "  --dump-frame FILE  write the last frame to FILE (PPM)\n"
+                 "  --hash             print the final state hash\n"
+                 "  --shm NAME         publish each frame and the RAM in shared memory NAME\n"
+                 "  --stream PORT      stream frames to viewers on localhost:PORT\n"
+                 "  --record FILE      record video and audio to FILE (.y4m + .wav, or .qbv)\n"
+                 "  --trace FILE       write a Chrome trace of frames FIRST to FIRST+COUNT-1 to FILE\n"
+                 "  --trace-window FIRST:COUNT  (default 0:60)\n"
+                 "batch options:\n"
+                 "  --jobs N           threads to run jobs on (default: one per core)\n"
+                 "  --timeout S        default wall-clock limit per job in seconds\n"
+                 "  --report FILE      write the JSON report to FILE instead of stdout\n";
+}
+
+int run_batch_mode(int argc, char *argv[])
+{
+    const std::string manifest {argv[2]};
+    unsigned threads {0};
+    Batch_job defaults {};
+    std::string report_path {};
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string arg {argv[i]};
+        const bool has_value {i + 1 < argc};
+        if (arg == "--jobs" && has_value)
+            threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        else if (arg == "--timeout" && has_value)
+            defaults.timeout = std::stod(argv[++i]);
+        else if (arg == "--report" && has_value)
+            report_path = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    const auto jobs = read_manifest(manifest, defaults);
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = qtboy::run_batch(jobs, threads);
+    const std::chrono::duration<double, std::milli> wall {std::chrono::steady_clock::now() - start};
+
+    size_t passed {0};
+    for (const auto &r : results)
+    {
+        passed += r.status == Batch_result::Status::Pass;
+        if (r.status != Batch_result::Status::Pass)
+            std::cerr << to_string(r.status) << ": " << r.job.rom << ": " << r.message << '\n';
+    }
+    std::cerr << passed << "/" << results.size() << " jobs passed in " << wall.count()
+              << " ms on " << threads << " threads\n";
+    if (report_path.empty())
+    {
+        write_report(std::cout, results, wall.count(), threads);
+    }
+    else
+    {
+        std::ofstream out(report_path);
+        if (!out)
+            throw std::runtime_error {"Could not open " + report_path};
+        write_report(out, results, wall.count(), threads);
+    }
+    return passed == results.size() ? 0 : 2;
+}
+
+double percent(std::chrono::nanoseconds part, std::chrono::nanoseconds total)
+{
+    return total.count() ? 100.0 * part.count() / total.count() : 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && std::string(argv[1]) == "--batch")
+    {
+        try
+        {
+            return run_batch_mode(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage();
+        return 1;
+    }
+    const std::string rom_path {argv[1]};
+    unsigned long long frames {3600}, cycles {0};
+    bool dmg {false}, catch_up {false}, threaded_audio {false}, profile {true}, hash {false};
+    std::string frame_path {}, shm_name {}, record_path {}, trace_path {};
+    unsigned trace_first {0}, trace_count {60};
+    int stream_port {-1};
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg {argv[i]};
+        const bool has_value {i + 1 < argc};
+        if (arg == "--frames" && has_value)
+            frames = std::stoull(argv[++i]);
+        else if (arg == "--cycles" && has_value)
+            cycles = std::stoull(argv[++i]);
+        else if (arg == "--dmg")
+            dmg = true;
+        else if (arg == "--catch-up")
+            catch_up = true;
+        else if (arg == "--threaded-audio")
+            threaded_audio = true;
+        else if (arg == "--no-profile")
+            profile = false;
+        else if (arg == "--dump-frame" && has_value)
+            frame_path = argv[++i];
+        else if (arg == "--hash")
+            hash = true;
+        else if (arg == "--shm" && has_value)
+            shm_name = argv[++i];
+        else if (arg == "--stream" && has_value)
+            stream_port = std::stoi(argv[++i]);
+        else if (arg == "--record" && has_value)
+            record_path = argv[++i];
+        else if (arg == "--trace" && has_value)
+            trace_path = argv[++i];
+        else if (arg == "--trace-window" && has_value)
+        {
+            const std::string window {argv[++i]};
+            const auto colon = window.find(':');
+            trace_first = static_cast<unsigned>(std::stoul(window.substr(0, colon)));
+            if (colon != std::string::npos)
+                trace_count = static_cast<unsigned>(std::stoul(window.substr(colon + 1)));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        Gameboy gb;
+        Frame_sink renderer;
+        // outputs are chained in front of the sink
+        Renderer *output {&renderer};
+        std::unique_ptr<Frame_stream_server> stream {};
+        if (stream_port >= 0)
+        {
+            Frame_stream_server::Options options {};
+            options.port = static_cast<uint16_t>(stream_port);
+            stream = std::make_unique<Frame_stream_server>(gb, options, output);
+            output = stream.get();
+            std::fprintf(stderr, "streaming on 127.0.0.1:%u\n", stream->port());
+        }
+        std::unique_ptr<Shared_memory_export> shm {};
+        if (!shm_name.empty())
+        {
+            shm = std::make_unique<Shared_memory_export>(shm_name, gb, output);
+            output = shm.get();
+        }
+        std::shared_ptr<Speaker> speaker {std::make_shared<Null_speaker>()};
+        std::unique_ptr<Recorder> recorder {};
+        if (!record_path.empty())
+        {
+            // this runs faster than real time: keep every frame rather than stay ahead
+            Recorder::Options options {};
+            options.format = Recorder::format_for(record_path);
+            options.lossless = true;
+            recorder = std::make_unique<Recorder>(record_path, options, output, speaker);
+            output = recorder.get();
+            speaker = recorder->speaker();
+        }
+        gb.set_renderer(output);
+        gb.set_speaker(speaker);
+        gb.set_force_dmg(dmg);
+        gb.set_catch_up(catch_up);
+        gb.set_threaded_audio(threaded_audio);
+        // as in batch mode, so that --hash gives the same result on every run
+        gb.set_emulated_rtc(BATCH_START_TIME);
+        if (!gb.load_cartridge(rom_path))
+        {
+            std::cerr << "Could not load " << rom_path << '\n';
+            return 1;
+        }
+        gb.set_profiling(profile);
+        if (!trace_path.empty())
+        {
+            Trace::set_thread_name("main");
+            Trace::start(trace_count, trace_first);
+        }
+
+        const size_t start_cycles {gb.cycles()};
+        const auto start = std::chrono::steady_clock::now();
+        if (cycles)
+            gb.execute(cycles);
+        else
+            gb.run_frames(frames);
+        const std::chrono::nanoseconds wall {std::chrono::steady_clock::now() - start};
+        const double seconds {wall.count() / 1e9};
+        const double ran {static_cast<double>(gb.cycles() - start_cycles)};
+
+        std::printf("rom:        %s (%s)\n", rom_path.c_str(), gb.is_cgb() ? "CGB" : "DMG");
+        std::printf("emulated:   %.0f cycles, %.1f frames (%llu presented)\n", ran,
+                    ran / CYCLES_PER_FRAME, static_cast<unsigned long long>(renderer.frames()));
+        std::printf("wall time:  %.1f ms\n", seconds * 1e3);
+        std::printf("speed:      %.2f MHz, %.1f fps, %.2fx real time\n", ran / seconds / 1e6,
+                    ran / CYCLES_PER_FRAME / seconds, ran / CLOCK_HZ / seconds);
+        if (profile)
+        {
+            // the samples are estimates (a timed instruction runs a bit slower than the
+            // others), so show each component's share of their total
+            const Gameboy::Profile p {gb.profile()};
+            const auto sampled = p.cpu + p.ppu + p.apu + p.timers;
+            auto line = [sampled](const char *name, std::chrono::nanoseconds t)
+            {
+                std::printf("  %-8s %9.1f ms %5.1f%%\n", name, t.count() / 1e6,
+                            percent(t, sampled));
+            };
+            std::printf("components (sampled):\n");
+            line("cpu", p.cpu);
+            line("ppu", p.ppu);
+            line("apu", p.apu);
+            line("timers", p.timers);
+        }
+        if (!trace_path.empty())
+        {
+            Trace::stop();
+            Trace::write_json(trace_path);
+        }
+        if (recorder)
+        {
+            recorder->stop();
+            const Recorder::Stats r {recorder->stats()};
+            std::printf("recorded:   %llu frames (%llu repeats, %llu dropped), %.1f MB\n",
+                        static_cast<unsigned long long>(r.frames),
+                        static_cast<unsigned long long>(r.repeats),
+                        static_cast<unsigned long long>(r.dropped), r.bytes_written / 1e6);
+            if (!r.ok)
+                throw std::runtime_error {"Could not write " + record_path};
+        }
+        if (hash)
+            std::printf("state hash: %016llx\n", static_cast<unsigned long long>(gb.state_hash()));
+        if (!frame_path.empty())
+            write_ppm(frame_path, renderer.frame());
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
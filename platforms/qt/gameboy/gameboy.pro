@@ -4,6 +4,8 @@ TARGET = QtBoy
 CONFIG += c++17 O3
 QT = gui core multimedia
 win32:RC_ICONS += QtBoy.ico
+win32:LIBS += -lws2_32 # sockets for netplay, link cables and frame streaming
+linux:LIBS += -lrt # shm_open() for the shared memory export
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,30 +18,47 @@ LIBS += -L"C:\Program Files\mingw-w64\dev_lib\lib" -lmingw32 -lSDL2main -lSDL2 #
 SOURCES += \
     ../../../src/apu.cpp \
     ../../../src/audio_types.cpp \
+    ../../../src/batch.cpp \
+    ../../../src/c_api.cpp \
     ../../../src/cartridge.cpp \
     ../../../src/debugger.cpp \
     ../../../src/disassembler.cpp \
     ../../../src/exception.cpp \
+    ../../../src/frame_codec.cpp \
+    ../../../src/frame_stream.cpp \
+    ../../../src/gameboy_pool.cpp \
     ../../../src/graphic_types.cpp \
     ../../../src/instructions.cpp \
     ../../../src/joypad.cpp \
+    ../../../src/link_cable.cpp \
     ../../../src/mbc1.cpp \
     ../../../src/mbc2.cpp \
     ../../../src/mbc3.cpp \
     ../../../src/mbc5.cpp \
     ../../../src/memory.cpp \
+    ../../../src/movie.cpp \
+    ../../../src/netplay.cpp \
     ../../../src/noise_channel.cpp \
     ../../../src/ppu.cpp \
     ../../../src/processor.cpp \
     ../../../src/ram.cpp \
     ../../../src/raw_audio.cpp \
+    ../../../src/recorder.cpp \
     ../../../src/reusable_thread.cpp \
+    ../../../src/rewind_buffer.cpp \
     ../../../src/rom.cpp \
+    ../../../src/rom_registry.cpp \
+    ../../../src/serial.cpp \
+    ../../../src/shared_memory_export.cpp \
+    ../../../src/socket.cpp \
     ../../../src/speaker.cpp \
     ../../../src/square_channel.cpp \
+    ../../../src/state_hash.cpp \
     ../../../src/system.cpp \
     ../../../src/timer.cpp \
+    ../../../src/trace.cpp \
     ../../../src/wave_channel.cpp \
+    ../../../src/work_stealing_pool.cpp \
     ../src/breakpoint_window.cpp \
     ../src/debuggerwindow.cpp \
     ../src/frame_buffer_tab.cpp \
@@ -57,30 +76,53 @@ SOURCES += \
 
 HEADERS += \
     ../../../include/apu.hpp \
+    ../../../include/batch.hpp \
     ../../../include/cartridge.hpp \
     ../../../include/debug_types.hpp \
     ../../../include/debugger.hpp \
     ../../../include/disassembler.hpp \
     ../../../include/exception.hpp \
+    ../../../include/frame_codec.hpp \
+    ../../../include/frame_sink.hpp \
+    ../../../include/frame_stream.hpp \
+    ../../../include/frame_tap.hpp \
+    ../../../include/gameboy_pool.hpp \
     ../../../include/graphic_types.hpp \
     ../../../include/instruction_info.hpp \
     ../../../include/joypad.hpp \
+    ../../../include/link_cable.hpp \
     ../../../include/memory.hpp \
     ../../../include/memory_bank_controller.hpp \
+    ../../../include/model.hpp \
+    ../../../include/movie.hpp \
+    ../../../include/netplay.hpp \
     ../../../include/noise_channel.hpp \
     ../../../include/ppu.hpp \
     ../../../include/processor.hpp \
+    ../../../include/qtboy.h \
+    ../../../include/qtboy_shm.h \
     ../../../include/ram.hpp \
     ../../../include/raw_audio.hpp \
+    ../../../include/recorder.hpp \
     ../../../include/register_pair.hpp \
     ../../../include/renderer.hpp \
     ../../../include/reusable_thread.hpp \
+    ../../../include/rewind_buffer.hpp \
     ../../../include/rom.hpp \
+    ../../../include/rom_registry.hpp \
+    ../../../include/serial.hpp \
+    ../../../include/shared_memory_export.hpp \
+    ../../../include/socket.hpp \
     ../../../include/speaker.hpp \
+    ../../../include/spsc_queue.hpp \
     ../../../include/square_channel.hpp \
+    ../../../include/state.hpp \
+    ../../../include/state_hash.hpp \
     ../../../include/system.hpp \
     ../../../include/timer.hpp \
+    ../../../include/trace.hpp \
     ../../../include/wave_channel.hpp \
+    ../../../include/work_stealing_pool.hpp \
     ../include/breakpoint_window.h \
     ../include/custom_palette_window.h \
     ../include/debuggerwindow.h \
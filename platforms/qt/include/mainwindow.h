@@ -4,9 +4,12 @@
 #include "system.hpp"
 #include "qt_renderer.h"
 #include "qt_speaker.h"
+#include "recorder.hpp"
 
 #include <QMainWindow>
 
+#include <memory>
+
 class QAction;
 class QMenu;
 class QImage;
@@ -22,6 +25,8 @@ struct Preferences
 {
     bool antialiasing;
     bool force_dmg;
+    bool rewind {false};
+    bool hud {false};
 };
 
 struct Controls
@@ -34,7 +39,8 @@ struct Controls
             right {Qt::Key_Right},
             select {Qt::Key_Shift},
             start {Qt::Key_Return},
-            turbo {Qt::Key_Space};
+            turbo {Qt::Key_Space},
+            rewind {Qt::Key_Backspace};
 };
 
 class MainWindow : public QMainWindow
@@ -54,12 +60,19 @@ class MainWindow : public QMainWindow
     // This is called by the PPU on VBLANK.
     void updateDisplay();
 
-    // Update the FPS counter in the window title. A QTimer calls this every second.
+    // Update the FPS counter in the window title and the performance HUD. A QTimer calls this
+    // every second.
     void updateFps();
 
     // Open file dialog to choose a ROM file
     void openRom();
 
+    // Start recording to a file chosen in a dialog, or stop recording
+    void toggleRecording(bool);
+
+    // Trace the next few seconds of emulation to a file chosen in a dialog (see qtboy::Trace)
+    void captureTrace();
+
     // Create debugger window
     void showDebugger();
 
@@ -73,6 +86,11 @@ class MainWindow : public QMainWindow
     void toggleAntiAlias(bool);
     void toggleForceDmg(bool);
     void toggleSound(bool);
+    void toggleThreadedAudio(bool);
+    void toggleCatchUp(bool);
+    void toggleRewind(bool);
+    void toggleRunAhead(bool);
+    void toggleHud(bool);
 
     private:
     // load the cartridge at fileName onto the Gameboy.
@@ -95,6 +113,10 @@ class MainWindow : public QMainWindow
     // Create all the actions performed by the buttons in the toolbar.
     void createActions();
 
+    // Records the video and audio output while recording, between the Gameboy and renderer_
+    // and speaker_. Declared before system_ so that it outlives the emulation thread.
+    std::unique_ptr<qtboy::Recorder> recorder_ {};
+
     std::shared_ptr<qtboy::Gameboy> system_;
 
     // Display for the Gameboy. Displays the contents output by the renderer.
@@ -106,6 +128,9 @@ class MainWindow : public QMainWindow
     // Produces audio output.
     std::shared_ptr<Qt_speaker> speaker_ {nullptr};
 
+    // File > Record, unchecked if recording can't start
+    QAction *recordAct_ {nullptr};
+
     // Timer that calls updateFps() every second
     QTimer *fpsTimer_;
 
@@ -118,6 +143,9 @@ class MainWindow : public QMainWindow
     // Title of the current ROM loaded
     QString curRom;
 
+    // Where the trace being captured goes once it's over (empty if none is)
+    QString tracePath_;
+
     // Saved preferences for options
     Preferences prefs_;
 
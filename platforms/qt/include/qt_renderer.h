@@ -6,6 +6,7 @@
 #include <QObject>
 #include <QImage>
 #include <QPixmap>
+#include <QString>
 #include <mutex>
 
 class Qt_renderer : public QObject, public qtboy::Renderer
@@ -20,6 +21,10 @@ class Qt_renderer : public QObject, public qtboy::Renderer
 
     void clear();
 
+    // Text drawn over the top left corner of image() (e.g. performance metrics). Empty to
+    // hide it.
+    void set_hud(const QString &text);
+
     QImage image() const;
     QPixmap pixmap() const;
 
@@ -30,6 +35,7 @@ class Qt_renderer : public QObject, public qtboy::Renderer
     mutable std::mutex buf_mutex_;
     unsigned w_, h_;
     std::vector<uint8_t> buf_;
+    QString hud_ {}; // guarded by buf_mutex_
 };
 
 #endif // QT_RENDERER_H
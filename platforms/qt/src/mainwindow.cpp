@@ -3,6 +3,7 @@
 #include "debuggerwindow.h"
 #include "vram_window.h"
 #include "qt_speaker.h"
+#include "trace.hpp"
 
 #include <chrono>
 #include <sstream>
@@ -19,6 +20,7 @@ MainWindow::MainWindow(QWidget *parent,
 {
     setCentralWidget(display_);
     setWindowTitle(title);
+    qtboy::Trace::set_thread_name("gui");
 
     display_->setScaledContents(true);
     display_->setMinimumSize(160, 144);
@@ -63,6 +65,8 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
         system_->press(qtboy::Joypad::Input::Start);
     else if (key == controls_.turbo)
         system_->set_throttle(false);
+    else if (key == controls_.rewind && !event->isAutoRepeat())
+        system_->set_rewinding(true);
 }
 
 void MainWindow::keyReleaseEvent(QKeyEvent *event)
@@ -86,10 +90,13 @@ void MainWindow::keyReleaseEvent(QKeyEvent *event)
         system_->release(qtboy::Joypad::Input::Start);
     else if (key == controls_.turbo)
         system_->set_throttle(true);
+    else if (key == controls_.rewind && !event->isAutoRepeat())
+        system_->set_rewinding(false);
 }
 
 void MainWindow::updateDisplay()
 {
+    const qtboy::Trace_scope probe {"gui.update_display"};
     QImage img {renderer_->image()};
     Qt::TransformationMode transformation_mode = prefs_.antialiasing
             ? Qt::SmoothTransformation
@@ -105,7 +112,37 @@ void MainWindow::updateDisplay()
 void MainWindow::updateFps()
 {
     QString newTitle {title_ + " - FPS: " + QString::number(frames_)};
+    if (prefs_.rewind)
+    {
+        qtboy::Rewind_buffer::Stats stats {system_->rewind_stats()};
+        newTitle += " - Rewind: " + QString::number(stats.seconds, 'f', 1) + "s ("
+                  + QString::number(stats.compression_ratio, 'f', 0) + ":1)";
+    }
     setWindowTitle(newTitle);
+    if (!tracePath_.isEmpty() && !qtboy::Trace::active())
+    {
+        try
+        {
+            qtboy::Trace::write_json(tracePath_.toStdString());
+        }
+        catch (const std::exception &e)
+        {
+            QMessageBox::warning(this, tr("Capture Trace"), e.what());
+        }
+        tracePath_.clear();
+    }
+    if (prefs_.hud)
+    {
+        const qtboy::Gameboy::Metrics m {system_->metrics()};
+        auto ms = [](double v) { return QString::number(v, 'f', 1); };
+        renderer_->set_hud(QString("%1% %2 fps (%3 shown)\n"
+                                   "cpu %4 ppu %5 apu %6 sync %7 ms\n"
+                                   "audio %8 skipped %9 %10 MIPS")
+                           .arg(m.speed * 100, 0, 'f', 0).arg(ms(m.fps)).arg(frames_)
+                           .arg(ms(m.cpu_ms)).arg(ms(m.ppu_ms)).arg(ms(m.apu_ms))
+                           .arg(ms(m.sync_ms)).arg(m.audio_queued).arg(m.frames_skipped)
+                           .arg(m.ips / 1e6, 0, 'f', 2));
+    }
     frames_ = 0;
 }
 
@@ -116,6 +153,61 @@ void MainWindow::openRom()
         loadRom(fileName);
 }
 
+void MainWindow::toggleRecording(bool b)
+{
+    if (!b)
+    {
+        if (!recorder_)
+            return;
+        system_->set_renderer(renderer_);
+        system_->set_speaker(speaker_);
+        speaker_->toggle(recorder_->speaker()->enabled());
+        recorder_->stop();
+        const bool ok {recorder_->stats().ok};
+        recorder_.reset();
+        if (!ok)
+            QMessageBox::warning(this, tr("Record"), tr("The recording could not be written."));
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(
+                this, tr("Record"), QString(),
+                tr("Video and audio (*.y4m);;Lossless QtBoy video (*.qbv)"));
+    if (!fileName.isEmpty())
+    {
+        try
+        {
+            qtboy::Recorder::Options options {};
+            options.format = qtboy::Recorder::format_for(fileName.toStdString());
+            recorder_ = std::make_unique<qtboy::Recorder>(fileName.toStdString(), options,
+                                                          renderer_, speaker_);
+        }
+        catch (const std::exception &e)
+        {
+            QMessageBox::warning(this, tr("Record"), e.what());
+        }
+    }
+    if (!recorder_)
+    {
+        const QSignalBlocker blocker {recordAct_};
+        recordAct_->setChecked(false);
+        return;
+    }
+    system_->set_renderer(recorder_.get());
+    system_->set_speaker(recorder_->speaker());
+}
+
+void MainWindow::captureTrace()
+{
+    if (!tracePath_.isEmpty())
+        return; // already capturing
+    tracePath_ = QFileDialog::getSaveFileName(this, tr("Capture Trace"), QString(),
+                                              tr("Chrome trace (*.json)"));
+    // about two seconds; updateFps() writes the file once they are over
+    if (!tracePath_.isEmpty())
+        qtboy::Trace::start(120);
+}
+
 void MainWindow::showDebugger()
 {
     /*
@@ -156,6 +248,35 @@ void MainWindow::toggleSound(bool b)
     system_->toggle_sound(b);
 }
 
+void MainWindow::toggleThreadedAudio(bool b)
+{
+    system_->set_threaded_audio(b);
+}
+
+void MainWindow::toggleCatchUp(bool b)
+{
+    system_->set_catch_up(b);
+}
+
+void MainWindow::toggleRunAhead(bool b)
+{
+    // 1 frame of run-ahead, on a second instance so it doesn't slow down emulation
+    system_->set_run_ahead(b ? 1 : 0, true);
+}
+
+void MainWindow::toggleHud(bool b)
+{
+    prefs_.hud = b;
+    system_->set_metrics(b);
+    renderer_->set_hud(b ? tr("measuring...") : QString());
+}
+
+void MainWindow::toggleRewind(bool b)
+{
+    prefs_.rewind = b;
+    system_->set_rewind(b);
+}
+
 QMenu *MainWindow::createMenu(const QString &name)
 {
     return menuBar()->addMenu(name);
@@ -191,6 +312,8 @@ void MainWindow::createActions()
     QMenu *fileMenu = createMenu(tr("&File"));
     QAction *openAct = createSingleAction(tr("&Open"), fileMenu, &MainWindow::openRom);
     openAct->setShortcuts(QKeySequence::Open);
+    recordAct_ = createCheckableAction(tr("&Record"), fileMenu, &MainWindow::toggleRecording);
+    createSingleAction(tr("Capture &Trace"), fileMenu, &MainWindow::captureTrace);
 
     // Options menu
     QMenu *optionsMenu = createMenu(tr("&Options"));
@@ -205,6 +328,21 @@ void MainWindow::createActions()
                           optionsMenu,
                           &MainWindow::toggleSound,
                           true);
+    createCheckableAction(tr("Threaded Audio"),
+                          optionsMenu,
+                          &MainWindow::toggleThreadedAudio);
+    createCheckableAction(tr("Catch-up Sync"),
+                          optionsMenu,
+                          &MainWindow::toggleCatchUp);
+    createCheckableAction(tr("Run-ahead"),
+                          optionsMenu,
+                          &MainWindow::toggleRunAhead);
+    createCheckableAction(tr("Rewind (hold Backspace)"),
+                          optionsMenu,
+                          &MainWindow::toggleRewind);
+    createCheckableAction(tr("Performance HUD"),
+                          optionsMenu,
+                          &MainWindow::toggleHud);
 
     /*
     // Tools menu
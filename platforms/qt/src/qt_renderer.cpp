@@ -1,5 +1,7 @@
 #include "qt_renderer.h"
 
+#include <QPainter>
+
 #include <cmath>
 
 Qt_renderer::Qt_renderer(unsigned w, unsigned h, QObject *parent)
@@ -36,11 +38,29 @@ void Qt_renderer::clear()
     buf_.resize(w_*h_*4);
 }
 
+void Qt_renderer::set_hud(const QString &text)
+{
+    const std::lock_guard<std::mutex> lock(buf_mutex_);
+    hud_ = text;
+}
+
 QImage Qt_renderer::image() const
 {
     const std::lock_guard<std::mutex> lock(buf_mutex_);
     QImage img(buf_.data(), w_, h_, QImage::Format_RGB555);
-    return img;
+    if (hud_.isEmpty())
+        return img;
+    // draw on a copy: the frame itself must stay as the PPU drew it
+    QImage hud {img.convertToFormat(QImage::Format_RGB32)};
+    QPainter painter {&hud};
+    QFont font {painter.font()};
+    font.setPixelSize(7);
+    painter.setFont(font);
+    const QRect box {painter.boundingRect(QRect(0, 0, w_, h_), Qt::AlignLeft | Qt::AlignTop, hud_)};
+    painter.fillRect(box.adjusted(0, 0, 2, 1), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(box.translated(1, 0), Qt::AlignLeft | Qt::AlignTop, hud_);
+    return hud;
 }
 
 QPixmap Qt_renderer::pixmap() const
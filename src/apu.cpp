@@ -1,12 +1,13 @@
 #include "apu.hpp"
 #include "system.hpp"
 #include "speaker.hpp"
+#include "state.hpp"
+#include "trace.hpp"
 
 #include <vector>
 #include <bitset>
 #include <cmath>
 #include <cstddef>
-#include <SDL.h>
 #include <chrono>
 
 using namespace qtboy;
@@ -16,8 +17,14 @@ Apu::Apu()
     : samples_(SAMPLE_SIZE)
 {}
 
+Apu::~Apu()
+{
+    stop_worker();
+}
+
 void Apu::reset()
 {
+    pause_worker();
     square1_ = {};
     square2_ = {};
     wave_ = {};
@@ -27,10 +34,31 @@ void Apu::reset()
     output_ = 0xf3;
     enable_ = 0xf1;
     downsample_cnt_ = DOWNSAMPLE_FREQ;
+    synced_ = 0;
+    cycles_ = 0;
+    logged_cycles_ = 0;
+    if (threaded_)
+    {
+        synth_->reset();
+        synth_cycles_ = 0;
+    }
+    resume_worker();
 }
 
 void Apu::tick(std::size_t cycles)
 {
+    // stepped along with every instruction, a tick is too short to time: only time batches
+    // of at least a scanline (catch-up synchronisation, the threaded audio worker)
+    const Trace_scope probe {"apu.tick", cycles >= 456};
+    // counted in both modes: it is saved, and states must not depend on the mode
+    cycles_ += cycles;
+    // in threaded mode the worker generates the samples, only keep its clock up to date
+    if (threaded_)
+    {
+        if (cycles_ - logged_cycles_ >= SYNC_PERIOD)
+            log_write({cycles_, 0, 0, audio_output_});
+        return;
+    }
     while (cycles-- > 0)
     {
         if (--frame_sequence_cnt <= 0)
@@ -68,6 +96,8 @@ void Apu::tick(std::size_t cycles)
         if (--downsample_cnt_ <= 0)
         {
             downsample_cnt_ = DOWNSAMPLE_FREQ;
+            if (!audio_output_ || !speaker_)
+                continue;
             uint16_t left_mix = 0, right_mix = 0;
             // generate empty samples if the speaker is disabled (leave left/right mix at 0)
             // (we still want samples to be pushed to the speaker because the CPU is synced to audio)
@@ -97,9 +127,18 @@ void Apu::tick(std::size_t cycles)
     }
 }
 
+void Apu::catch_up(uint64_t now)
+{
+    if (now <= synced_)
+        return;
+    const uint64_t cycles {now - synced_};
+    synced_ = now;
+    tick(cycles);
+}
+
 int Apu::samples_queued()
 {
-    return speaker_->samples_queued();
+    return speaker_ ? speaker_->samples_queued() : 0;
 }
 
 uint8_t Apu::read_reg(uint16_t adr)
@@ -126,6 +165,9 @@ uint8_t Apu::read_reg(uint16_t adr)
 
 void Apu::write_reg(uint8_t b, uint16_t adr)
 {
+    // the write is still applied below so that reads see the register values
+    if (threaded_)
+        log_write({cycles_, adr, b, audio_output_});
     if (adr > 0xff09 && adr < 0xff15)
        square1_.write_reg(b, adr);
     else if (adr > 0xff15 && adr < 0xff1a)
@@ -146,12 +188,239 @@ void Apu::write_reg(uint8_t b, uint16_t adr)
 
 void Apu::set_speaker(std::shared_ptr<Speaker> s)
 {
+    if (threaded_)
+    {
+        pause_worker();
+        synth_->speaker_ = s;
+        resume_worker();
+    }
     speaker_ = std::move(s);
 }
 
+void Apu::set_audio_output(bool b)
+{
+    // the cycles up to now were emulated with the old setting
+    if (threaded_ && b != audio_output_)
+        log_write({cycles_, 0, 0, audio_output_});
+    audio_output_ = b;
+}
+
 void Apu::toggle_sound(bool b)
 {
-    speaker_->toggle(b);
+    if (speaker_)
+        speaker_->toggle(b);
+}
+
+void Apu::set_threaded(bool b)
+{
+    if (b == threaded_)
+        return;
+    if (b)
+    {
+        // hand the current channel state over to the worker
+        synth_ = std::make_unique<Apu>();
+        synth_->copy_synthesis_state(*this);
+        synth_->speaker_ = speaker_;
+        start_worker();
+    }
+    else
+    {
+        // take the channel state back so synthesis continues where the worker left off
+        stop_worker();
+        copy_synthesis_state(*synth_);
+        synth_.reset();
+    }
+    threaded_ = b;
+}
+
+void Apu::copy_synthesis_state(const Apu &a)
+{
+    square1_ = a.square1_;
+    square2_ = a.square2_;
+    wave_ = a.wave_;
+    noise_ = a.noise_;
+    volume_ = a.volume_;
+    output_ = a.output_;
+    enable_ = a.enable_;
+    downsample_cnt_ = a.downsample_cnt_;
+    frame_sequence_cnt = a.frame_sequence_cnt;
+    frame_sequencer_ = a.frame_sequencer_;
+}
+
+void Apu::save_synthesis_state(State_writer &w) const
+{
+    square1_.save_state(w);
+    square2_.save_state(w);
+    wave_.save_state(w);
+    noise_.save_state(w);
+    w.put(volume_);
+    w.put(output_);
+    w.put(enable_);
+    w.put(downsample_cnt_);
+    w.put(frame_sequence_cnt);
+    w.put(frame_sequencer_);
+}
+
+void Apu::load_synthesis_state(State_reader &r)
+{
+    square1_.load_state(r);
+    square2_.load_state(r);
+    wave_.load_state(r);
+    noise_.load_state(r);
+    r.get(volume_);
+    r.get(output_);
+    r.get(enable_);
+    r.get(downsample_cnt_);
+    r.get(frame_sequence_cnt);
+    r.get(frame_sequencer_);
+}
+
+void Apu::save_state(State_writer &w)
+{
+    if (threaded_)
+    {
+        // bring the worker's copy up to date, it's the one generating samples
+        pause_worker();
+        synth_->audio_output_ = audio_output_;
+        synth_->tick(cycles_ - synth_cycles_);
+        synth_cycles_ = cycles_;
+        try
+        {
+            synth_->save_synthesis_state(w);
+        }
+        catch (...)
+        {
+            resume_worker();
+            throw;
+        }
+        resume_worker();
+    }
+    else
+    {
+        save_synthesis_state(w);
+    }
+    w.put(synced_);
+    w.put(cycles_);
+}
+
+void Apu::load_state(State_reader &r)
+{
+    pause_worker();
+    try
+    {
+        load_synthesis_state(r);
+        r.get(synced_);
+        r.get(cycles_);
+    }
+    catch (...)
+    {
+        resume_worker();
+        throw;
+    }
+    logged_cycles_ = cycles_;
+    // samples_ is output that hasn't reached the speaker yet, not state; it is kept
+    if (threaded_)
+    {
+        synth_->copy_synthesis_state(*this);
+        synth_cycles_ = cycles_;
+    }
+    resume_worker();
+}
+
+void Apu::log_write(const Register_write &w)
+{
+    // the worker is never far behind, so the queue is only ever full momentarily
+    while (!writes_.push(w))
+        std::this_thread::yield();
+    logged_cycles_ = w.cycle;
+}
+
+void Apu::start_worker()
+{
+    if (!synth_)
+        return;
+    synth_cycles_ = cycles_;
+    worker_exit_ = false;
+    worker_paused_ = false;
+    worker_parked_ = false;
+    worker_ = std::thread([this]
+    {
+        Trace::set_thread_name("audio");
+        std::unique_lock<std::mutex> lock(worker_mutex_);
+        while (!worker_exit_)
+        {
+            if (worker_paused_)
+            {
+                // let pause_worker() have synth_ until resume_worker()
+                worker_parked_ = true;
+                worker_cv_.notify_all();
+                worker_cv_.wait(lock, [this]{ return !worker_paused_ || worker_exit_; });
+                worker_parked_ = false;
+                continue;
+            }
+            lock.unlock();
+            const bool replayed {replay_writes()};
+            lock.lock();
+            // woken early by pause_worker() and stop_worker()
+            if (!replayed)
+                worker_cv_.wait_for(lock, std::chrono::microseconds(500),
+                                    [this]{ return worker_paused_ || worker_exit_; });
+        }
+    });
+}
+
+void Apu::stop_worker()
+{
+    if (!worker_.joinable())
+        return;
+    {
+        const std::lock_guard<std::mutex> lock(worker_mutex_);
+        worker_exit_ = true;
+    }
+    worker_cv_.notify_all();
+    worker_.join();
+    // apply whatever the worker didn't get to so synth_ is up to date
+    replay_writes();
+}
+
+void Apu::pause_worker()
+{
+    if (!worker_.joinable())
+        return;
+    std::unique_lock<std::mutex> lock(worker_mutex_);
+    worker_paused_ = true;
+    worker_cv_.notify_all();
+    worker_cv_.wait(lock, [this]{ return worker_parked_; });
+    lock.unlock();
+    // the worker is parked: drain the log here so synth_ is up to date
+    replay_writes();
+}
+
+void Apu::resume_worker()
+{
+    if (!worker_.joinable())
+        return;
+    {
+        const std::lock_guard<std::mutex> lock(worker_mutex_);
+        worker_paused_ = false;
+    }
+    worker_cv_.notify_all();
+}
+
+bool Apu::replay_writes()
+{
+    Register_write w {};
+    bool replayed {false};
+    while (writes_.pop(w))
+    {
+        synth_->audio_output_ = w.output;
+        synth_->tick(w.cycle - synth_cycles_);
+        synth_cycles_ = w.cycle;
+        if (w.adr != 0)
+            synth_->write_reg(w.b, w.adr);
+        replayed = true;
+    }
+    return replayed;
 }
 
 std::pair<uint8_t, uint8_t> Apu::mix_samples(uint8_t square1,
@@ -0,0 +1,274 @@
+#include "batch.hpp"
+#include "system.hpp"
+#include "frame_sink.hpp"
+#include "movie.hpp"
+#include "rom_registry.hpp"
+#include "state_hash.hpp"
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace qtboy
+{
+
+namespace
+{
+
+// a stuck PC stays within this many bytes (a busy loop, or a jump to itself)
+constexpr unsigned HANG_PC_RANGE {0x40};
+
+std::string hex(uint64_t v)
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+std::string json_string(const std::string &s)
+{
+    std::string out {"\""};
+    for (char c : s)
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buf[7];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else
+                {
+                    out += c;
+                }
+        }
+    }
+    return out + '"';
+}
+
+}
+
+std::vector<Batch_job> read_manifest(const std::string &path, const Batch_job &defaults)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error {"Could not open manifest " + path};
+    const fs::path dir {fs::path(path).parent_path()};
+    auto resolve = [&dir](const std::string &p)
+    {
+        return fs::path(p).is_absolute() ? p : (dir / p).string();
+    };
+
+    std::vector<Batch_job> jobs;
+    std::string line;
+    for (size_t n = 1; std::getline(in, line); ++n)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        auto error = [&](const std::string &what)
+        {
+            return std::runtime_error {path + ":" + std::to_string(n) + ": " + what};
+        };
+        std::istringstream fields(line);
+        std::string field;
+        std::getline(fields, field, '\t');
+        Batch_job job {defaults};
+        job.rom = resolve(field);
+        while (std::getline(fields, field, '\t'))
+        {
+            if (field.empty())
+                continue;
+            const auto eq = field.find('=');
+            if (eq == std::string::npos)
+                throw error("expected key=value, got \"" + field + '"');
+            const std::string key {field.substr(0, eq)}, value {field.substr(eq + 1)};
+            try
+            {
+                if (key == "frames")
+                    job.frames = std::stoull(value);
+                else if (key == "movie")
+                    job.movie = resolve(value);
+                else if (key == "timeout")
+                    job.timeout = std::stod(value);
+                else if (key == "hang_frames")
+                    job.hang_frames = static_cast<unsigned>(std::stoul(value));
+                else if (key == "expect")
+                    job.expect = std::stoull(value, nullptr, 16);
+                else
+                    throw error("unknown field \"" + key + '"');
+            }
+            catch (const std::logic_error &)
+            {
+                // from stoull() and friends
+                throw error("bad value for " + key + ": \"" + value + '"');
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+Batch_result run_job(const Batch_job &job)
+{
+    using Clock = std::chrono::steady_clock;
+    Batch_result r {};
+    r.job = job;
+    const auto start = Clock::now();
+    auto elapsed = [&start]
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    try
+    {
+        Gameboy gb;
+        Frame_sink renderer;
+        gb.set_save_dir({});
+        gb.set_renderer(&renderer);
+        // before loading, so that the RTC of the fresh cartridge starts on emulated time too
+        gb.set_emulated_rtc(BATCH_START_TIME);
+        if (!gb.load_cartridge(job.rom))
+            throw std::runtime_error {"Could not load " + job.rom};
+        size_t frames {job.frames};
+        if (!job.movie.empty())
+        {
+            const Movie m {Movie::load(job.movie)};
+            gb.play_movie(m);
+            if (!frames)
+                frames = m.inputs.size();
+        }
+        if (!frames)
+            throw std::runtime_error {"No frame count given"};
+
+        r.status = Batch_result::Status::Pass;
+        uint64_t presented {renderer.frames()};
+        unsigned stalled {0}; // frames since the last picture
+        uint16_t pc_lo {0}, pc_hi {0}; // PCs seen while stalled
+        while (r.frames_run < frames)
+        {
+            gb.run_frames(1);
+            ++r.frames_run;
+            if (r.frames_run < frames && elapsed() > job.timeout)
+            {
+                r.status = Batch_result::Status::Timeout;
+                r.message = "Timed out after " + std::to_string(r.frames_run) + " frames";
+                break;
+            }
+            if (!job.hang_frames || renderer.frames() != presented)
+            {
+                presented = renderer.frames();
+                stalled = 0;
+                continue;
+            }
+            const uint16_t pc {gb.dump_cpu().pc};
+            pc_lo = stalled ? std::min(pc_lo, pc) : pc;
+            pc_hi = stalled ? std::max(pc_hi, pc) : pc;
+            if (++stalled < job.hang_frames)
+                continue;
+            if (static_cast<unsigned>(pc_hi - pc_lo) < HANG_PC_RANGE)
+            {
+                r.status = Batch_result::Status::Hang;
+                r.message = "No frame for " + std::to_string(stalled) + " frames with PC in "
+                            + hex(pc_lo).substr(12) + "-" + hex(pc_hi).substr(12);
+                break;
+            }
+            // busy with the LCD off, but going places: watch a new window
+            stalled = 0;
+        }
+        r.frame_hash = hash64(renderer.frame().data(), sizeof(Frame_sink::Frame));
+        r.state_hash = gb.state_hash();
+        if (r.status == Batch_result::Status::Pass && job.expect && *job.expect != r.state_hash)
+        {
+            r.status = Batch_result::Status::Fail;
+            r.message = "Expected state hash " + hex(*job.expect);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        r.status = Batch_result::Status::Error;
+        r.message = e.what();
+    }
+    r.ms = elapsed() * 1e3;
+    return r;
+}
+
+std::vector<Batch_result> run_batch(const std::vector<Batch_job> &jobs, unsigned threads)
+{
+    // hold on to every image for the whole batch, so that jobs on the same ROM that don't
+    // overlap in time don't load it again
+    std::map<std::string, std::shared_ptr<const Rom>> roms;
+    for (const auto &job : jobs)
+    {
+        if (!roms.count(job.rom))
+            roms[job.rom] = Rom_registry::instance().load(job.rom);
+    }
+
+    std::vector<Batch_result> results(jobs.size());
+    Work_stealing_pool pool {threads};
+    for (size_t i = 0; i < jobs.size(); ++i)
+        pool.submit([&results, &jobs, i]{ results[i] = run_job(jobs[i]); });
+    pool.wait();
+    return results;
+}
+
+const char *to_string(Batch_result::Status s)
+{
+    switch (s)
+    {
+        case Batch_result::Status::Pass: return "pass";
+        case Batch_result::Status::Fail: return "fail";
+        case Batch_result::Status::Error: return "error";
+        case Batch_result::Status::Timeout: return "timeout";
+        case Batch_result::Status::Hang: return "hang";
+    }
+    return "";
+}
+
+void write_report(std::ostream &out, const std::vector<Batch_result> &results, double wall_ms,
+                  unsigned threads)
+{
+    const auto passed = std::count_if(results.begin(), results.end(), [](const Batch_result &r)
+    {
+        return r.status == Batch_result::Status::Pass;
+    });
+    out << "{\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"wall_ms\": " << wall_ms << ",\n"
+        << "  \"jobs\": " << results.size() << ",\n"
+        << "  \"passed\": " << passed << ",\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Batch_result &r {results[i]};
+        out << (i ? ",\n" : "\n")
+            << "    {\"rom\": " << json_string(r.job.rom)
+            << ", \"movie\": " << json_string(r.job.movie)
+            << ", \"frames\": " << r.job.frames
+            << ", \"frames_run\": " << r.frames_run
+            << ", \"status\": " << json_string(to_string(r.status))
+            << ", \"passed\": " << (r.status == Batch_result::Status::Pass ? "true" : "false")
+            << ", \"message\": " << json_string(r.message)
+            << ", \"frame_hash\": " << json_string(hex(r.frame_hash))
+            << ", \"state_hash\": " << json_string(hex(r.state_hash))
+            << ", \"ms\": " << r.ms << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+}
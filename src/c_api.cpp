@@ -0,0 +1,175 @@
+#include "qtboy.h"
+#include "system.hpp"
+#include "frame_sink.hpp"
+
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+static_assert(qtboy::Frame_sink::WIDTH == QTBOY_SCREEN_WIDTH
+              && qtboy::Frame_sink::HEIGHT == QTBOY_SCREEN_HEIGHT);
+
+struct qtboy_gb
+{
+    qtboy::Frame_sink frame {}; // outlives gb, which draws on it
+    qtboy::Gameboy gb {};
+    std::string error {};
+
+    qtboy_gb()
+    {
+        gb.set_renderer(&frame);
+        gb.set_save_dir({});
+    }
+
+    // Run fn, turning an exception into error and a return value of -1.
+    template <typename F>
+    int guard(F fn)
+    {
+        try
+        {
+            fn();
+            return 0;
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        catch (...)
+        {
+            error = "Unknown error";
+        }
+        return -1;
+    }
+};
+
+extern "C" {
+
+uint32_t qtboy_api_version(void)
+{
+    return QTBOY_API_VERSION;
+}
+
+qtboy_gb *qtboy_create(void)
+{
+    return new (std::nothrow) qtboy_gb;
+}
+
+void qtboy_destroy(qtboy_gb *gb)
+{
+    delete gb;
+}
+
+const char *qtboy_last_error(const qtboy_gb *gb)
+{
+    return gb->error.c_str();
+}
+
+void qtboy_set_save_dir(qtboy_gb *gb, const char *dir)
+{
+    gb->gb.set_save_dir(dir ? dir : "");
+}
+
+int qtboy_load_rom(qtboy_gb *gb, const char *path)
+{
+    return gb->guard([gb, path]
+    {
+        if (!gb->gb.load_cartridge(path))
+            throw std::runtime_error {std::string {"Could not load "} + path};
+    });
+}
+
+int qtboy_step_frames(qtboy_gb *gb, uint32_t n, uint8_t input)
+{
+    return gb->guard([gb, n, input]
+    {
+        gb->gb.set_input(input);
+        gb->gb.run_frames(n);
+    });
+}
+
+const uint16_t *qtboy_framebuffer_ptr(const qtboy_gb *gb)
+{
+    return gb->frame.frame().data();
+}
+
+int qtboy_set_observation(qtboy_gb *gb, uint32_t width, uint32_t height, int mode)
+{
+    return gb->guard([gb, width, height, mode]
+    {
+        using Mode = qtboy::Ppu::Observation_mode;
+        if (mode != QTBOY_OBSERVE_LUMINANCE && mode != QTBOY_OBSERVE_PALETTE_INDEX)
+            throw std::runtime_error {"Unknown observation mode"};
+        gb->gb.set_observation({width, height, mode == QTBOY_OBSERVE_LUMINANCE
+                                                   ? Mode::Luminance : Mode::Palette_index});
+    });
+}
+
+const uint8_t *qtboy_observation_ptr(const qtboy_gb *gb)
+{
+    return gb->gb.observation();
+}
+
+const uint8_t *qtboy_ram_ptr(const qtboy_gb *gb, size_t *size)
+{
+    size_t n {0};
+    const uint8_t *p {gb->gb.work_ram(n)};
+    if (size)
+        *size = n;
+    return p;
+}
+
+uint8_t qtboy_read_memory(qtboy_gb *gb, uint16_t adr)
+{
+    // the cartridge areas go to the cartridge, which isn't there without a ROM
+    if (!gb->gb.state_size())
+        return 0xff;
+    return gb->gb.memory_read(adr);
+}
+
+void qtboy_write_memory(qtboy_gb *gb, uint16_t adr, uint8_t b)
+{
+    if (gb->gb.state_size())
+        gb->gb.memory_write(b, adr);
+}
+
+size_t qtboy_state_size(const qtboy_gb *gb)
+{
+    return gb->gb.state_size();
+}
+
+size_t qtboy_save_state(qtboy_gb *gb, void *buf, size_t size)
+{
+    size_t written {0};
+    gb->guard([gb, buf, size, &written]
+    {
+        if (!gb->gb.state_size())
+            throw std::runtime_error {"No ROM is loaded"};
+        written = gb->gb.save_state(static_cast<uint8_t *>(buf), size);
+    });
+    return written;
+}
+
+int qtboy_load_state(qtboy_gb *gb, const void *buf, size_t size)
+{
+    return gb->guard([gb, buf, size]
+    {
+        if (!gb->gb.state_size())
+            throw std::runtime_error {"No ROM is loaded"};
+        gb->gb.load_state(static_cast<const uint8_t *>(buf), size);
+    });
+}
+
+uint64_t qtboy_state_hash(qtboy_gb *gb)
+{
+    uint64_t hash {0};
+    gb->guard([gb, &hash]
+    {
+        if (!gb->gb.state_size())
+            throw std::runtime_error {"No ROM is loaded"};
+        hash = gb->gb.state_hash();
+    });
+    return hash;
+}
+
+}
@@ -8,21 +8,26 @@
 
 #include "rom.hpp"
 #include "ram.hpp"
+#include "state.hpp"
 
 namespace qtboy
 {	
 
 Cartridge::Cartridge(std::istream &is)
-	: rom_ {is}
+    : Cartridge(std::make_shared<const Rom>(is))
+{}
+
+Cartridge::Cartridge(std::shared_ptr<const Rom> rom, std::function<int64_t()> clock)
+    : rom_ {std::move(rom)}
 {
-	init_mbc();
+	init_mbc(std::move(clock));
     init_info();
     init_ram();
 }
 
-void Cartridge::init_mbc()
+void Cartridge::init_mbc(std::function<int64_t()> clock)
 {
-	switch (rom_.read(0, 0x147))
+	switch (rom_->read(0, 0x147))
 	{
         case 0x09:
             has_battery_ = true;
@@ -33,12 +38,12 @@ void Cartridge::init_mbc()
             has_battery_ = true;
 		case 0x01:
         case 0x02:
-            mbc_ = std::make_unique<Mbc1>(&rom_, &ram_);
+            mbc_ = std::make_unique<Mbc1>(rom_.get(), &ram_);
             break;
         case 0x06:
             has_battery_ = true;
         case 0x05:
-            mbc_ = std::make_unique<Mbc2>(&rom_);
+            mbc_ = std::make_unique<Mbc2>(rom_.get());
             break;
 		case 0x0f:
 		case 0x10:
@@ -46,7 +51,7 @@ void Cartridge::init_mbc()
             has_battery_ = true;
 		case 0x11:
         case 0x12:
-            mbc_ = std::make_unique<Mbc3>(&rom_, &ram_);
+            mbc_ = std::make_unique<Mbc3>(rom_.get(), &ram_, std::move(clock));
             break;
         case 0x1b:
         case 0x1e:
@@ -55,7 +60,7 @@ void Cartridge::init_mbc()
         case 0x1a:
 		case 0x1c:
         case 0x1d:
-            mbc_ = std::make_unique<Mbc5>(&rom_, &ram_);
+            mbc_ = std::make_unique<Mbc5>(rom_.get(), &ram_);
             break;
 		default:
 			throw std::runtime_error {"Unimplemented memory bank controller\n"};
@@ -65,12 +70,12 @@ void Cartridge::init_mbc()
 void Cartridge::init_info()
 {
 	for (uint8_t i {0}; i < 11; ++i)
-		title_ += rom_.read(0, 0x134+i);
+		title_ += rom_->read(0, 0x134+i);
 }
 
 void Cartridge::init_ram()
 {
-    switch (rom_.read(0, 0x149))
+    switch (rom_->read(0, 0x149))
 	{
 		default:
         case 0x00:
@@ -102,7 +107,7 @@ uint8_t Cartridge::read(uint16_t adr) const
 	{
 		uint8_t bank_n = adr < Rom::Bank_size ? 0 : 1;
 		uint16_t relative_adr = adr - (bank_n ? Rom::Bank_size : 0);
-		b = rom_.read(bank_n, relative_adr);
+		b = rom_->read(bank_n, relative_adr);
 	}
 	return b;
 }
@@ -149,15 +154,15 @@ std::unordered_map<std::string, Memory_range> Cartridge::dump() const
     {
         out["RAMX"] = {"RAMX", std::vector<uint8_t>(sizeof(External_ram::Bank))};
     }
-    out["ROM0"] = {"ROM0", rom_.dump(0)};
+    out["ROM0"] = {"ROM0", rom_->dump(0)};
     uint8_t rom_bank = mbc_ ? mbc_->rom_bank() : 1;
-    out["ROMX"] = {"ROM" + std::to_string(rom_bank), rom_.dump(rom_bank)};
+    out["ROMX"] = {"ROM" + std::to_string(rom_bank), rom_->dump(rom_bank)};
     return out;
 }
 
 std::vector<uint8_t> Cartridge::dump_rom() const
 {
-    return rom_.dump();
+    return rom_->dump();
 }
 
 std::vector<uint8_t> Cartridge::dump_ram() const
@@ -173,7 +178,7 @@ std::vector<uint8_t> Cartridge::dump_ram() const
 	
 bool Cartridge::is_cgb() const
 {
-	return rom_.read(0, 0x143) & 0x80; // upper bit
+	return rom_->read(0, 0x143) & 0x80; // upper bit
 }	
 
 std::string Cartridge::title() const
@@ -181,4 +186,31 @@ std::string Cartridge::title() const
     return title_;
 }
 
+uint16_t Cartridge::checksum() const
+{
+    return static_cast<uint16_t>(rom_->read(0, 0x14e) << 8 | rom_->read(0, 0x14f));
+}
+
+void Cartridge::save_state(State_writer &w) const
+{
+    if (ram_)
+        ram_->save_state(w);
+    if (mbc_)
+        mbc_->save_state(w);
+}
+
+void Cartridge::load_state(State_reader &r)
+{
+    if (ram_)
+        ram_->load_state(r);
+    if (mbc_)
+        mbc_->load_state(r);
+}
+
+void Cartridge::set_clock(std::function<int64_t()> clock)
+{
+    if (mbc_)
+        mbc_->set_clock(std::move(clock));
+}
+
 }
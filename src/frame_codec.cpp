@@ -0,0 +1,112 @@
+#include "frame_codec.hpp"
+
+#include <algorithm>
+
+namespace qtboy
+{
+
+namespace
+{
+
+void put16(std::vector<uint8_t> &out, uint16_t v)
+{
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+}
+
+void Frame_encoder::encode(const Color *frame, const Color *prev, std::vector<uint8_t> &out)
+{
+    // palette of the frame, in order of first appearance
+    ++stamp_now_;
+    colours_.clear();
+    for (size_t i = 0; i < PIXELS; ++i)
+    {
+        const Color c {frame[i]};
+        if (stamp_[c] == stamp_now_)
+            continue;
+        stamp_[c] = stamp_now_;
+        index_[c] = static_cast<uint16_t>(colours_.size());
+        colours_.push_back(c);
+    }
+    if (colours_.size() > 256)
+    {
+        put16(out, 0);
+        for (size_t i = 0; i < PIXELS; ++i)
+            put16(out, frame[i]);
+        return;
+    }
+
+    put16(out, static_cast<uint16_t>(colours_.size()));
+    for (Color c : colours_)
+        put16(out, c);
+    size_t i {0};
+    while (i < PIXELS)
+    {
+        size_t run {1};
+        if (prev && frame[i] == prev[i])
+        {
+            while (run < 128 && i + run < PIXELS && frame[i + run] == prev[i + run])
+                ++run;
+            out.push_back(static_cast<uint8_t>(run - 1));
+        }
+        else
+        {
+            while (run < 128 && i + run < PIXELS && frame[i + run] == frame[i]
+                   && !(prev && frame[i + run] == prev[i + run]))
+                ++run;
+            out.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+            out.push_back(static_cast<uint8_t>(index_[frame[i]]));
+        }
+        i += run;
+    }
+}
+
+bool decode_frame(const uint8_t *data, size_t size, const Color *prev, Color *frame)
+{
+    constexpr size_t PIXELS {Frame_encoder::PIXELS};
+    auto get16 = [data](size_t at) { return static_cast<uint16_t>(data[at] | data[at + 1] << 8); };
+    if (size < 2)
+        return false;
+    const size_t n {get16(0)};
+    size_t at {2};
+    if (n == 0)
+    {
+        if (size != at + PIXELS * 2)
+            return false;
+        for (size_t i = 0; i < PIXELS; ++i, at += 2)
+            frame[i] = get16(at);
+        return true;
+    }
+    if (size < at + n * 2)
+        return false;
+    Color colours[256];
+    for (size_t i = 0; i < n; ++i, at += 2)
+        colours[i] = get16(at);
+    size_t i {0};
+    while (i < PIXELS && at < size)
+    {
+        const uint8_t op {data[at++]};
+        const size_t run {(op & 0x7fu) + 1};
+        if (i + run > PIXELS)
+            return false;
+        if (op < 0x80)
+        {
+            if (!prev)
+                return false;
+            if (prev != frame)
+                std::copy(prev + i, prev + i + run, frame + i);
+        }
+        else
+        {
+            if (at == size || data[at] >= n)
+                return false;
+            std::fill(frame + i, frame + i + run, colours[data[at++]]);
+        }
+        i += run;
+    }
+    return i == PIXELS && at == size;
+}
+
+}
@@ -0,0 +1,226 @@
+#include "frame_stream.hpp"
+#include "socket.hpp"
+#include "system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+Frame_stream_server::Frame_stream_server(Gameboy &gb, const Options &options, Renderer *next)
+    : Frame_tap {next}, gb_ {gb}, options_ {options},
+      sockets_ {std::make_unique<Socket_library>()}
+{
+    sockaddr_in adr {};
+    adr.sin_family = AF_INET;
+    adr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.address.c_str(), &adr.sin_addr) != 1)
+        throw std::runtime_error {"Invalid address " + options.address};
+    listener_ = static_cast<std::intptr_t>(socket(AF_INET, SOCK_STREAM, 0));
+    if (listener_ < 0)
+        throw std::runtime_error {"Could not create a socket"};
+    int one {1};
+    setsockopt(static_cast<Socket>(listener_), SOL_SOCKET, SO_REUSEADDR,
+               reinterpret_cast<const char *>(&one), sizeof(one));
+    socklen_t len {sizeof(adr)};
+    if (bind(static_cast<Socket>(listener_), reinterpret_cast<sockaddr *>(&adr), sizeof(adr)) != 0
+        || listen(static_cast<Socket>(listener_), 4) != 0
+        || getsockname(static_cast<Socket>(listener_), reinterpret_cast<sockaddr *>(&adr), &len) != 0)
+    {
+        close_socket(static_cast<Socket>(listener_));
+        throw std::runtime_error {"Could not listen on " + options.address + ":"
+                                  + std::to_string(options.port)};
+    }
+    port_ = ntohs(adr.sin_port);
+    thread_ = std::thread {[this]{ serve(); }};
+}
+
+Frame_stream_server::~Frame_stream_server()
+{
+    stop_ = true;
+    thread_.join();
+    for (const Client &c : clients_)
+        close_socket(static_cast<Socket>(c.socket));
+    close_socket(static_cast<Socket>(listener_));
+}
+
+void Frame_stream_server::present_screen()
+{
+    ++presented_;
+    // nobody watching, or the server is copying the previous frame: don't wait for it
+    if (client_count_ && frame_mutex_.try_lock())
+    {
+        latest_ = back_;
+        latest_number_ = presented_;
+        frame_mutex_.unlock();
+    }
+    Frame_tap::present_screen();
+}
+
+Frame_stream_server::Stats Frame_stream_server::stats() const
+{
+    return {client_count_, frames_sent_, bytes_sent_, raw_bytes_};
+}
+
+void Frame_stream_server::serve()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto interval = std::chrono::microseconds {1000000 / std::max(1u, options_.max_fps)};
+    auto next_send = Clock::now();
+    uint64_t sent_number {0};
+    Frame frame {};
+    while (!stop_)
+    {
+        // wake up at least every 10 ms to look for a new frame (and to notice stop_)
+        fd_set readable, writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(static_cast<Socket>(listener_), &readable);
+        std::intptr_t highest {listener_};
+        for (const Client &c : clients_)
+        {
+            FD_SET(static_cast<Socket>(c.socket), &readable);
+            if (!c.unsent.empty())
+                FD_SET(static_cast<Socket>(c.socket), &writable);
+            highest = std::max(highest, c.socket);
+        }
+        timeval timeout {0, 10000};
+        if (select(static_cast<int>(highest + 1), &readable, &writable, nullptr, &timeout) < 0)
+            continue;
+
+        if (FD_ISSET(static_cast<Socket>(listener_), &readable))
+        {
+            const auto s = static_cast<std::intptr_t>(accept(static_cast<Socket>(listener_),
+                                                            nullptr, nullptr));
+            if (s >= 0)
+            {
+                // a viewer that stops reading must not hold up the others or shutting down
+                Client c {s};
+                c.unsent = {'Q', 'B', 'S', '1', WIDTH & 0xff, WIDTH >> 8, HEIGHT & 0xff,
+                            HEIGHT >> 8};
+                if (set_nonblocking(static_cast<Socket>(s)) && send_unsent(c))
+                    clients_.push_back(std::move(c));
+                else
+                    close_socket(static_cast<Socket>(s));
+            }
+        }
+        for (auto it = clients_.begin(); it != clients_.end();)
+        {
+            bool alive {true};
+            if (FD_ISSET(static_cast<Socket>(it->socket), &readable))
+            {
+                uint8_t in[64];
+                const auto n = recv(static_cast<Socket>(it->socket), reinterpret_cast<char *>(in),
+                                    sizeof(in), 0);
+                alive = n > 0;
+                if (alive && options_.accept_input)
+                    apply_input(*it, in[n - 1]); // only the latest state matters
+            }
+            if (alive && FD_ISSET(static_cast<Socket>(it->socket), &writable))
+                alive = send_unsent(*it);
+            if (!alive)
+            {
+                apply_input(*it, 0); // don't leave its buttons held
+                close_socket(static_cast<Socket>(it->socket));
+                it = clients_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        client_count_ = static_cast<unsigned>(clients_.size());
+
+        if (clients_.empty() || Clock::now() < next_send)
+            continue;
+        uint64_t number {0};
+        {
+            const std::lock_guard<std::mutex> lock(frame_mutex_);
+            number = latest_number_;
+            if (number != sent_number)
+                frame = latest_;
+        }
+        if (number == sent_number)
+            continue;
+        sent_number = number;
+        next_send = std::max(next_send + interval, Clock::now());
+        for (auto it = clients_.begin(); it != clients_.end();)
+        {
+            // skip the frame for a viewer still taking in the last one
+            if (!it->unsent.empty()
+                || (!it->last.empty()
+                    && std::equal(it->last.begin(), it->last.end(), frame.begin())))
+            {
+                ++it;
+                continue;
+            }
+            encode(frame, number, *it);
+            ++frames_sent_;
+            bytes_sent_ += out_.size();
+            raw_bytes_ += sizeof(frame);
+            std::swap(it->unsent, out_);
+            if (!send_unsent(*it))
+            {
+                apply_input(*it, 0);
+                close_socket(static_cast<Socket>(it->socket));
+                it = clients_.erase(it);
+                continue;
+            }
+            it->last.assign(frame.begin(), frame.end());
+            ++it;
+        }
+        client_count_ = static_cast<unsigned>(clients_.size());
+    }
+}
+
+bool Frame_stream_server::send_unsent(Client &client)
+{
+    size_t sent {0};
+    while (sent < client.unsent.size())
+    {
+        const auto n = send(static_cast<Socket>(client.socket),
+                            reinterpret_cast<const char *>(client.unsent.data() + sent),
+                            static_cast<int>(client.unsent.size() - sent), SEND_FLAGS);
+        if (n < 0 && would_block())
+            break;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    client.unsent.erase(client.unsent.begin(),
+                        client.unsent.begin() + static_cast<std::ptrdiff_t>(sent));
+    return true;
+}
+
+void Frame_stream_server::encode(const Frame &frame, uint64_t number, const Client &client)
+{
+    out_.assign(4, 0); // size, filled in at the end
+    for (int i = 0; i < 8; ++i)
+        out_.push_back(static_cast<uint8_t>(number >> (i * 8)));
+    encoder_.encode(frame.data(), client.last.empty() ? nullptr : client.last.data(), out_);
+    const size_t size {out_.size() - 4};
+    for (int i = 0; i < 4; ++i)
+        out_[static_cast<size_t>(i)] = static_cast<uint8_t>(size >> (i * 8));
+}
+
+void Frame_stream_server::apply_input(Client &client, uint8_t input)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        const auto button = static_cast<Joypad::Input>(i);
+        const uint8_t mask {Joypad::mask(button)};
+        if ((input ^ client.input) & mask)
+        {
+            if (input & mask)
+                gb_.press(button);
+            else
+                gb_.release(button);
+        }
+    }
+    client.input = input;
+}
+
+}
@@ -0,0 +1,228 @@
+#include "gameboy_pool.hpp"
+#include "batch.hpp"
+#include "system.hpp"
+#include "frame_sink.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace qtboy
+{
+
+struct Gameboy_pool::Env
+{
+    Frame_sink frame {}; // outlives gb, which draws on it
+    Gameboy gb {};
+    bool done {false};
+    std::vector<uint8_t> ram {}; // the ram_addresses bytes when the caller doesn't want them
+};
+
+Gameboy_pool::Gameboy_pool(const std::string &path, size_t size, Options options)
+    : envs_(size),
+      ram_addresses_ {std::move(options.ram_addresses)},
+      done_ {std::move(options.done)},
+      observation_size_ {options.observation.width * options.observation.height}
+{
+    if (size == 0)
+        throw std::runtime_error {"Gameboy_pool needs at least one instance"};
+    unsigned threads {options.threads ? options.threads : std::thread::hardware_concurrency()};
+    threads_ = static_cast<unsigned>(std::clamp<size_t>(threads, 1, size));
+    for (unsigned i = 0; i < threads_; ++i)
+    {
+        workers_.emplace_back([this, i]{ work(i); });
+#ifdef __linux__
+        if (options.pin_threads)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+            // only a hint: the pool works the same unpinned
+            pthread_setaffinity_np(workers_.back().native_handle(), sizeof(cpus), &cpus);
+        }
+#endif
+    }
+
+    try
+    {
+        // create the instances on the threads that run them, so that their memory is local
+        run_on_workers([this, &path, &options](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                auto env = std::make_unique<Env>();
+                env->gb.set_save_dir({});
+                env->gb.set_renderer(&env->frame);
+                env->gb.set_emulated_rtc(BATCH_START_TIME);
+                env->gb.set_observation(options.observation);
+                if (!env->gb.load_cartridge(path))
+                    throw std::runtime_error {"Could not load " + path};
+                env->ram.resize(ram_addresses_.size());
+                envs_[i] = std::move(env);
+            }
+        });
+    }
+    catch (...)
+    {
+        stop_workers();
+        throw;
+    }
+    start_state_.resize(envs_[0]->gb.state_size());
+    envs_[0]->gb.save_state(start_state_.data(), start_state_.size());
+}
+
+Gameboy_pool::Gameboy_pool(const std::string &path, size_t size)
+    : Gameboy_pool(path, size, Options {})
+{
+}
+
+Gameboy_pool::~Gameboy_pool()
+{
+    stop_workers();
+}
+
+void Gameboy_pool::stop_workers()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exiting_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &t : workers_)
+        t.join();
+    workers_.clear();
+}
+
+void Gameboy_pool::step(const uint8_t *inputs, unsigned frames, const Step_output &out)
+{
+    struct Args
+    {
+        const uint8_t *inputs;
+        unsigned frames;
+        const Step_output &out;
+    } args {inputs, frames, out};
+    // capturing two pointers keeps the std::function from allocating
+    run_on_workers([this, &args](size_t first, size_t last)
+    {
+        const Step_output &o {args.out};
+        const size_t ram_size {ram_addresses_.size()};
+        for (size_t i = first; i < last; ++i)
+        {
+            Env &env {*envs_[i]};
+            if (env.done)
+            {
+                env.gb.load_state(start_state_.data(), start_state_.size());
+                env.done = false;
+            }
+            env.gb.set_input(args.inputs[i]);
+            env.gb.set_output(o.frames != nullptr);
+            env.gb.run_frames(args.frames);
+
+            uint8_t *ram {o.ram ? o.ram + i * ram_size : env.ram.data()};
+            for (size_t j = 0; j < ram_size; ++j)
+                ram[j] = env.gb.memory_read(ram_addresses_[j]);
+            if (done_)
+                env.done = done_(ram);
+
+            if (o.frames)
+                std::memcpy(o.frames + i * FRAME_PIXELS, env.frame.frame().data(),
+                            FRAME_PIXELS * sizeof(uint16_t));
+            if (o.observations)
+                std::memcpy(o.observations + i * observation_size_, env.gb.observation(),
+                            observation_size_);
+            if (o.done)
+                o.done[i] = env.done;
+        }
+    });
+}
+
+void Gameboy_pool::set_start_state(const uint8_t *buf, size_t size)
+{
+    // try it on an instance first (load_state() leaves it untouched if the state is bad),
+    // then put the instance back the way it was
+    Gameboy &gb {envs_[0]->gb};
+    std::vector<uint8_t> current(gb.state_size());
+    gb.save_state(current.data(), current.size());
+    gb.load_state(buf, size);
+    gb.load_state(current.data(), current.size());
+    start_state_.assign(buf, buf + size);
+}
+
+void Gameboy_pool::reset()
+{
+    run_on_workers([this](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            reset(i);
+    });
+}
+
+void Gameboy_pool::reset(size_t i)
+{
+    Env &env {*envs_.at(i)};
+    env.gb.load_state(start_state_.data(), start_state_.size());
+    env.done = false;
+}
+
+Gameboy &Gameboy_pool::instance(size_t i)
+{
+    return envs_.at(i)->gb;
+}
+
+void Gameboy_pool::run_on_workers(const std::function<void(size_t, size_t)> &fn)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &fn;
+    running_ = threads_;
+    ++generation_;
+    start_cv_.notify_all();
+    done_cv_.wait(lock, [this]{ return running_ == 0; });
+    task_ = nullptr;
+    if (error_)
+    {
+        auto e = error_;
+        error_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void Gameboy_pool::work(unsigned id)
+{
+    uint64_t seen {0};
+    while (true)
+    {
+        const std::function<void(size_t, size_t)> *task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [this, seen]{ return generation_ != seen || exiting_; });
+            if (exiting_)
+                return;
+            seen = generation_;
+            task = task_;
+        }
+        // slices differ in size by at most one instance
+        const size_t n {envs_.size()};
+        std::exception_ptr error {};
+        try
+        {
+            (*task)(id * n / threads_, (id + 1) * n / threads_);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (error && !error_)
+            error_ = error;
+        if (--running_ == 0)
+            done_cv_.notify_one();
+    }
+}
+
+}
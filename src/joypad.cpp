@@ -1,5 +1,6 @@
 #include "joypad.hpp"
 #include "processor.hpp"
+#include "state.hpp"
 
 using qtboy::Joypad;
 
@@ -21,6 +22,33 @@ void Joypad::release(Input i)
     update_button(i, false);
 }
 
+uint8_t Joypad::state() const
+{
+    return static_cast<uint8_t>(buttons_ | directions_ << 4);
+}
+
+void Joypad::set_state(uint8_t s)
+{
+    buttons_ = s & 0xf;
+    directions_ = s >> 4;
+}
+
+uint8_t Joypad::mask(Input i)
+{
+    switch (i)
+    {
+        case Input::A: return 1 << 0;
+        case Input::B: return 1 << 1;
+        case Input::Select: return 1 << 2;
+        case Input::Start: return 1 << 3;
+        case Input::Right: return 1 << 4;
+        case Input::Left: return 1 << 5;
+        case Input::Up: return 1 << 6;
+        case Input::Down: return 1 << 7;
+    }
+    return 0;
+}
+
 void Joypad::update_button(Input i, bool pressed)
 {
     // uint8_t old_buttons_ {buttons_};
@@ -87,3 +115,19 @@ void Joypad::reset()
     select_button_ = 0;
     select_direction_ = 0;
 }
+
+void Joypad::save_state(State_writer &w) const
+{
+    w.put(directions_);
+    w.put(buttons_);
+    w.put(select_button_);
+    w.put(select_direction_);
+}
+
+void Joypad::load_state(State_reader &r)
+{
+    r.get(directions_);
+    r.get(buttons_);
+    r.get(select_button_);
+    r.get(select_direction_);
+}
@@ -0,0 +1,276 @@
+#include "link_cable.hpp"
+#include "socket.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+//
+// In-process cable: the two ends meet at a barrier.
+//
+
+namespace
+{
+
+struct Shared_cable
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool connected[2] {true, true};
+    bool interrupted[2] {false, false};
+    bool waiting[2] {false, false};
+    Link_message sent[2] {}; // message of an end waiting for the other
+    Link_message inbox[2] {}; // message handed to a waiting end by the other
+    uint64_t meetings {0};
+};
+
+class Local_end : public Link_cable
+{
+    public:
+    Local_end(std::shared_ptr<Shared_cable> cable, int side)
+        : cable_ {std::move(cable)}, me_ {side}, other_ {1 - side}
+    {}
+
+    ~Local_end() override { disconnect(); }
+
+    bool sync(const Link_message &ours, Link_message &theirs) override
+    {
+        Shared_cable &c {*cable_};
+        std::unique_lock<std::mutex> lock(c.mutex);
+        if (!c.connected[me_] || !c.connected[other_])
+            return false;
+        if (!pending_)
+        {
+            if (c.interrupted[me_])
+                return false;
+            if (c.waiting[other_]) // the other end got here first
+            {
+                c.waiting[other_] = false;
+                c.inbox[other_] = ours;
+                theirs = c.sent[other_];
+                ++c.meetings;
+                c.cv.notify_all();
+                return true;
+            }
+            c.sent[me_] = ours;
+            c.waiting[me_] = true;
+            meeting_ = c.meetings;
+            pending_ = true;
+        }
+        // an interrupted wait stays posted, the other end can still meet it
+        c.cv.wait(lock, [&]
+        {
+            return c.meetings != meeting_ || !c.connected[other_] || c.interrupted[me_];
+        });
+        if (c.meetings == meeting_)
+        {
+            if (!c.connected[other_])
+            {
+                c.waiting[me_] = false;
+                pending_ = false;
+            }
+            return false;
+        }
+        pending_ = false;
+        theirs = c.inbox[me_];
+        return true;
+    }
+
+    void disconnect() override
+    {
+        const std::lock_guard<std::mutex> lock(cable_->mutex);
+        cable_->connected[me_] = false;
+        cable_->cv.notify_all();
+    }
+
+    bool connected() const override
+    {
+        const std::lock_guard<std::mutex> lock(cable_->mutex);
+        return cable_->connected[me_] && cable_->connected[other_];
+    }
+
+    void set_interrupted(bool b) override
+    {
+        const std::lock_guard<std::mutex> lock(cable_->mutex);
+        cable_->interrupted[me_] = b;
+        cable_->cv.notify_all();
+    }
+
+    private:
+    std::shared_ptr<Shared_cable> cable_;
+    const int me_, other_;
+    // the message posted by an interrupted sync() is still waiting for meeting meeting_
+    bool pending_ {false};
+    uint64_t meeting_ {0};
+};
+
+//
+// Cable over TCP: each end sends its message and waits for the other's.
+//
+
+class Socket_end : public Link_cable
+{
+    public:
+    explicit Socket_end(Socket s)
+        : socket_ {s}
+    {
+        // messages are tiny and each one is waited for
+        int one {1};
+        setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&one),
+                   sizeof(one));
+    }
+
+    ~Socket_end() override
+    {
+        disconnect();
+        close_socket(socket_);
+    }
+
+    bool sync(const Link_message &ours, Link_message &theirs) override
+    {
+        if (!connected_ || (!sent_ && interrupted_))
+            return false;
+        if (!sent_)
+        {
+            const uint8_t out[2] {ours.sb, static_cast<uint8_t>(ours.master_done
+                                                               | ours.slave_ready << 1
+                                                               | ours.busy << 2)};
+            if (send(socket_, reinterpret_cast<const char *>(out), sizeof(out), SEND_FLAGS)
+                != sizeof(out))
+            {
+                connected_ = false;
+                return false;
+            }
+            sent_ = true;
+        }
+        // an interrupted receive picks up where it left off
+        while (received_ < sizeof(in_))
+        {
+            if (interrupted_)
+                return false;
+            if (!wait_readable())
+                continue;
+            const auto n = recv(socket_, reinterpret_cast<char *>(in_ + received_),
+                                static_cast<int>(sizeof(in_) - received_), 0);
+            if (n <= 0)
+            {
+                connected_ = false;
+                return false;
+            }
+            received_ += static_cast<size_t>(n);
+        }
+        sent_ = false;
+        received_ = 0;
+        theirs.sb = in_[0];
+        theirs.master_done = in_[1] & 1;
+        theirs.slave_ready = in_[1] & 2;
+        theirs.busy = in_[1] & 4;
+        return true;
+    }
+
+    void disconnect() override
+    {
+        if (connected_.exchange(false))
+        {
+            // wakes up a recv() on either end
+#ifdef _WIN32
+            shutdown(socket_, SD_BOTH);
+#else
+            shutdown(socket_, SHUT_RDWR);
+#endif
+        }
+    }
+
+    bool connected() const override { return connected_; }
+
+    void set_interrupted(bool b) override { interrupted_ = b; }
+
+    private:
+    // Wait a little for data (or the connection closing) so that an interruption is noticed.
+    bool wait_readable()
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(socket_, &fds);
+        timeval timeout {0, 10000};
+        return select(static_cast<int>(socket_ + 1), &fds, nullptr, nullptr, &timeout) != 0;
+    }
+
+    Socket_library sockets_ {}; // for as long as socket_ is open
+    Socket socket_;
+    std::atomic<bool> connected_ {true};
+    std::atomic<bool> interrupted_ {false};
+    // message of the meeting in progress (sync thread only)
+    bool sent_ {false};
+    uint8_t in_[2] {};
+    size_t received_ {0};
+};
+
+}
+
+std::pair<std::shared_ptr<Link_cable>, std::shared_ptr<Link_cable>> make_local_link()
+{
+    auto cable = std::make_shared<Shared_cable>();
+    return {std::make_shared<Local_end>(cable, 0), std::make_shared<Local_end>(cable, 1)};
+}
+
+std::shared_ptr<Link_cable> listen_link(uint16_t port, const std::string &address)
+{
+    const Socket_library sockets {};
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *res {nullptr};
+    if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        throw std::runtime_error {"Could not resolve " + address};
+    const Socket listener {socket(AF_INET, SOCK_STREAM, 0)};
+    if (listener == NO_SOCKET)
+    {
+        freeaddrinfo(res);
+        throw std::runtime_error {"Could not create a socket"};
+    }
+    int one {1};
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&one),
+               sizeof(one));
+    const bool ok {bind(listener, res->ai_addr, static_cast<int>(res->ai_addrlen)) == 0
+                   && listen(listener, 1) == 0};
+    freeaddrinfo(res);
+    if (!ok)
+    {
+        close_socket(listener);
+        throw std::runtime_error {"Could not listen on " + address + ":" + std::to_string(port)};
+    }
+    const Socket s {accept(listener, nullptr, nullptr)};
+    close_socket(listener);
+    if (s == NO_SOCKET)
+        throw std::runtime_error {"Link cable connection failed"};
+    return std::make_shared<Socket_end>(s);
+}
+
+std::shared_ptr<Link_cable> connect_link(const std::string &host, uint16_t port)
+{
+    const Socket_library sockets {};
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res {nullptr};
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        throw std::runtime_error {"Could not resolve " + host};
+    const Socket s {socket(AF_INET, SOCK_STREAM, 0)};
+    const bool ok {s != NO_SOCKET && connect(s, res->ai_addr, static_cast<int>(res->ai_addrlen)) == 0};
+    freeaddrinfo(res);
+    if (!ok)
+    {
+        if (s != NO_SOCKET)
+            close_socket(s);
+        throw std::runtime_error {"Could not connect to " + host + ":" + std::to_string(port)};
+    }
+    return std::make_shared<Socket_end>(s);
+}
+
+}
@@ -3,11 +3,12 @@
 #include "rom.hpp"
 #include "ram.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 namespace qtboy
 {
 
-Mbc1::Mbc1(Rom *rom, std::optional<External_ram> *ram)
+Mbc1::Mbc1(const Rom *rom, std::optional<External_ram> *ram)
     : rom_ {rom}, ram_ {ram}
 {}
 
@@ -104,4 +105,20 @@ void Mbc1::adjust_rom_bank()
     }
 }
 
+void Mbc1::save_state(State_writer &w) const
+{
+    w.put(ram_bank_);
+    w.put(rom_bank_);
+    w.put(ram_enable_);
+    w.put(ram_mode_select_);
+}
+
+void Mbc1::load_state(State_reader &r)
+{
+    r.get(ram_bank_);
+    r.get(rom_bank_);
+    r.get(ram_enable_);
+    r.get(ram_mode_select_);
+}
+
 }
@@ -3,11 +3,12 @@
 #include "rom.hpp"
 #include "ram.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 namespace qtboy
 {
 
-Mbc2::Mbc2(Rom *rom)
+Mbc2::Mbc2(const Rom *rom)
     : rom_ {rom},
       ram_(512)
 {}
@@ -77,4 +78,18 @@ std::vector<uint8_t> Mbc2::dump_ram() const
     return ram_;
 }
 
+void Mbc2::save_state(State_writer &w) const
+{
+    w.put(rom_bank_);
+    w.put(ram_enable_);
+    w.put_bytes(ram_.data(), ram_.size());
+}
+
+void Mbc2::load_state(State_reader &r)
+{
+    r.get(rom_bank_);
+    r.get(ram_enable_);
+    r.get_bytes(ram_.data(), ram_.size());
+}
+
 }
@@ -3,17 +3,19 @@
 #include "rom.hpp"
 #include "ram.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 #include <ctime>
 
 namespace qtboy
 {
 
-Mbc3::Mbc3(Rom *rom, std::optional<External_ram> *ram)
-    : rom_ {rom}, ram_ {ram}
+Mbc3::Mbc3(const Rom *rom, std::optional<External_ram> *ram,
+           std::function<int64_t()> clock)
+    : rom_ {rom}, ram_ {ram}, clock_ {std::move(clock)}
 {
     // initialize RTC
-    rtc_.base_time = std::time(nullptr);
+    rtc_.base_time = now();
     rtc_.base_regs = {};
     rtc_.latched_regs = {};
     rtc_.latched = false;
@@ -214,7 +216,7 @@ void Mbc3::load_rtc(const std::array<uint8_t, 5> &base)
 void Mbc3::update_rtc() const
 {
     // get current time
-    std::time_t now = std::time(nullptr);
+    std::time_t now = this->now();
     std::time_t new_time = 0;
     // update time if RTC is enabled
     if ((rtc_.base_regs[4] & 0x40) == 0 && now > rtc_.base_time)
@@ -240,6 +242,37 @@ void Mbc3::update_rtc() const
     rtc_.base_time = now;
 }
 
+std::time_t Mbc3::now() const
+{
+    return clock_ ? static_cast<std::time_t>(clock_()) : std::time(nullptr);
+}
+
+void Mbc3::save_state(State_writer &w) const
+{
+    w.put(ram_rtc_enable_);
+    w.put(ram_timer_enable_);
+    w.put(rom_bank_);
+    w.put(ram_bank_);
+    w.put(is_rtc_);
+    w.put(mapped_rtc_);
+    w.put(static_cast<int64_t>(rtc_.base_time));
+    w.put(rtc_.base_regs);
+    w.put(rtc_.latched_regs);
+    w.put(rtc_.latched);
+}
 
+void Mbc3::load_state(State_reader &r)
+{
+    r.get(ram_rtc_enable_);
+    r.get(ram_timer_enable_);
+    r.get(rom_bank_);
+    r.get(ram_bank_);
+    r.get(is_rtc_);
+    r.get(mapped_rtc_);
+    rtc_.base_time = static_cast<std::time_t>(r.get<int64_t>());
+    r.get(rtc_.base_regs);
+    r.get(rtc_.latched_regs);
+    r.get(rtc_.latched);
+}
 
 }
@@ -3,11 +3,12 @@
 #include "rom.hpp"
 #include "ram.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 namespace qtboy
 {
 
-Mbc5::Mbc5(Rom *rom, std::optional<External_ram> *ram)
+Mbc5::Mbc5(const Rom *rom, std::optional<External_ram> *ram)
     : rom_ {rom}, ram_ {ram}
 {}
 
@@ -50,7 +51,7 @@ void Mbc5::write(uint8_t b, uint16_t adr)
     }
     else if (adr < 0x4000) // hi bit of ROM bank # select
     {
-        rom_bank_ &= (b ? 0x100 : ~0x100);
+        rom_bank_ = (rom_bank_ & 0xff) | (b & 1) << 8;
     }
     else if (adr < 0x6000) // high bit
     {
@@ -77,5 +78,18 @@ std::vector<uint8_t> Mbc5::dump_ram() const
     return ram_->value().dump();
 }
 
+void Mbc5::save_state(State_writer &w) const
+{
+    w.put(ram_enable_);
+    w.put(ram_bank_);
+    w.put(rom_bank_);
+}
+
+void Mbc5::load_state(State_reader &r)
+{
+    r.get(ram_enable_);
+    r.get(ram_bank_);
+    r.get(rom_bank_);
+}
 
 }
@@ -1,23 +1,28 @@
 #include "processor.hpp"
 #include "memory.hpp"
 #include "timer.hpp"
+#include "serial.hpp"
 #include "ppu.hpp"
 #include "joypad.hpp"
 #include "exception.hpp"
 #include "apu.hpp"
+#include "state.hpp"
+#include "trace.hpp"
 
 #include <cstdint>
+#include <algorithm>
 // #include <QDebug>
 
 namespace qtboy
 {
 
-Memory::Memory(Processor &c, Ppu &p, Timer &t, Joypad &j, Apu &a)
+Memory::Memory(Processor &c, Ppu &p, Timer &t, Joypad &j, Apu &a, Serial &s)
     : cpu_ {c},
       ppu_ {p},
       timer_ {t},
       joypad_ {j},
-      apu_ {a}
+      apu_ {a},
+      serial_ {s}
 {
     init_io();
 }
@@ -25,13 +30,29 @@ Memory::Memory(Processor &c, Ppu &p, Timer &t, Joypad &j, Apu &a)
 void Memory::enable_cgb(bool is_cgb)
 {
     cgb_mode_ = is_cgb;
+    if (is_cgb)
+    {
+        read_ = &Memory::read_impl<Model::Cgb>;
+        write_ = &Memory::write_impl<Model::Cgb>;
+    }
+    else
+    {
+        read_ = &Memory::read_impl<Model::Dmg>;
+        write_ = &Memory::write_impl<Model::Dmg>;
+    }
 }
 
-uint8_t Memory::read(uint16_t adr) const
+template <Model M>
+uint8_t Memory::read_impl(uint16_t adr) const
 {
+    constexpr bool cgb {M == Model::Cgb};
     if (!cart_) // no cartridge inserted
         return 0xff;
 
+    // during OAM DMA the CPU sees the byte being transferred on the bus the DMA uses
+    if (adr < 0xff00 && cpu_.cycles() < dma_end_ && dma_conflict(adr))
+        return (adr < 0xfe00) ? oam_[dma_index()] : 0xff;
+
     uint8_t b {0xff};
 
     if (adr < 0x8000) // ROM bank accessing
@@ -40,12 +61,13 @@ uint8_t Memory::read(uint16_t adr) const
     }
     else if (adr < 0xa000) // VRAM accessing
     {
+        sync_ppu();
         // VRAM accesible when PPU disabled or mode isn't 3
         if (!ppu_.enabled() || ppu_.mode() != 3)
         {
             uint16_t a = adr - 0x8000; // adjusted for placement in memory map
             // CGB can access banks 0-1
-            if (cgb_mode_)
+            if constexpr (cgb)
             {
                 // get VRAM bank specified in bit 0 of 0xff4f
                 uint8_t bank = io_[0x4f] & 1;
@@ -69,7 +91,7 @@ uint8_t Memory::read(uint16_t adr) const
     else if (adr < 0xe000) // WRAM bank 1-7 accessing (CGB)
     {
         uint16_t a = adr - 0xd000; // adjust
-        if (cgb_mode_) // WRAM banks 1-7 are accessible in CGB mode
+        if constexpr (cgb) // WRAM banks 1-7 are accessible in CGB mode
         {
             uint8_t bank = io_[0x70] & 7;
             if (bank == 0)
@@ -83,10 +105,11 @@ uint8_t Memory::read(uint16_t adr) const
     }
     else if (adr < 0xfe00) // echo RAM
     {
-        return read(adr - 0x2000);  // echo ram of 0xc000-0xddff
+        return read_impl<M>(adr - 0x2000);  // echo ram of 0xc000-0xddff
     }
     else if (adr < 0xfea0) // OAM accessing
     {
+        sync_ppu();
         //if (!ppu_.enabled() || ppu_.mode() < 2)
             b = oam_[adr - 0xfe00];
        // else
@@ -102,14 +125,25 @@ uint8_t Memory::read(uint16_t adr) const
     {
         if (adr == 0xff00)
             b = joypad_.read_reg();
+        else if (adr == 0xff01 || adr == 0xff02) // serial registers
+            b = serial_.read(adr);
         else if (adr > 0xff03 && adr < 0xff08) // timer registers
             b = timer_.read(adr);
         else if (adr > 0xff0f && adr < 0xff40) // APU registers
+        {
+            sync_apu();
             b = apu_.read_reg(adr);
+        }
         else if (adr > 0xff3f && adr < 0xff4c && adr != 0xff46) // ppu registers
+        {
+            sync_ppu();
             b = ppu_.read_reg(adr);
-        else if (cgb_mode_ && adr >= 0xff68 && adr <= 0xff6b) // CGB PPU regs
+        }
+        else if (cgb && adr >= 0xff68 && adr <= 0xff6b) // CGB PPU regs
+        {
+            sync_ppu();
             b = ppu_.read_reg(adr);
+        }
         else // misc. IO register
         {
             b = io_[adr - 0xff00];
@@ -118,14 +152,14 @@ uint8_t Memory::read(uint16_t adr) const
             {
                 case 0xff4d: // key1 (GBC only: sped switch)
                 {
-                    if (cgb_mode_)
+                    if constexpr (cgb)
                         b |= 0x7e; // only bits 0 and 7 are read, other bits=1
                     else
                         b = 0xff;
                 } break;
                 case 0xff4f: // vbk
                 {
-                    if (cgb_mode_)
+                    if constexpr (cgb)
                     {
                         b &= 1;
                         b |= 0xfe;
@@ -142,7 +176,7 @@ uint8_t Memory::read(uint16_t adr) const
                 case 0xff54: b = hdma_dest_ & 0xff; break; // hdma4
                 case 0xff55:// hdma5
                 {
-                    if (!cgb_mode_)
+                    if constexpr (!cgb)
                         b = 0xff;
                     else
                         b = static_cast<uint8_t>(
@@ -151,7 +185,7 @@ uint8_t Memory::read(uint16_t adr) const
                 } break;
                 case 0xff70: // svbk
                 {
-                    if (cgb_mode_) // upper 5 bits always read 1 in CGB
+                    if constexpr (cgb) // upper 5 bits always read 1 in CGB
                         b |= 0xf8;
                     else // always FF in DMG
                         b = 0xff;
@@ -170,12 +204,17 @@ uint8_t Memory::read(uint16_t adr) const
     return b;
 }
 
-void Memory::write(uint8_t b, uint16_t adr)
+template <Model M>
+void Memory::write_impl(uint8_t b, uint16_t adr)
 {
+    constexpr bool cgb {M == Model::Cgb};
     if (!cart_) // no cartridge inserted
         return;
     if (debug_mode_)
         debug_callback_(b, adr);
+    // writes to a bus in use by OAM DMA are lost
+    if (adr < 0xff00 && cpu_.cycles() < dma_end_ && dma_conflict(adr))
+        return;
     /*
     if (adr == 0xff02 && b == 0x81)
             // qStdOut() << static_cast<char>(read(0xff01));
@@ -201,13 +240,14 @@ void Memory::write(uint8_t b, uint16_t adr)
     }
     else if (adr < 0xa000) // VRAM accessing
     {
+        sync_ppu();
         // VRAM only accessible if PPU is enabled and PPU mode isn't 3
 
         if (!ppu_.enabled() || ppu_.mode() != 3)
         {
             uint16_t a = adr - 0x8000; // adjusted for placement in memory map
             // CGB can access banks 0-1
-            if (cgb_mode_)
+            if constexpr (cgb)
             {
                 // get VRAM bank specified in bit 0 of 0xff4f
                 uint8_t bank = io_[0x4f] & 1;
@@ -232,7 +272,7 @@ void Memory::write(uint8_t b, uint16_t adr)
     else if (adr < 0xe000) // write to WRAM bank 1-n
     {
         uint16_t a = adr - 0xd000; // adjust
-        if (cgb_mode_) // WRAM banks 1-7 are accessible in CGB mode
+        if constexpr (cgb) // WRAM banks 1-7 are accessible in CGB mode
         {
             uint8_t bank = io_[0x70] & 7;
             if (bank == 0)
@@ -246,10 +286,11 @@ void Memory::write(uint8_t b, uint16_t adr)
     }
     else if (adr < 0xfe00) // echo RAM
     {
-        write(b, adr - 0x2000);  // echo ram of 0xc000-0xddff
+        write_impl<M>(b, adr - 0x2000);  // echo ram of 0xc000-0xddff
     }
     else if (adr < 0xfea0) // OAM accessing
     {
+        sync_ppu();
         // OAM only accessible if PPU is enabled and PPU mode is 0 or 1
         if (!ppu_.enabled() || ppu_.mode() < 2)
             oam_[adr - 0xfe00] = b;
@@ -263,18 +304,32 @@ void Memory::write(uint8_t b, uint16_t adr)
     {
         if (adr == 0xff00)
             joypad_.write_reg(b);
+        else if (adr == 0xff01 || adr == 0xff02) // serial registers
+            serial_.write(b, adr);
         else if (adr > 0xff03 && adr < 0xff08) // timer registers
             timer_.write(b, adr);
         else if (adr > 0xff0f && adr < 0xff40) // APU registers
+        {
+            sync_apu();
             apu_.write_reg(b, adr);
+        }
         else if (adr > 0xff3f && adr < 0xff4c && adr != 0xff46) // PPU registers
+        {
+            sync_ppu();
             ppu_.write_reg(b, adr);
-        else if (cgb_mode_ && adr >= 0xff68 && adr <= 0xff6b) // CGB PPU regs
+        }
+        else if (cgb && adr >= 0xff68 && adr <= 0xff6b) // CGB PPU regs
+        {
+            sync_ppu();
             ppu_.write_reg(b, adr);
+        }
         else if (adr == 0xff46) // DMA
+        {
+            sync_ppu();
             oam_dma_transfer(b);
+        }
         // misc. IO registers
-        if (cgb_mode_)
+        if constexpr (cgb)
         {
             switch (adr)
             {
@@ -358,13 +413,21 @@ void Memory::vram_write(uint8_t b, uint8_t bank, uint16_t a)
 
 Cartridge *Memory::load_cartridge(std::istream &is)
 {
-    cart_ = std::make_unique<Cartridge>(is);
+    return load_cartridge(std::make_shared<const Rom>(is));
+}
+
+Cartridge *Memory::load_cartridge(std::shared_ptr<const Rom> rom)
+{
+    cart_ = std::make_unique<Cartridge>(std::move(rom), clock_);
     set_ram_size();
-    if (cart_->is_cgb())
-        cgb_mode_ = true;
     return cart_.get();
 }
 
+std::shared_ptr<const Rom> Memory::rom() const
+{
+    return cart_ ? cart_->rom() : nullptr;
+}
+
 void Memory::reset()
 {
     vram_.reset();
@@ -376,11 +439,14 @@ void Memory::reset()
     init_io();
     logging_ = false;
     log_.clear();
-    cgb_mode_ = false;
+    enable_cgb(false);
     hdma_active_ = false;
     hdma_src_ = 0;
     hdma_dest_ = 0;
     hdma_len_ = 0xff;
+    dma_src_ = 0;
+    dma_start_ = 0;
+    dma_end_ = 0;
 }
 
 std::vector<uint8_t> Memory::dump_rom() const
@@ -530,19 +596,21 @@ void Memory::oam_dma_transfer(uint8_t b)
 {
     if (b > 0xf1) // only defined for range between 00-f1
         throw std::runtime_error {"Attempted to write value outside 00-f1 for OAM DMA transfer"};
-    // make sure OAM is the correct size (not really necessary but just to make sure OAM DMA
-    // doesn't access out of bounds.
     static_assert(std::tuple_size<decltype(oam_)>::value == 0xa0,
                   "OAM is incorrect size, should be 0xa0)");
-    // copy from XX00-XX9f to oam (fe00-fe9f), where XXh = b
-    for (uint8_t i {0}; i < 0x9f; ++i)
-        oam_[i] = read(static_cast<uint16_t>(b << 8 | i));
-    // OAM DMA transfer should take 160 machine cycles (160*4 clock cycles)
-    cpu_.add_cycles(160*4);
+    // copy from XX00-XX9f to oam (fe00-fe9f), where XXh = b. The copy is done at once, the
+    // CPU is then locked out of the source bus and OAM for the 160 machine cycles the transfer
+    // takes.
+    const Trace_scope probe {"dma.oam"};
+    dma_src_ = static_cast<uint16_t>(b << 8);
+    bus_copy(dma_src_, oam_.data(), 0xa0);
+    dma_start_ = cpu_.cycles();
+    dma_end_ = dma_start_ + (cpu_.double_speed() ? 160*2 : 160*4);
 }
 
 void Memory::vram_dma_transfer(uint8_t b)
 {
+    sync_ppu();
     hdma_len_ = (b & 0x7f);
     // uint8_t hdma_len = (b & 0x7f);
     // bit 7 is 0: GDMA (instant)
@@ -562,12 +630,15 @@ void Memory::vram_dma_transfer(uint8_t b)
     {
         hdma_active_ = true;
     }
+    // HDMA needs the PPU to be caught up at every HBLANK
+    ppu_.schedule_event();
 }
 
 void Memory::general_dma(uint8_t hdma_len)
 {
-    // copy everything all at once
-    for (uint16_t i = 0; i < (hdma_len_ & 0x7f); ++i)
+    const Trace_scope probe {"dma.general"};
+    // copy everything all at once (hdma_len+1 blocks of 10h bytes)
+    for (uint16_t i = 0; i <= (hdma_len_ & 0x7f); ++i)
         dma_copy();
     // ff55 reads 0xff when finished
     hdma_len_ = 0xff;
@@ -580,6 +651,7 @@ void Memory::hblank_dma()
     // only run if active and cpu isn't halted
     if (hdma_active_ && !cpu_.halted())
     {
+        const Trace_scope probe {"dma.hblank"};
         // end if no more  bytes to copy
         if ((hdma_len_ & 0x7f) == 0)
             hdma_active_ = false;
@@ -593,18 +665,119 @@ void Memory::dma_copy()
 {
     // HDMA src in e000-ffff maps to a000-bfff
     uint16_t src = (hdma_src_ >= 0xe000) ? hdma_src_-0x4000 : hdma_src_;
-    uint16_t dst = hdma_dest_;
-    for (uint8_t i = 0; i < 0x10; ++i)
-    {
-        if (src < 0x8000 || src > 0x9fff)
-            write( read(src), dst );
-        ++src;
-        ++dst;
-    }
+    // destination is always in the selected VRAM bank
+    uint8_t *dst = vram_.data(io_[0x4f] & 1, hdma_dest_ & 0x1ff0, 0x10);
+    // VRAM can't be used as the source
+    if (src < 0x8000 || src > 0x9fff)
+        bus_copy(src, dst, 0x10);
     hdma_src_ += 0x10;
     hdma_dest_ += 0x10;
 }
 
+void Memory::bus_copy(uint16_t src, uint8_t *out, uint16_t len) const
+{
+    if (src >= 0xe000 && src < 0xfe00) // echo RAM
+        src -= 0x2000;
+    const uint8_t *p {nullptr};
+    if (src >= 0x8000 && src < 0xa000)
+        p = vram_.data(cgb_mode_ ? io_[0x4f] & 1 : 0) + (src - 0x8000);
+    else if (src >= 0xc000 && src < 0xd000)
+        p = wram_.data(0) + (src - 0xc000);
+    else if (src >= 0xd000 && src < 0xe000)
+    {
+        uint8_t bank = cgb_mode_ ? io_[0x70] & 7 : 1;
+        p = wram_.data(bank ? bank : 1) + (src - 0xd000);
+    }
+
+    if (p)
+    {
+        std::copy_n(p, len, out);
+    }
+    else // ROM and external RAM go through the MBC
+    {
+        for (uint16_t i {0}; i < len; ++i)
+            out[i] = cart_->read(static_cast<uint16_t>(src + i));
+    }
+}
+
+bool Memory::dma_conflict(uint16_t adr) const
+{
+    // OAM is always busy, otherwise VRAM and the external bus (cartridge, WRAM) conflict
+    // only with themselves
+    if (adr >= 0xfe00)
+        return true;
+    auto vram_bus = [](uint16_t a){ return a >= 0x8000 && a < 0xa000; };
+    return vram_bus(adr) == vram_bus(dma_src_);
+}
+
+uint8_t Memory::dma_index() const
+{
+    const uint64_t elapsed {(cpu_.cycles() - dma_start_) * 0xa0 / (dma_end_ - dma_start_)};
+    return static_cast<uint8_t>(std::min<uint64_t>(elapsed, 0x9f));
+}
+
+void Memory::save_state(State_writer &w) const
+{
+    vram_.save_state(w);
+    wram_.save_state(w);
+    w.put(oam_);
+    w.put(io_);
+    w.put(hram_);
+    w.put(ie_);
+    w.put(cgb_mode_);
+    w.put(hdma_active_);
+    w.put(hdma_src_);
+    w.put(hdma_dest_);
+    w.put(hdma_len_);
+    w.put(dma_src_);
+    w.put(dma_start_);
+    w.put(dma_end_);
+    if (cart_)
+        cart_->save_state(w);
+}
+
+void Memory::load_state(State_reader &r)
+{
+    vram_.load_state(r);
+    wram_.load_state(r);
+    r.get(oam_);
+    r.get(io_);
+    r.get(hram_);
+    r.get(ie_);
+    enable_cgb(r.get<bool>());
+    r.get(hdma_active_);
+    r.get(hdma_src_);
+    r.get(hdma_dest_);
+    r.get(hdma_len_);
+    r.get(dma_src_);
+    r.get(dma_start_);
+    r.get(dma_end_);
+    if (cart_)
+        cart_->load_state(r);
+}
+
+uint16_t Memory::rom_checksum() const
+{
+    return cart_ ? cart_->checksum() : 0;
+}
+
+void Memory::set_clock(std::function<int64_t()> clock)
+{
+    clock_ = std::move(clock);
+    if (cart_)
+        cart_->set_clock(clock_);
+}
+
+void Memory::sync_ppu() const
+{
+    ppu_.catch_up(cpu_.cycles());
+}
+
+void Memory::sync_apu() const
+{
+    apu_.catch_up(cpu_.cycles());
+}
+
 void Memory::set_debug_mode(bool b)
 {
     debug_mode_ = b;
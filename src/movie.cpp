@@ -0,0 +1,70 @@
+#include "movie.hpp"
+#include "state.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+// A movie file is MOVIE_MAGIC, MOVIE_VERSION, the ROM hash, the start time, the size and bytes of the start
+// state, then the number of frames and one input byte per frame.
+static constexpr uint32_t MOVIE_MAGIC {0x564d4251}; // "QBMV"
+static constexpr uint16_t MOVIE_VERSION {1};
+
+static void put_movie(State_writer &w, const Movie &m)
+{
+    w.put(MOVIE_MAGIC);
+    w.put(MOVIE_VERSION);
+    w.put(m.rom_hash);
+    w.put(m.start_time);
+    w.put(static_cast<uint64_t>(m.start_state.size()));
+    w.put_bytes(m.start_state.data(), m.start_state.size());
+    w.put(static_cast<uint64_t>(m.inputs.size()));
+    w.put_bytes(m.inputs.data(), m.inputs.size());
+}
+
+void Movie::save(const std::string &path) const
+{
+    State_writer counter {};
+    put_movie(counter, *this);
+    std::vector<uint8_t> buf(counter.size());
+    State_writer w {buf.data(), buf.size()};
+    put_movie(w, *this);
+
+    std::ofstream out {path, std::ios::binary | std::ios::trunc};
+    if (!out.write(reinterpret_cast<const char *>(buf.data()), buf.size()))
+        throw std::runtime_error {"Could not write movie to " + path};
+}
+
+Movie Movie::load(const std::string &path)
+{
+    std::ifstream in {path, std::ios::binary};
+    if (!in.good())
+        throw std::runtime_error {"Could not open movie " + path};
+    const std::vector<uint8_t> buf {std::istreambuf_iterator<char>(in),
+                                    std::istreambuf_iterator<char>()};
+    State_reader r {buf.data(), buf.size()};
+    if (r.get<uint32_t>() != MOVIE_MAGIC)
+        throw std::runtime_error {path + " is not a movie"};
+    if (r.get<uint16_t>() != MOVIE_VERSION)
+        throw std::runtime_error {"Movie " + path + " is from an unsupported version"};
+    Movie m {};
+    r.get(m.rom_hash);
+    r.get(m.start_time);
+    // sizes are checked against what is left before allocating
+    auto get_block = [&r, &buf](std::vector<uint8_t> &v)
+    {
+        const uint64_t n {r.get<uint64_t>()};
+        if (n > buf.size() - r.size())
+            throw std::runtime_error {"Movie is truncated"};
+        v.resize(n);
+        r.get_bytes(v.data(), n);
+    };
+    get_block(m.start_state);
+    get_block(m.inputs);
+    return m;
+}
+
+}
@@ -0,0 +1,381 @@
+#include "netplay.hpp"
+#include "system.hpp"
+#include "socket.hpp"
+#include "state.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+//
+// Udp_transport
+//
+
+Udp_transport::Udp_transport(uint16_t local_port, const std::string &remote_host,
+                             uint16_t remote_port)
+    : sockets_ {std::make_unique<Socket_library>()}
+{
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *res {nullptr};
+    if (getaddrinfo(remote_host.c_str(), nullptr, &hints, &res) != 0 || !res)
+        throw std::runtime_error {"Could not resolve " + remote_host};
+    remote_ip_ = reinterpret_cast<sockaddr_in *>(res->ai_addr)->sin_addr.s_addr;
+    remote_port_ = htons(remote_port);
+    freeaddrinfo(res);
+
+    socket_ = static_cast<std::intptr_t>(::socket(AF_INET, SOCK_DGRAM, 0));
+    sockaddr_in local {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(local_port);
+    if (socket_ < 0)
+        throw std::runtime_error {"Could not create a socket"};
+    if (bind(static_cast<Socket>(socket_), reinterpret_cast<sockaddr *>(&local),
+             sizeof(local)) != 0)
+    {
+        close_socket(static_cast<Socket>(socket_));
+        throw std::runtime_error {"Could not bind UDP port " + std::to_string(local_port)};
+    }
+    set_nonblocking(static_cast<Socket>(socket_));
+}
+
+Udp_transport::~Udp_transport()
+{
+    close_socket(static_cast<Socket>(socket_));
+}
+
+void Udp_transport::set_conditions(unsigned latency_ms, unsigned jitter_ms, double loss)
+{
+    latency_ms_ = latency_ms;
+    jitter_ms_ = std::min(jitter_ms, latency_ms);
+    loss_ = loss;
+}
+
+void Udp_transport::send(const uint8_t *data, size_t len)
+{
+    flush();
+    if (loss_ > 0 && std::uniform_real_distribution<double>(0, 1)(rng_) < loss_)
+        return;
+    if (latency_ms_ == 0)
+    {
+        send_now(data, len);
+        return;
+    }
+    const int jitter {static_cast<int>(jitter_ms_)};
+    const int delay {static_cast<int>(latency_ms_)
+                     + std::uniform_int_distribution<int>(-jitter, jitter)(rng_)};
+    held_.push_back({Clock::now() + std::chrono::milliseconds(delay),
+                     std::vector<uint8_t>(data, data + len)});
+}
+
+size_t Udp_transport::receive(uint8_t *buf, size_t size)
+{
+    flush();
+    sockaddr_in from {};
+    socklen_t from_len {sizeof(from)};
+    const auto n = recvfrom(static_cast<Socket>(socket_), reinterpret_cast<char *>(buf),
+                            static_cast<int>(size), 0, reinterpret_cast<sockaddr *>(&from),
+                            &from_len);
+    // ignore anything that isn't from the peer
+    if (n <= 0 || from.sin_addr.s_addr != remote_ip_ || from.sin_port != remote_port_)
+        return 0;
+    return static_cast<size_t>(n);
+}
+
+void Udp_transport::send_now(const uint8_t *data, size_t len)
+{
+    sockaddr_in to {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = remote_ip_;
+    to.sin_port = remote_port_;
+    sendto(static_cast<Socket>(socket_), reinterpret_cast<const char *>(data),
+           static_cast<int>(len), 0, reinterpret_cast<sockaddr *>(&to), sizeof(to));
+}
+
+void Udp_transport::flush()
+{
+    const auto now = Clock::now();
+    auto due = std::stable_partition(held_.begin(), held_.end(),
+                                     [now](const Held_packet &p){ return p.due > now; });
+    for (auto it = due; it != held_.end(); ++it)
+        send_now(it->data.data(), it->data.size());
+    held_.erase(due, held_.end());
+}
+
+//
+// Rollback_session
+//
+
+// Packets start with their type. The start state is sent in chunks small enough to never be
+// fragmented.
+enum class Packet : uint8_t
+{
+    Hello, // host: ROM hash, start time, state size
+    Chunk, // host: index, size and bytes of a piece of the start state
+    Ready, // guest: the start state was received
+    Inputs // both: ack, first frame, count, inputs, check frame, check hash
+};
+static constexpr size_t CHUNK_SIZE {1024};
+static constexpr size_t MAX_PACKET {CHUNK_SIZE + 64};
+static constexpr uint64_t NO_CHECK {UINT64_MAX};
+static constexpr size_t HELLO_SIZE {sizeof(Packet) + 2 * sizeof(uint64_t) + sizeof(uint32_t)};
+static constexpr size_t CHUNK_HEADER_SIZE {sizeof(Packet) + 2 * sizeof(uint32_t)};
+static constexpr size_t INPUTS_HEADER_SIZE {sizeof(Packet) + 2 * sizeof(uint64_t) + sizeof(uint16_t)};
+
+Rollback_session::Rollback_session(Gameboy &gb, Udp_transport &net, bool host,
+                                   unsigned max_rollback, unsigned input_delay)
+    : gb_ {gb}, net_ {net}, host_ {host},
+      max_rollback_ {std::min(max_rollback, RING_SIZE / 4)},
+      input_delay_ {std::min(input_delay, RING_SIZE / 8)},
+      states_(RING_SIZE, std::vector<uint8_t>(gb.state_size())),
+      packet_(MAX_PACKET)
+{
+    rom_hash_ = gb_.rom_hash();
+    // the first input_delay_ frames have no input on both sides
+    local_known_ = input_delay_;
+}
+
+bool Rollback_session::synchronize()
+{
+    if (host_ && start_state_.empty())
+    {
+        start_time_ = std::time(nullptr);
+        gb_.set_emulated_rtc(start_time_);
+        start_state_.resize(gb_.state_size());
+        gb_.save_state(start_state_.data(), start_state_.size());
+    }
+    receive();
+    if (host_ && !synced_)
+    {
+        State_writer w {packet_.data(), packet_.size()};
+        w.put(Packet::Hello);
+        w.put(rom_hash_);
+        w.put(start_time_);
+        w.put(static_cast<uint32_t>(start_state_.size()));
+        net_.send(packet_.data(), w.size());
+        for (size_t i {0}; i * CHUNK_SIZE < start_state_.size(); ++i)
+        {
+            const size_t n {std::min(CHUNK_SIZE, start_state_.size() - i * CHUNK_SIZE)};
+            State_writer c {packet_.data(), packet_.size()};
+            c.put(Packet::Chunk);
+            c.put(static_cast<uint32_t>(i));
+            c.put(static_cast<uint32_t>(n));
+            c.put_bytes(start_state_.data() + i * CHUNK_SIZE, n);
+            net_.send(packet_.data(), c.size());
+        }
+    }
+    return synced_;
+}
+
+bool Rollback_session::advance(uint8_t local_input)
+{
+    receive();
+    if (rollback_from_ < frame_)
+        rollback();
+    if (frame_ >= remote_known_ + max_rollback_)
+    {
+        ++stats_.stalls;
+        send_inputs();
+        return false;
+    }
+    local_[(frame_ + input_delay_) % RING_SIZE] = local_input;
+    local_known_ = frame_ + input_delay_ + 1;
+    simulate(frame_++);
+    stats_.frame = frame_;
+    stats_.confirmed_frame = confirmed();
+    check_desync();
+    send_inputs();
+    return true;
+}
+
+void Rollback_session::poll()
+{
+    receive();
+    if (rollback_from_ < frame_)
+        rollback();
+    stats_.confirmed_frame = confirmed();
+    check_desync();
+    if (synced_)
+        send_inputs();
+}
+
+uint64_t Rollback_session::confirmed() const
+{
+    return std::min({frame_, remote_known_, local_known_, rollback_from_});
+}
+
+void Rollback_session::receive()
+{
+    std::array<uint8_t, MAX_PACKET> buf;
+    while (const size_t n = net_.receive(buf.data(), buf.size()))
+        handle_packet(buf.data(), n);
+}
+
+void Rollback_session::handle_packet(const uint8_t *data, size_t len)
+{
+    // sizes are checked up front so that a malformed packet is simply ignored
+    State_reader r {data, len};
+    if (len < sizeof(Packet))
+        return;
+    switch (r.get<Packet>())
+    {
+        case Packet::Hello:
+        {
+            if (host_ || len != HELLO_SIZE)
+                return;
+            if (synced_)
+            {
+                // our Ready was lost
+                send_ready();
+                return;
+            }
+            if (r.get<uint64_t>() != rom_hash_)
+                throw std::runtime_error {"Netplay peer has another ROM loaded"};
+            r.get(start_time_);
+            const auto size = r.get<uint32_t>();
+            if (size != gb_.state_size())
+                throw std::runtime_error {"Save state has the wrong size for the loaded ROM"};
+            if (start_state_.size() != size)
+            {
+                start_state_.assign(size, 0);
+                chunks_received_.assign((size + CHUNK_SIZE - 1) / CHUNK_SIZE, false);
+            }
+            break;
+        }
+        case Packet::Chunk:
+        {
+            if (host_ || synced_ || start_state_.empty() || len < CHUNK_HEADER_SIZE)
+                return;
+            const auto i = r.get<uint32_t>();
+            const auto n = r.get<uint32_t>();
+            if (n != len - CHUNK_HEADER_SIZE || i >= chunks_received_.size()
+                || i * CHUNK_SIZE + n > start_state_.size())
+                return;
+            r.get_bytes(start_state_.data() + i * CHUNK_SIZE, n);
+            chunks_received_[i] = true;
+            if (std::all_of(chunks_received_.begin(), chunks_received_.end(),
+                            [](bool b){ return b; }))
+            {
+                gb_.load_state(start_state_.data(), start_state_.size());
+                gb_.set_emulated_rtc(start_time_);
+                synced_ = true;
+                send_ready();
+            }
+            break;
+        }
+        case Packet::Ready:
+            if (host_)
+                synced_ = true;
+            break;
+        case Packet::Inputs:
+        {
+            // the guest only sends inputs once it has the start state
+            if (host_)
+                synced_ = true;
+            if (!synced_ || len < INPUTS_HEADER_SIZE)
+                return;
+            remote_ack_ = std::max<uint64_t>(remote_ack_, r.get<uint64_t>());
+            const auto first = r.get<uint64_t>();
+            const auto count = r.get<uint16_t>();
+            if (len != INPUTS_HEADER_SIZE + count + 2 * sizeof(uint64_t))
+                return;
+            for (uint64_t f {first}; f < first + count; ++f)
+            {
+                const auto input = r.get<uint8_t>();
+                // only extend the run of known inputs (older packets may arrive late)
+                if (f != remote_known_ || f >= frame_ + RING_SIZE / 2)
+                    continue;
+                remote_[f % RING_SIZE] = input;
+                ++remote_known_;
+                if (f < frame_ && predicted_[f % RING_SIZE] != input)
+                    rollback_from_ = std::min(rollback_from_, f);
+            }
+            const auto check = r.get<uint64_t>();
+            const auto hash = r.get<uint64_t>();
+            if (check != NO_CHECK)
+            {
+                peer_check_frame_ = check;
+                peer_check_hash_ = hash;
+            }
+            break;
+        }
+    }
+}
+
+void Rollback_session::send_inputs()
+{
+    // everything the peer hasn't acknowledged, as much as fits
+    const uint64_t first {std::max(remote_ack_, local_known_ > RING_SIZE / 2
+                                                ? local_known_ - RING_SIZE / 2 : 0)};
+    State_writer w {packet_.data(), packet_.size()};
+    w.put(Packet::Inputs);
+    w.put(remote_known_);
+    w.put(first);
+    w.put(static_cast<uint16_t>(local_known_ - first));
+    for (uint64_t f {first}; f < local_known_; ++f)
+        w.put(local_[f % RING_SIZE]);
+    const uint64_t c {confirmed()};
+    const bool can_check {c > 0 && frame_ - c < RING_SIZE};
+    w.put(can_check ? c - 1 : NO_CHECK);
+    w.put(can_check ? hashes_[(c - 1) % RING_SIZE] : uint64_t {0});
+    net_.send(packet_.data(), w.size());
+}
+
+void Rollback_session::send_ready()
+{
+    const Packet p {Packet::Ready};
+    net_.send(reinterpret_cast<const uint8_t *>(&p), sizeof(p));
+}
+
+void Rollback_session::rollback()
+{
+    const uint64_t from {rollback_from_};
+    const uint64_t to {frame_};
+    rollback_from_ = UINT64_MAX;
+    const auto &state = states_[from % RING_SIZE];
+    gb_.load_state(state.data(), state.size());
+    // the frames being caught up on were already shown
+    gb_.set_output(false);
+    for (uint64_t f {from}; f < to; ++f)
+        simulate(f);
+    gb_.set_output(true);
+    ++stats_.rollbacks;
+    stats_.resimulated_frames += to - from;
+    stats_.max_rollback_depth = std::max(stats_.max_rollback_depth,
+                                         static_cast<unsigned>(to - from));
+}
+
+void Rollback_session::simulate(uint64_t f)
+{
+    auto &state = states_[f % RING_SIZE];
+    gb_.save_state(state.data(), state.size());
+    // (the first input_delay_ local inputs are left at 0)
+    const uint8_t local {local_[f % RING_SIZE]};
+    uint8_t remote {0};
+    if (f < remote_known_)
+        remote = remote_[f % RING_SIZE];
+    else if (remote_known_ > 0) // predict the input is still held
+        remote = remote_[(remote_known_ - 1) % RING_SIZE];
+    predicted_[f % RING_SIZE] = remote;
+    gb_.set_input(local | remote);
+    gb_.run_frames(1);
+    hashes_[f % RING_SIZE] = gb_.state_hash();
+}
+
+void Rollback_session::check_desync()
+{
+    if (peer_check_frame_ == NO_CHECK || peer_check_frame_ >= confirmed())
+        return;
+    if (frame_ - peer_check_frame_ <= RING_SIZE
+        && hashes_[peer_check_frame_ % RING_SIZE] != peer_check_hash_)
+        stats_.desynced = true;
+    peer_check_frame_ = NO_CHECK;
+}
+
+}
@@ -1,4 +1,5 @@
 #include "noise_channel.hpp"
+#include "state.hpp"
 #include <cstdint>
 
 using namespace qtboy;
@@ -111,3 +112,35 @@ void Noise_channel::restart_sound()
     volume_ = initial_volume;
     lfsr_ = 0x7fff;
 }
+
+void Noise_channel::save_state(State_writer &w) const
+{
+    w.put(length_);
+    w.put(envelope_);
+    w.put(poly_);
+    w.put(counter_);
+    w.put(volume_);
+    w.put(output_);
+    w.put(timer_);
+    w.put(length_timer_);
+    w.put(envelope_timer_);
+    w.put(envelope_running_);
+    w.put(enabled_);
+    w.put(lfsr_);
+}
+
+void Noise_channel::load_state(State_reader &r)
+{
+    r.get(length_);
+    r.get(envelope_);
+    r.get(poly_);
+    r.get(counter_);
+    r.get(volume_);
+    r.get(output_);
+    r.get(timer_);
+    r.get(length_timer_);
+    r.get(envelope_timer_);
+    r.get(envelope_running_);
+    r.get(enabled_);
+    r.get(lfsr_);
+}
@@ -2,12 +2,16 @@
 #include "renderer.hpp"
 #include "exception.hpp"
 #include "processor.hpp"
+#include "state.hpp"
 #include "exception.hpp"
+#include "trace.hpp"
 
 #include <iostream>
 #include <string>
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 #define CHANGE_BIT(b, n, x) b ^= (-x ^ b) & (1UL << n)
 #define CLEAR_BIT(b, n) b &= ~(1UL << n)
@@ -37,6 +41,9 @@ Ppu::Ppu(Memory &m,
 void Ppu::reset()
 {
     clock_ = 0;
+    synced_ = 0;
+    next_event_ = 0;
+    frames_ = 0;
     window_line_ = 0;
     lcdc_ = 0x90;
     stat_ = 0x00;
@@ -51,8 +58,10 @@ void Ppu::reset()
     wx_ = 0;
     sprites_ = {};
     stat_signal_ = false;
+    frame_start_ = true;
+    observing_ = false;
     // CGB registers
-    cgb_mode_ = false;
+    enable_cgb(false);
     bgpd_ = {};
     obpd_ = {};
     bgpi_ = 0;
@@ -62,6 +71,8 @@ void Ppu::reset()
 void Ppu::enable_cgb(bool is_cgb)
 {
     cgb_mode_ = is_cgb;
+    render_scanline_ = is_cgb ? &Ppu::render_scanline<Model::Cgb>
+                              : &Ppu::render_scanline<Model::Dmg>;
 }
 
 void Ppu::step(size_t cycles)
@@ -73,29 +84,79 @@ void Ppu::step(size_t cycles)
         clock_ = 0;
         ly_ = 0;
         stat_ &= 0xfc; // mode 0
+        frame_start_ = true;
         return; // don't execute if master bit is off
     }
-    check_stat();
-    switch (stat_ & 3) // bit 0-1
+    // when catching up, a batch of cycles can span several modes
+    bool mode_changed {true};
+    while (mode_changed)
     {
-        // mode 2: scan for OAM sprites
-        case 2:
-            oam_scan();
-            break;
-        // OAM/VRAM read
-        // end of mode 3 = end of scan line
-        case 3:
-            vram_read();
-            break;
-        // HBLANK
-        case 0:
-            hblank();
-            break;
-        // VBLANK
-        case 1:
-            vblank();
-            break;
+        check_stat();
+        switch (stat_ & 3) // bit 0-1
+        {
+            // mode 2: scan for OAM sprites
+            case 2:
+                mode_changed = oam_scan();
+                break;
+            // OAM/VRAM read
+            // end of mode 3 = end of scan line
+            case 3:
+                mode_changed = vram_read();
+                break;
+            // HBLANK
+            case 0:
+                mode_changed = hblank();
+                break;
+            // VBLANK
+            case 1:
+                mode_changed = vblank();
+                break;
+        }
+    }
+}
+
+void Ppu::catch_up(uint64_t now)
+{
+    if (now <= synced_)
+        return;
+    const uint64_t cycles {now - synced_};
+    // update first: stepping accesses memory, which would try to catch up the PPU again
+    synced_ = now;
+    step(cycles);
+    schedule_event();
+}
+
+void Ppu::schedule_event()
+{
+    if (!(lcdc_ & 0x80))
+    {
+        next_event_ = std::numeric_limits<uint64_t>::max();
+        return;
+    }
+    // cycles until the end of the current mode
+    static constexpr int MODE_LENGTHS[] {204, 456, 80, 172};
+    int remaining = MODE_LENGTHS[stat_ & 3] - clock_;
+    // Rendering is unaffected by how late it happens, since every register, VRAM and OAM access
+    // catches the PPU up first. So unless a STAT source (bits 3-6) or HDMA needs every mode
+    // change, the next thing that has to happen on time is the VBLANK interrupt.
+    if (!(stat_ & 0x78) && !memory_.hdma_active())
+    {
+        if (ly_ < 144)
+        {
+            // position within the current line
+            int line_clock {clock_};
+            if ((stat_ & 3) == 3)
+                line_clock += 80;
+            else if ((stat_ & 3) == 0)
+                line_clock += 80 + 172;
+            remaining = (144 - ly_) * 456 - line_clock;
+        }
+        else
+        {
+            remaining = (154 - ly_) * 456 - clock_ + 144 * 456;
+        }
     }
+    next_event_ = synced_ + static_cast<uint64_t>(std::max(remaining, 0));
 }
 
 int Ppu::mode() const
@@ -163,9 +224,9 @@ void Ppu::write_reg(uint8_t b, uint16_t adr)
         case 0xff44: ly_ = b; break;
         case 0xff45: lyc_ = b; break;
         // ff46: DMA transfer
-        case 0xff47: bgp_ = b; break;
-        case 0xff48: obp0_ = b; break;
-        case 0xff49: obp1_ = b; break;
+        case 0xff47: bgp_ = b; palettes_changed_ = true; break;
+        case 0xff48: obp0_ = b; palettes_changed_ = true; break;
+        case 0xff49: obp1_ = b; palettes_changed_ = true; break;
         case 0xff4a: wy_ = b; break;
         case 0xff4b: wx_ = b; break;
 
@@ -176,6 +237,7 @@ void Ppu::write_reg(uint8_t b, uint16_t adr)
             // bits 0-5 in bgpi used to index in background palette memory
             // bit 7 enables auto increment after writting
             bgpd_[bgpi_ & 0x3f] = b;
+            palettes_changed_ = true;
             if (bgpi_ & 0x80)
                 ++bgpi_;
         } break;
@@ -185,6 +247,7 @@ void Ppu::write_reg(uint8_t b, uint16_t adr)
             // bits 0-5 in obpi used to index in object palette memory
             // bit 7 enables auto increment after writting
             obpd_[obpi_ & 0x3f] = b;
+            palettes_changed_ = true;
             if (obpi_ & 0x80)
                 ++obpi_;
         } break;
@@ -193,6 +256,8 @@ void Ppu::write_reg(uint8_t b, uint16_t adr)
             throw qtboy::Exception("Attempted to write invalid PPU register.",
                                      __FILE__, __LINE__);
     }
+    // the write may have changed the LCD enable or the STAT interrupt sources
+    schedule_event();
 }
 
 
@@ -201,6 +266,95 @@ void Ppu::set_renderer(Renderer *r)
     renderer_ = r;
 }
 
+void Ppu::set_observation(const Observation_format &f)
+{
+    if (f.width > 160 || f.height > 144)
+        throw std::runtime_error {"Observations can't be larger than the screen"};
+    const bool enabled {f.width != 0 && f.height != 0};
+    observation_format_ = enabled ? f : Observation_format {};
+    observation_.assign(f.width * f.height, 0);
+    observation_back_.assign(f.width * f.height, 0);
+    observation_sums_.assign(f.width, 0);
+    observation_widths_.assign(f.width, 0);
+    observation_samples_.assign(f.width, 0);
+    observing_ = false;
+    if (!enabled)
+        return;
+    // output pixel (i, j) is the box of pixels [i*160/w, (i+1)*160/w) x [j*144/h, (j+1)*144/h)
+    for (unsigned i = 0; i < f.width; ++i)
+    {
+        const unsigned first {i * 160 / f.width}, last {(i + 1) * 160 / f.width};
+        observation_widths_[i] = static_cast<uint8_t>(last - first);
+        observation_samples_[i] = static_cast<uint8_t>(first + (last - first) / 2);
+        for (unsigned x = first; x < last; ++x)
+            observation_column_[x] = static_cast<uint8_t>(i);
+    }
+    for (unsigned j = 0; j < f.height; ++j)
+    {
+        const unsigned first {j * 144 / f.height}, last {(j + 1) * 144 / f.height};
+        for (unsigned y = first; y < last; ++y)
+        {
+            observation_lines_[y] = {static_cast<uint8_t>(j), static_cast<uint8_t>(last - first),
+                                     y == first + (last - first) / 2, y + 1 == last};
+        }
+    }
+}
+
+void Ppu::save_state(State_writer &w) const
+{
+    w.put(clock_);
+    w.put(synced_);
+    w.put(next_event_);
+    w.put(window_line_);
+    w.put(lcdc_);
+    w.put(stat_);
+    w.put(scy_);
+    w.put(scx_);
+    w.put(ly_);
+    w.put(lyc_);
+    w.put(bgp_);
+    w.put(obp0_);
+    w.put(obp1_);
+    w.put(wy_);
+    w.put(wx_);
+    w.put(sprites_);
+    w.put(stat_signal_);
+    w.put(bgpd_);
+    w.put(obpd_);
+    w.put(bgpi_);
+    w.put(obpi_);
+    w.put(cgb_mode_);
+}
+
+void Ppu::load_state(State_reader &r)
+{
+    r.get(clock_);
+    r.get(synced_);
+    r.get(next_event_);
+    r.get(window_line_);
+    r.get(lcdc_);
+    r.get(stat_);
+    r.get(scy_);
+    r.get(scx_);
+    r.get(ly_);
+    r.get(lyc_);
+    r.get(bgp_);
+    r.get(obp0_);
+    r.get(obp1_);
+    r.get(wy_);
+    r.get(wx_);
+    r.get(sprites_);
+    r.get(stat_signal_);
+    r.get(bgpd_);
+    r.get(obpd_);
+    r.get(bgpi_);
+    r.get(obpi_);
+    enable_cgb(r.get<bool>());
+    // a frame already being drawn would only be observed in part
+    frame_start_ = ly_ == 0 && (stat_ & 3) == 2;
+    observing_ = false;
+}
+
 Texture Ppu::get_framebuffer(bool with_bg, bool with_win,
                              bool with_sprites) const
 {
@@ -258,7 +412,10 @@ Texture Ppu::get_layer(Layer l) const
     {
         for (unsigned x = 0; x < 256; ++x)
         {
-            render_layer_pixel(tex, l, x, y, x, y);
+            if (cgb_mode_)
+                render_layer_pixel<Model::Cgb>(tex, l, x, y, x, y);
+            else
+                render_layer_pixel<Model::Dmg>(tex, l, x, y, x, y);
         }
     }
     return tex;
@@ -306,6 +463,7 @@ void Ppu::write_vram(uint8_t b, uint8_t bank, uint16_t adr)
     memory_.vram_write(b, bank, adr);
 }
 
+template <Model M>
 void Ppu::render_scanline()
 {
     Texture tex {160, 1};
@@ -317,24 +475,81 @@ void Ppu::render_scanline()
     }
     else
     {
-        if (lcdc_ & 1 || cgb_mode_) // bg/window enable
+        if (lcdc_ & 1 || M == Model::Cgb) // bg/window enable
         {
-            render_layer_line(tex, Ppu::Layer::Background);
+            render_layer_line<M>(tex, Ppu::Layer::Background);
             if (lcdc_ & 1 << 5) // window display enable
-                render_layer_line(tex, Ppu::Layer::Window);
+                render_layer_line<M>(tex, Ppu::Layer::Window);
         }
         // background and window appear white if lcdc bit 0 is cleared
         else
         {
             Color c(0xffff);
             tex.fill(c);
+            line_source_.fill(BLANK_INDEX);
         }
         if (lcdc_ & 1 << 1) // OBJ display enable
-            render_sprite_line(tex);
+            render_sprite_line<M>(tex);
     }
-    renderer_->draw_texture(tex, 0, ly_);
+    if (renderer_ && video_output_)
+        renderer_->draw_texture(tex, 0, ly_);
+    if (observing_)
+        observe_line();
 }
 
+void Ppu::observe_line()
+{
+    const Observation_line &line {observation_lines_[ly_]};
+    uint8_t *out {observation_back_.data() + line.row * observation_format_.width};
+    if (observation_format_.mode == Observation_mode::Palette_index)
+    {
+        if (line.sampled)
+        {
+            for (size_t i = 0; i < observation_samples_.size(); ++i)
+                out[i] = line_source_[observation_samples_[i]];
+        }
+        return;
+    }
+    if (palettes_changed_)
+        update_luminance();
+    for (unsigned x = 0; x < 160; ++x)
+        observation_sums_[observation_column_[x]] += luminance_[line_source_[x]];
+    if (!line.last)
+        return;
+    for (size_t i = 0; i < observation_sums_.size(); ++i)
+    {
+        const unsigned pixels {static_cast<unsigned>(observation_widths_[i]) * line.height};
+        out[i] = static_cast<uint8_t>(observation_sums_[i] / pixels);
+        observation_sums_[i] = 0;
+    }
+}
+
+void Ppu::update_luminance()
+{
+    for (uint8_t p = 0; p < 16; ++p)
+    {
+        const Palette pal {p < 8 ? get_bg_palette(p) : get_sprite_palette(p - 8)};
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            // Rec. 601 luma of the colour shown on screen
+            const unsigned r = pal[i] >> 10 & 0x1f, g = pal[i] >> 5 & 0x1f, b = pal[i] & 0x1f;
+            const unsigned y {(r * 299 + g * 587 + b * 114) * 255 / (31 * 1000)};
+            luminance_[p * 4 + i] = static_cast<uint8_t>(y);
+        }
+    }
+    luminance_[BLANK_INDEX] = 255;
+    palettes_changed_ = false;
+}
+
+void Ppu::skip_scanline()
+{
+    // the window line counter is the only state drawing changes
+    const bool window_enabled {(lcdc_ & 1 || cgb_mode_) && lcdc_ & 1 << 5};
+    if (window_enabled && ly_ >= wy_ && wx_ >= 7 && wx_ <= 166 && wy_ <= 143)
+        ++window_line_;
+}
+
+template <Model M>
 void Ppu::render_layer_line(Texture &tex, Ppu::Layer layer)
 {
     // don't draw windo if the current line isn't a window line
@@ -364,7 +579,8 @@ void Ppu::render_layer_line(Texture &tex, Ppu::Layer layer)
         uint8_t x = (layer == Ppu::Layer::Background)
                 ? x_px + scx_
                 : x_px - (wx_-7);
-        render_layer_pixel(tex, layer, x, y, x_px, 0);
+        render_layer_pixel<M>(tex, layer, x, y, x_px, 0,
+                              observing_ ? line_source_.data() : nullptr);
         ++window_pxs_drawn;
     }
     if (layer == Ppu::Layer::Window && window_pxs_drawn != 0)
@@ -372,9 +588,10 @@ void Ppu::render_layer_line(Texture &tex, Ppu::Layer layer)
 }
 
 // render the layer pixel at (tex_x,tex_y) with the color at (x, y) in VRAM
+template <Model M>
 void Ppu::render_layer_pixel(Texture &tex, Ppu::Layer layer,
                              uint8_t x, uint8_t y,
-                             uint8_t tex_x, uint8_t tex_y) const
+                             uint8_t tex_x, uint8_t tex_y, uint8_t *source) const
 {
     uint16_t tile_map = 0x9800;
     if (layer == Ppu::Layer::Background)
@@ -396,7 +613,9 @@ void Ppu::render_layer_pixel(Texture &tex, Ppu::Layer layer,
     uint16_t tile_i = (tile_y*32) + tile_x + tile_map;
     // CGB only: corresponding tile attributes held in parallel location
     // in VRAM bank 1
-    uint8_t tile_attr = cgb_mode_ ? read_vram(1, tile_i) : 0;
+    uint8_t tile_attr {0};
+    if constexpr (M == Model::Cgb)
+        tile_attr = read_vram(1, tile_i);
     // index of the tile in tile data of the tile to draw
     uint8_t tile_data_i = read_vram(0, tile_i);
     // bank containing the tile data
@@ -434,7 +653,7 @@ void Ppu::render_layer_pixel(Texture &tex, Ppu::Layer layer,
     // (or last) pixel
     bool hi_bit = (hi_byte & 1 << (7-px_offset));
     bool lo_bit = (lo_byte & 1 << (7-px_offset));
-    Palette pal(get_bg_palette(tile_attr & 7));
+    Palette pal(bg_palette<M>(tile_attr & 7));
     // get pixel color index
     // bit of hi byte is the hi bit of the 2-bit color index in the palette
     // bit of lo byte is the lo bit of the 2-bit color index in the palette
@@ -445,14 +664,17 @@ void Ppu::render_layer_pixel(Texture &tex, Ppu::Layer layer,
     if (tile_attr & 1 << 7) // ensure highest priority
         priority = 0;
     // CGB: when LCDC bit 0 is cleared, sprites always appear above bg/window
-    if (cgb_mode_ && !(lcdc_ & 1))
+    if (M == Model::Cgb && !(lcdc_ & 1))
         priority = 3;
     // index into texture
     unsigned tex_i = tex_x + tex_y * tex.width();
     tex.set_pixel(tex_i, pal[px_i]);
     tex.set_pixel_priority(tex_i, priority);
+    if (source)
+        source[tex_x] = static_cast<uint8_t>((tile_attr & 7) << 2 | px_i);
 }
 
+template <Model M>
 void Ppu::render_sprite_line(Texture &tex)
 {
     const uint16_t tile_data = 0x8000;
@@ -480,7 +702,7 @@ void Ppu::render_sprite_line(Texture &tex)
         ++sprites_drawn;
     }
     // first object in OAM has highest priority, so draw first
-    order_sprites(ordered_sprites);
+    order_sprites<M>(ordered_sprites);
     for (Sprite s : ordered_sprites)
     {
         uint8_t tile_i;
@@ -512,12 +734,12 @@ void Ppu::render_sprite_line(Texture &tex)
         else
             adr += (ln % 8) * 2;
         // CGB Only: attribute bit 3 specifies VRAM bank, otherwise 0
-        uint8_t bank = (cgb_mode_ && s.attr & 1 << 3) ? 1 : 0;
+        uint8_t bank = (M == Model::Cgb && s.attr & 1 << 3) ? 1 : 0;
         uint8_t low_byte = read_vram(bank, adr);
         uint8_t high_byte = read_vram(bank, adr+1);
         // if CGB: palette is in attribute bits 0-2, otherwise bit 4
-        uint8_t pal_idx = (cgb_mode_) ? (s.attr & 7) : (s.attr & 1 << 4);
-        Palette pal = get_sprite_palette(pal_idx);
+        uint8_t pal_idx = (M == Model::Cgb) ? (s.attr & 7) : (s.attr & 1 << 4);
+        Palette pal = sprite_palette<M>(pal_idx);
         bool ob_priority = s.attr & 1 << 7;
         for (uint8_t px = 0; px < 8; ++px)
         {
@@ -536,7 +758,12 @@ void Ppu::render_sprite_line(Texture &tex)
                 bool lo_bit = (low_byte & 1 << (x_flip ? px : 7-px));
                 uint8_t p = static_cast<uint8_t>(hi_bit << 1 | lo_bit);
                 if (p != 0) // only draw if not transparent
+                {
                     tex.set_pixel(x, pal[p]);
+                    // object palettes come after the 8 background ones
+                    const uint8_t obs_pal = (M == Model::Cgb) ? pal_idx : (pal_idx ? 1 : 0);
+                    line_source_[x] = static_cast<uint8_t>((8 + obs_pal) << 2 | p);
+                }
             }
         }
     }
@@ -554,10 +781,11 @@ std::array<Texture, 40> Ppu::get_sprites() const
     return out;
 }
 
+template <Model M>
 void Ppu::order_sprites(std::array<Sprite, 10> &s) const
 {
     // CGB mode: lower OAM # = higher priority
-    if (cgb_mode_)
+    if constexpr (M == Model::Cgb)
     {
         std::reverse(s.begin(), s.end());
     }
@@ -572,10 +800,21 @@ void Ppu::order_sprites(std::array<Sprite, 10> &s) const
 }
 
 Palette Ppu::get_bg_palette(uint8_t idx) const
+{
+    return cgb_mode_ ? bg_palette<Model::Cgb>(idx) : bg_palette<Model::Dmg>(idx);
+}
+
+Palette Ppu::get_sprite_palette(uint8_t idx) const
+{
+    return cgb_mode_ ? sprite_palette<Model::Cgb>(idx) : sprite_palette<Model::Dmg>(idx);
+}
+
+template <Model M>
+Palette Ppu::bg_palette(uint8_t idx) const
 {
     Palette pal {};
     // CGB stores palettes in background palette memoery (bgpm)
-    if (cgb_mode_)
+    if constexpr (M == Model::Cgb)
     {
         uint8_t pal_idx = idx * 8;
         // each palette is 8 bytes long (2 per color)
@@ -597,10 +836,11 @@ Palette Ppu::get_bg_palette(uint8_t idx) const
     return pal;
 }
 
-Palette Ppu::get_sprite_palette(uint8_t idx) const
+template <Model M>
+Palette Ppu::sprite_palette(uint8_t idx) const
 {
     Palette pal {};
-    if (cgb_mode_)
+    if constexpr (M == Model::Cgb)
     {
         uint8_t pal_idx = idx * 8;
         // each palette is 8 bytes long (2 per color)
@@ -697,88 +937,118 @@ Color Ppu::color_correct(const Color &c) const
 void Ppu::load_sprites()
 {
     uint8_t i = 0;
-    for (uint16_t adr = 0xfe00; adr < 0xfea0; adr += 4) // sprites are 4 bytes
+    for (uint8_t adr = 0; adr < 0xa0; adr += 4) // sprites are 4 bytes
     {
-        sprites_[i].y = read(adr);
-        sprites_[i].x = read(adr+1);
-        sprites_[i].tile = read(adr+2);
-        sprites_[i].attr = read(adr+3);
+        sprites_[i].y = memory_.oam_read(adr);
+        sprites_[i].x = memory_.oam_read(adr+1);
+        sprites_[i].tile = memory_.oam_read(adr+2);
+        sprites_[i].attr = memory_.oam_read(adr+3);
         sprites_[i].id = i;
         ++i;
     }
 }
 
 // OAM_SCAN mode 2
-void Ppu::oam_scan()
+bool Ppu::oam_scan()
 {
-    if (clock_ >= 80)
-    {
-        clock_ -= 80;
-        load_sprites();
-        SET_BIT(stat_, 1);
-        SET_BIT(stat_, 0); // mode 3
-    }
+    if (clock_ < 80)
+        return false;
+    clock_ -= 80;
+    load_sprites();
+    SET_BIT(stat_, 1);
+    SET_BIT(stat_, 0); // mode 3
+    return true;
 }
 
 // VRAM_READ mode 3
-void Ppu::vram_read()
+bool Ppu::vram_read()
 {
-    if (clock_ >= 172)
+    if (clock_ < 172)
+        return false;
+    clock_ -= 172;
+    if (frame_start_)
     {
-        clock_ -= 172;
-        if (!renderer_)
-            return;
-        render_scanline();
-        // enter hblank
-        CLEAR_BIT(stat_, 1);
-        CLEAR_BIT(stat_, 0); // mode 0
-        if (cgb_mode_)
-            memory_.hblank_dma();
+        // first line drawn in this frame (line 0 isn't drawn right after the LCD is turned on)
+        frame_start_ = false;
+        // the request stands until a frame is observed in full (the LCD may be turned off
+        // half-way through)
+        observing_ = observation_requested_ && !observation_.empty();
+        if (observing_)
+        {
+            // palettes may have changed through a reset, a loaded state or the options
+            palettes_changed_ = true;
+            std::fill(observation_sums_.begin(), observation_sums_.end(), 0);
+        }
     }
+    if ((renderer_ && video_output_) || observing_)
+    {
+        const Trace_scope probe {"ppu.render_scanline"};
+        (this->*render_scanline_)();
+    }
+    else
+        skip_scanline();
+    // enter hblank
+    CLEAR_BIT(stat_, 1);
+    CLEAR_BIT(stat_, 0); // mode 0
+    if (cgb_mode_)
+        memory_.hblank_dma();
+    return true;
 }
 
 // HBLANK mode 0
-void Ppu::hblank()
+bool Ppu::hblank()
 {
-    if (clock_ >= 204)
+    if (clock_ < 204)
+        return false;
+    clock_ -= 204;
+    ++ly_;
+    if (ly_ == 144)
     {
-        clock_ -= 204;
-        ++ly_;
-        if (ly_ == 144)
+        // enter vblank
+        window_line_ = 0;
+        CLEAR_BIT(stat_, 1); // mode 1
+        SET_BIT(stat_, 0);
+        cpu_.request_interrupt(Processor::Interrupt::VBLANK);
+        ++frames_;
+        frame_start_ = true;
+        if (observing_)
         {
-            // enter vblank
-            window_line_ = 0;
-            CLEAR_BIT(stat_, 1); // mode 1
-            SET_BIT(stat_, 0);
-            cpu_.request_interrupt(Processor::Interrupt::VBLANK);
-            if (!renderer_)
-                return;
-            renderer_->present_screen();
+            // same size, so observation() keeps pointing at the same bytes
+            observation_ = observation_back_;
+            observing_ = false;
+            observation_requested_ = false;
         }
-        else
+        if (renderer_ && video_output_)
         {
-            // enter oam_scan
-            SET_BIT(stat_, 1); // mode 2
-            CLEAR_BIT(stat_, 0);
+            const Trace_scope probe {"ppu.present_screen"};
+            renderer_->present_screen();
+            presented_.fetch_add(1, std::memory_order_relaxed);
         }
     }
+    else
+    {
+        // enter oam_scan
+        SET_BIT(stat_, 1); // mode 2
+        CLEAR_BIT(stat_, 0);
+    }
+    return true;
 }
 
 // VBLANK mode 1
-void Ppu::vblank()
+bool Ppu::vblank()
 {
-    if (clock_ >= 456)
+    if (clock_ < 456)
+        return false;
+    clock_ -= 456;
+    ++ly_;
+    if (ly_ > 153)
     {
-        clock_ -= 456;
-        ++ly_;
-        if (ly_ > 153)
-        {
-            // restart scanning modes
-            SET_BIT(stat_, 1); // mode 2
-            CLEAR_BIT(stat_, 0);
-            ly_ = 0;
-        }
+        // restart scanning modes
+        SET_BIT(stat_, 1); // mode 2
+        CLEAR_BIT(stat_, 0);
+        ly_ = 0;
     }
+    return true;
 }
 
 void Ppu::check_stat()
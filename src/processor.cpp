@@ -1,11 +1,11 @@
 #include <iomanip>
-#include <chrono>
 #include <ctime>
 
 #include "processor.hpp"
 #include "register_pair.hpp"
 #include "instruction_info.hpp"
 #include "exception.hpp"
+#include "state.hpp"
 
 #define B bc_.hi
 #define C bc_.lo
@@ -60,11 +60,6 @@ void Processor::reset(bool force_dmg)
     double_speed_ = false;
 }
 
-void Processor::add_cycles(uint32_t c)
-{
-    cycles_ += c;
-}
-
 std::vector<uint8_t> Processor::next_ops(uint16_t n) const
 {
     std::vector<uint8_t> out {};
@@ -113,16 +108,6 @@ bool Processor::execute_interrupt(Interrupt i)
     stpd_ = false;
     if (!ime_)
         return false; // don't service the interrupt if IME is disabled
-    /*
-    if (i == VBLANK)
-    {
-        static auto last = std::chrono::high_resolution_clock::now();
-        auto now = std::chrono::high_resolution_clock::now();
-        uint64_t frame_time = std::chrono::duration_cast<std::chrono::milliseconds>(now-last).count();
-        std::cout << "Frame time: " << frame_time << "ms\n";
-        last = now;
-    }
-    */
 
     write(pc_.hi, --sp_);
     write(pc_.lo, --sp_);
@@ -811,4 +796,34 @@ Cpu_dump Processor::dump() const noexcept
             {read(pc_), read(pc_+1), read(pc_+2)}};
 }
 
+void Processor::save_state(State_writer &w) const
+{
+    for (const Register_pair *rp : {&af_, &bc_, &de_, &hl_, &sp_, &pc_})
+        w.put(static_cast<uint16_t>(*rp));
+    w.put(cycles_);
+    w.put(stpd_);
+    w.put(hltd_);
+    w.put(use_branch_cycles_);
+    w.put(ime_);
+    w.put(ei_set_);
+    w.put(di_set_);
+    w.put(halt_bug_);
+    w.put(double_speed_);
+}
+
+void Processor::load_state(State_reader &r)
+{
+    for (Register_pair *rp : {&af_, &bc_, &de_, &hl_, &sp_, &pc_})
+        *rp = r.get<uint16_t>();
+    r.get(cycles_);
+    r.get(stpd_);
+    r.get(hltd_);
+    r.get(use_branch_cycles_);
+    r.get(ime_);
+    r.get(ei_set_);
+    r.get(di_set_);
+    r.get(halt_bug_);
+    r.get(double_speed_);
+}
+
 }
@@ -1,4 +1,6 @@
 #include "ram.hpp"
+#include "state.hpp"
+#include "state_hash.hpp"
 
 #include <istream>
 #include <stdexcept>
@@ -12,6 +14,7 @@ template <uint16_t bank_sz>
 Ram<bank_sz>::Ram(uint8_t banks, const std::vector<uint8_t> &sram)
     : data_(banks)
 {
+    mark_all_dirty();
     if (!sram.empty())
         load(sram);
 }
@@ -26,6 +29,21 @@ template <uint16_t bank_sz>
 void Ram<bank_sz>::write(uint8_t b, uint8_t bank, uint16_t adr)
 {
     data_[bank][adr] = b;
+    mark_dirty(bank, adr);
+}
+
+template <uint16_t bank_sz>
+const uint8_t *Ram<bank_sz>::data(uint8_t bank) const
+{
+    return data_[bank].data();
+}
+
+template <uint16_t bank_sz>
+uint8_t *Ram<bank_sz>::data(uint8_t bank, uint16_t adr, uint16_t len)
+{
+    for (uint16_t page = adr / PAGE_SIZE; page * PAGE_SIZE < adr + len; ++page)
+        mark_dirty(bank, page * PAGE_SIZE);
+    return data_[bank].data() + adr;
 }
 
 template<uint16_t bank_sz>
@@ -37,6 +55,7 @@ void Ram<bank_sz>::load(const std::vector<uint8_t> &sram)
         std::copy(sram.begin() + i, sram.begin() + i + bank_sz, b.data());
         i += bank_sz;
     }
+    mark_all_dirty();
 }
 
 template <uint16_t bank_sz>
@@ -61,6 +80,7 @@ template <uint16_t bank_sz>
 void Ram<bank_sz>::resize(uint8_t nbanks)
 {
 	data_.resize(nbanks);
+    mark_all_dirty();
 }
 
 template <uint16_t bank_sz>
@@ -74,6 +94,49 @@ void Ram<bank_sz>::reset()
 {
     for (uint8_t i {0}; i < data_.size(); ++i)
         data_[i] = {};
+    mark_all_dirty();
+}
+
+template <uint16_t bank_sz>
+void Ram<bank_sz>::save_state(State_writer &w) const
+{
+    if (w.digest())
+    {
+        w.put(hash());
+        return;
+    }
+    for (const Bank &b : data_)
+        w.put_bytes(b.data(), bank_sz);
+}
+
+template <uint16_t bank_sz>
+void Ram<bank_sz>::load_state(State_reader &r)
+{
+    for (Bank &b : data_)
+        r.get_bytes(b.data(), bank_sz);
+    mark_all_dirty();
+}
+
+template <uint16_t bank_sz>
+uint64_t Ram<bank_sz>::hash() const
+{
+    for (size_t i {0}; i < dirty_.size(); ++i)
+    {
+        if (dirty_[i])
+        {
+            const uint8_t *page {data_[i / PAGES_PER_BANK].data() + i % PAGES_PER_BANK * PAGE_SIZE};
+            page_hashes_[i] = hash64(page, PAGE_SIZE, i);
+            dirty_[i] = 0;
+        }
+    }
+    return hash64(page_hashes_.data(), page_hashes_.size() * sizeof(uint64_t));
+}
+
+template <uint16_t bank_sz>
+void Ram<bank_sz>::mark_all_dirty()
+{
+    dirty_.assign(data_.size() * PAGES_PER_BANK, 1);
+    page_hashes_.resize(dirty_.size());
 }
 
 template class Ram<0x2000>;
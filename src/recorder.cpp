@@ -0,0 +1,335 @@
+#include "recorder.hpp"
+#include "raw_audio.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+namespace
+{
+
+constexpr uint32_t FPS_NUM {4194304}, FPS_DEN {70224};
+constexpr uint32_t SAMPLE_RATE {65536};
+constexpr uint16_t CHANNELS {2};
+constexpr size_t WAV_HEADER {44};
+
+template <typename T>
+void put(std::ostream &out, T v)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out.put(static_cast<char>(v >> (i * 8)));
+}
+
+void put(std::ostream &out, const char *s)
+{
+    out.write(s, static_cast<std::streamsize>(std::strlen(s)));
+}
+
+std::string wav_path(const std::string &path)
+{
+    const auto dot = path.find_last_of('.');
+    const auto slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ".wav";
+    return path.substr(0, dot) + ".wav";
+}
+
+}
+
+// Records what the APU queues and passes it on to the real speaker.
+class Recorder::Tap : public Speaker
+{
+    public:
+    Tap(Recorder &recorder, std::shared_ptr<Speaker> next)
+        : recorder_ {recorder}, next_ {std::move(next)}
+    {
+        if (next_)
+            toggle(next_->enabled());
+    }
+
+    void queue_samples(const Raw_audio &a) override
+    {
+        recorder_.queue_audio(a);
+        if (next_)
+            next_->queue_samples(a);
+    }
+
+    // without a real speaker, nothing is ever queued, so the APU never drops samples
+    int samples_queued() override { return next_ ? next_->samples_queued() : 0; }
+
+    void clear_samples() override
+    {
+        if (next_)
+            next_->clear_samples();
+    }
+
+    private:
+    Recorder &recorder_;
+    std::shared_ptr<Speaker> next_;
+};
+
+Recorder::Recorder(const std::string &path, const Options &options, Renderer *next,
+                   std::shared_ptr<Speaker> next_speaker)
+    : Frame_tap {next}, options_ {options},
+      speaker_ {std::make_shared<Tap>(*this, std::move(next_speaker))},
+      video_ {path, std::ios::binary}
+{
+    if (!video_)
+        throw std::runtime_error {"Could not create " + path};
+    if (options.format == Format::Y4m_wav)
+    {
+        const std::string audio_path {wav_path(path)};
+        audio_file_.open(audio_path, std::ios::binary);
+        if (!audio_file_)
+            throw std::runtime_error {"Could not create " + audio_path};
+        video_ << "YUV4MPEG2 W" << WIDTH << " H" << HEIGHT << " F" << FPS_NUM << ':' << FPS_DEN
+               << " Ip A1:1 C444\n";
+        // sizes are filled in by finish()
+        put(audio_file_, "RIFF");
+        put(audio_file_, uint32_t {0});
+        put(audio_file_, "WAVEfmt ");
+        put(audio_file_, uint32_t {16});
+        put(audio_file_, uint16_t {1}); // PCM
+        put(audio_file_, CHANNELS);
+        put(audio_file_, SAMPLE_RATE);
+        put(audio_file_, SAMPLE_RATE * CHANNELS); // bytes per second
+        put(audio_file_, CHANNELS); // bytes per sample frame
+        put(audio_file_, uint16_t {8});
+        put(audio_file_, "data");
+        put(audio_file_, uint32_t {0});
+    }
+    else
+    {
+        put(video_, "QBV1");
+        put(video_, static_cast<uint16_t>(WIDTH));
+        put(video_, static_cast<uint16_t>(HEIGHT));
+        put(video_, FPS_NUM);
+        put(video_, FPS_DEN);
+        put(video_, SAMPLE_RATE);
+        put(video_, static_cast<uint8_t>(CHANNELS));
+        put(video_, uint8_t {8});
+    }
+    for (unsigned i = 0; i < SLOTS; ++i)
+        free_.push(static_cast<int16_t>(i));
+    thread_ = std::thread {[this]{ write_loop(); }};
+}
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+Recorder::Format Recorder::format_for(const std::string &path)
+{
+    const std::string ext {".qbv"};
+    if (path.size() >= ext.size()
+        && std::equal(ext.rbegin(), ext.rend(), path.rbegin(),
+                      [](char a, char b)
+                      { return a == std::tolower(static_cast<unsigned char>(b)); }))
+        return Format::Delta;
+    return Format::Y4m_wav;
+}
+
+void Recorder::present_screen()
+{
+    if (!stopped_)
+    {
+        ++frames_;
+        const bool repeat {has_last_ && back_ == last_};
+        if (repeat)
+            ++repeats_;
+        // this is the only thread pushing to filled_, so once there is room it stays
+        while (filled_.size() == filled_.capacity() && options_.lossless && !stopped_)
+            std::this_thread::yield();
+        const bool room {filled_.size() < filled_.capacity()};
+        int16_t slot {REPEAT};
+        if (!repeat && room)
+        {
+            while (!free_.pop(slot) && options_.lossless && !stopped_)
+                std::this_thread::yield();
+            if (slot != REPEAT)
+            {
+                slots_[static_cast<size_t>(slot)] = back_;
+                last_ = back_;
+                has_last_ = true;
+            }
+        }
+        // nothing to repeat before the first frame
+        if (has_last_)
+        {
+            if (room)
+                filled_.push(slot);
+            // recorded as a repeat of last_ instead, or not at all
+            if (!room || (!repeat && slot == REPEAT))
+                ++dropped_;
+        }
+    }
+    Frame_tap::present_screen();
+}
+
+void Recorder::queue_audio(const Raw_audio &a)
+{
+    if (stopped_)
+        return;
+    Audio_chunk chunk {};
+    for (size_t at = 0; at < a.size(); at += chunk.size)
+    {
+        chunk.size = static_cast<uint16_t>(std::min(a.size() - at, chunk.data.size()));
+        std::memcpy(chunk.data.data(), a.data() + at, chunk.size);
+        bool queued {false};
+        while (!(queued = audio_.push(chunk)) && options_.lossless && !stopped_)
+            std::this_thread::yield();
+        if (!queued)
+            audio_dropped_ += chunk.size;
+    }
+}
+
+void Recorder::stop()
+{
+    if (stopped_.exchange(true))
+        return;
+    stop_ = true;
+    thread_.join();
+    finish();
+}
+
+Recorder::Stats Recorder::stats() const
+{
+    return {frames_, repeats_, dropped_, audio_dropped_, bytes_written_, !failed_};
+}
+
+void Recorder::write_loop()
+{
+    while (true)
+    {
+        // whatever was queued before stop() is still written
+        const bool stopping {stop_};
+        bool busy {false};
+        int16_t slot {REPEAT};
+        while (filled_.pop(slot))
+        {
+            write_frame(slot);
+            busy = true;
+        }
+        Audio_chunk chunk {};
+        while (audio_.pop(chunk))
+        {
+            write_audio(chunk);
+            busy = true;
+        }
+        if (stopping)
+            return;
+        if (!busy)
+            std::this_thread::sleep_for(std::chrono::milliseconds {2});
+    }
+}
+
+void Recorder::write_frame(int16_t slot)
+{
+    if (slot == REPEAT)
+    {
+        if (options_.format == Format::Y4m_wav)
+        {
+            write("FRAME\n", 6);
+            write(out_.data(), out_.size());
+        }
+        else
+        {
+            write_record('R', nullptr, 0);
+        }
+        ++written_;
+        return;
+    }
+
+    const Frame &frame {slots_[static_cast<size_t>(slot)]};
+    if (options_.format == Format::Y4m_wav)
+    {
+        // BT.601 studio range, one plane after the other, kept for repeats
+        constexpr size_t N {WIDTH * HEIGHT};
+        out_.resize(N * 3);
+        for (size_t i = 0; i < N; ++i)
+        {
+            auto expand = [](unsigned v) { return static_cast<int>((v << 3) | (v >> 2)); };
+            const unsigned c {frame[i]};
+            const int r {expand((c >> 10) & 0x1f)}, g {expand((c >> 5) & 0x1f)},
+                      b {expand(c & 0x1f)};
+            out_[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            out_[N + i] = static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + 128 + (128 << 8))
+                                               >> 8);
+            out_[2 * N + i] = static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 128
+                                                    + (128 << 8)) >> 8);
+        }
+        write("FRAME\n", 6);
+        write(out_.data(), out_.size());
+    }
+    else
+    {
+        const bool key {written_ >= next_key_};
+        if (key)
+            next_key_ = written_ + KEY_INTERVAL;
+        out_.clear();
+        encoder_.encode(frame.data(), key ? nullptr : prev_.data(), out_);
+        write_record('F', out_.data(), out_.size());
+        prev_ = frame;
+    }
+    ++written_;
+    free_.push(slot);
+}
+
+void Recorder::write_audio(const Audio_chunk &chunk)
+{
+    if (options_.format == Format::Delta)
+    {
+        write_record('A', chunk.data.data(), chunk.size);
+        return;
+    }
+    audio_file_.write(reinterpret_cast<const char *>(chunk.data.data()), chunk.size);
+    audio_size_ += chunk.size;
+    bytes_written_ += chunk.size;
+    if (!audio_file_)
+        failed_ = true;
+}
+
+void Recorder::write_record(char type, const uint8_t *data, size_t size)
+{
+    uint8_t header[5] {static_cast<uint8_t>(type)};
+    for (size_t i = 0; i < 4; ++i)
+        header[1 + i] = static_cast<uint8_t>(size >> (i * 8));
+    write(header, sizeof(header));
+    write(data, size);
+}
+
+void Recorder::write(const void *data, size_t size)
+{
+    video_.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    bytes_written_ += size;
+    if (!video_)
+        failed_ = true;
+}
+
+void Recorder::finish()
+{
+    if (options_.format == Format::Y4m_wav)
+    {
+        // a WAV can't hold more than 4 GB, about 9 hours
+        const auto size = static_cast<uint32_t>(std::min<uint64_t>(audio_size_, 0xffffffff
+                                                                                - WAV_HEADER));
+        audio_file_.seekp(4);
+        put(audio_file_, static_cast<uint32_t>(size + WAV_HEADER - 8));
+        audio_file_.seekp(WAV_HEADER - 4);
+        put(audio_file_, size);
+        audio_file_.close();
+        if (!audio_file_)
+            failed_ = true;
+    }
+    video_.close();
+    if (!video_)
+        failed_ = true;
+}
+
+}
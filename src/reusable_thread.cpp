@@ -1,7 +1,5 @@
 #include "reusable_thread.hpp"
 
-#include <iostream>
-
 Reusable_thread::Reusable_thread()
     : Reusable_thread(std::function<void()>())
 {}
@@ -9,37 +7,54 @@ Reusable_thread::Reusable_thread()
 Reusable_thread::Reusable_thread(std::function<void()> fn)
     : callback_ {std::move(fn)}
 {
-    has_work_ = false;
     // start thread
     thread_ = std::thread([this]
     {
+        std::unique_lock<std::mutex> lock(mutex_);
         while (true)
         {
-            while (!has_work_)
-            {
-                if (exiting_)
-                    return;
-            }
-            // scope for lock guard
-            {
-                const std::lock_guard<std::mutex> lock(callback_mutex_);
-                if (callback_)
-                    callback_();
-            }
+            cv_.wait(lock, [this]{ return has_work_ || exiting_; });
+            if (!has_work_)
+                return;
+            // run the task without holding the lock so wait() can block on it
+            lock.unlock();
+            if (callback_)
+                callback_();
+            lock.lock();
             has_work_ = false;
+            cv_.notify_all();
         }
     });
 }
 
+Reusable_thread::~Reusable_thread()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exiting_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
 void Reusable_thread::set_task(std::function<void()> fn)
 {
-    const std::lock_guard<std::mutex> lock(callback_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return !has_work_; });
     callback_ = std::move(fn);
 }
 
 void Reusable_thread::queue()
 {
-    has_work_ = true;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        has_work_ = true;
+    }
+    cv_.notify_all();
 }
 
-
+void Reusable_thread::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return !has_work_; });
+}
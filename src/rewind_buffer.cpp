@@ -0,0 +1,217 @@
+#include "rewind_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace qtboy
+{
+
+// Delta encoding: a series of tokens, each made of a 16-bit count of zero bytes to skip, a 16-bit
+// count of literal bytes and the literal bytes themselves. A literal run only ends at 4 or more
+// zeros, so a token never takes more space than the bytes it covers (besides its header).
+static constexpr std::size_t MAX_RUN {0xffff};
+static constexpr std::size_t MIN_ZERO_RUN {4};
+
+static constexpr double FRAMES_PER_SECOND {4194304.0 / 70224};
+
+Rewind_buffer::Rewind_buffer(std::size_t state_size, std::size_t budget,
+                             unsigned frames_per_snapshot)
+    : state_size_ {state_size},
+      frames_per_snapshot_ {frames_per_snapshot},
+      staging_(state_size),
+      latest_(state_size),
+      delta_(state_size),
+      scratch_(state_size + 4 * (state_size / MAX_RUN + 2)),
+      ring_(budget)
+{
+    worker_ = std::thread([this]{ work(); });
+}
+
+Rewind_buffer::~Rewind_buffer()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+uint8_t *Rewind_buffer::staging()
+{
+    return staged_ ? nullptr : staging_.data();
+}
+
+void Rewind_buffer::commit()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        staged_ = true;
+    }
+    cv_.notify_one();
+}
+
+bool Rewind_buffer::pop(uint8_t *out)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    // take in a state the worker hasn't gotten to yet so it isn't lost
+    if (staged_)
+    {
+        push_delta();
+        staged_ = false;
+    }
+    if (!have_latest_)
+        return false;
+    std::memcpy(out, latest_.data(), state_size_);
+    if (entries_.empty())
+    {
+        have_latest_ = false;
+        return true;
+    }
+    // step latest_ back to the state before it
+    const Entry e {entries_.back()};
+    entries_.pop_back();
+    apply_delta(ring_.data() + e.offset, e.size, latest_.data());
+    raw_bytes_ -= state_size_;
+    packed_bytes_ -= e.size;
+    return true;
+}
+
+void Rewind_buffer::clear()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    have_latest_ = false;
+    staged_ = false;
+    raw_bytes_ = 0;
+    packed_bytes_ = 0;
+}
+
+Rewind_buffer::Stats Rewind_buffer::stats() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    Stats s {};
+    s.snapshots = entries_.size() + (have_latest_ ? 1 : 0);
+    s.bytes_used = packed_bytes_;
+    s.compression_ratio = packed_bytes_ ? static_cast<double>(raw_bytes_) / packed_bytes_ : 0;
+    s.seconds = s.snapshots * frames_per_snapshot_ / FRAMES_PER_SECOND;
+    return s;
+}
+
+void Rewind_buffer::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        cv_.wait(lock, [this]{ return staged_ || exit_; });
+        if (exit_)
+            return;
+        push_delta();
+        staged_ = false;
+    }
+}
+
+void Rewind_buffer::push_delta()
+{
+    if (have_latest_)
+    {
+        // delta that takes staging_ back to latest_
+        for (std::size_t i {0}; i < state_size_; ++i)
+            delta_[i] = latest_[i] ^ staging_[i];
+        store(compress());
+    }
+    std::swap(latest_, staging_);
+    have_latest_ = true;
+}
+
+void Rewind_buffer::store(std::size_t n)
+{
+    if (n > ring_.size())
+    {
+        // can't keep anything older than the latest state
+        entries_.clear();
+        raw_bytes_ = 0;
+        packed_bytes_ = 0;
+        return;
+    }
+    auto evict_oldest = [this]
+    {
+        raw_bytes_ -= state_size_;
+        packed_bytes_ -= entries_.front().size;
+        entries_.pop_front();
+    };
+    std::size_t offset {entries_.empty() ? 0 : entries_.back().offset + entries_.back().size};
+    if (offset + n > ring_.size())
+    {
+        // the oldest entries are in the tail of the ring that is skipped
+        while (!entries_.empty() && entries_.front().offset >= offset)
+            evict_oldest();
+        offset = 0;
+    }
+    // the oldest entries are the ones right after the write position
+    while (!entries_.empty() && entries_.front().offset < offset + n
+           && offset < entries_.front().offset + entries_.front().size)
+        evict_oldest();
+    std::memcpy(ring_.data() + offset, scratch_.data(), n);
+    entries_.push_back({offset, n});
+    raw_bytes_ += state_size_;
+    packed_bytes_ += n;
+}
+
+std::size_t Rewind_buffer::compress()
+{
+    std::size_t in {0}, out {0};
+    auto put16 = [this, &out](std::size_t v)
+    {
+        scratch_[out++] = static_cast<uint8_t>(v & 0xff);
+        scratch_[out++] = static_cast<uint8_t>(v >> 8);
+    };
+    while (in < state_size_)
+    {
+        std::size_t zeros {0};
+        while (in + zeros < state_size_ && zeros < MAX_RUN && delta_[in + zeros] == 0)
+            ++zeros;
+        in += zeros;
+
+        // literals run until MIN_ZERO_RUN zeros in a row (which are left for the next token)
+        std::size_t lits {0}, zero_run {0};
+        while (in + lits < state_size_ && lits < MAX_RUN)
+        {
+            zero_run = (delta_[in + lits] == 0) ? zero_run + 1 : 0;
+            ++lits;
+            if (zero_run == MIN_ZERO_RUN)
+            {
+                lits -= MIN_ZERO_RUN;
+                break;
+            }
+        }
+        put16(zeros);
+        put16(lits);
+        std::memcpy(scratch_.data() + out, delta_.data() + in, lits);
+        out += lits;
+        in += lits;
+    }
+    return out;
+}
+
+void Rewind_buffer::apply_delta(const uint8_t *src, std::size_t n, uint8_t *state) const
+{
+    std::size_t in {0}, pos {0};
+    auto get16 = [src, &in]
+    {
+        const std::size_t v = src[in] | src[in + 1] << 8;
+        in += 2;
+        return v;
+    };
+    while (in < n)
+    {
+        pos += get16();
+        const std::size_t lits {get16()};
+        for (std::size_t i {0}; i < lits; ++i)
+            state[pos + i] ^= src[in + i];
+        in += lits;
+        pos += lits;
+    }
+}
+
+}
@@ -1,8 +1,18 @@
 #include "rom.hpp"
+#include "state_hash.hpp"
 
 #include <istream>
+#include <fstream>
 #include <stdexcept>
 #include <iomanip>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace qtboy
 {
@@ -11,32 +21,86 @@ Rom::Rom(std::istream &is)
 {
 	if (!is.good())
         throw std::runtime_error {"ROM: Invalid input stream!\n"};
-    Bank buf {};
-	while (is.read(reinterpret_cast<char *>(buf.data()), buf.size()))
-        data_.push_back(buf);
+    load(is);
+}
+
+Rom::~Rom()
+{
+#ifndef _WIN32
+    if (map_)
+        munmap(map_, map_size_);
+#endif
+}
+
+void Rom::load(std::istream &is)
+{
+    buffer_.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    // a trailing partial bank still holds code or data; pad it like open bus
+    banks_ = (buffer_.size() + Bank_size - 1) / Bank_size;
+    buffer_.resize(banks_ * Bank_size, 0xff);
+    data_ = buffer_.data();
+}
+
+std::shared_ptr<const Rom> Rom::open(const std::string &path)
+{
+    auto rom = std::shared_ptr<Rom>(new Rom());
+#ifndef _WIN32
+    const int fd {::open(path.c_str(), O_RDONLY)};
+    if (fd < 0)
+        return nullptr;
+    struct stat st {};
+    void *p {MAP_FAILED};
+    // only whole banks are mapped: reading past the end of the file would fault
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size % Bank_size == 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p != MAP_FAILED)
+    {
+        rom->map_ = p;
+        rom->map_size_ = st.st_size;
+        rom->data_ = static_cast<const uint8_t *>(p);
+        rom->banks_ = st.st_size / Bank_size;
+        // bank 0 (with the header) is read right away; the other banks are paged in when the
+        // game switches to them
+        madvise(p, Bank_size, MADV_WILLNEED);
+        return rom;
+    }
+#endif
+    std::ifstream is {path, std::ios::binary};
+    if (!is.good())
+        return nullptr;
+    rom->load(is);
+    return rom;
 }
 
-uint8_t Rom::read(uint8_t bank, uint16_t adr) const
+uint8_t Rom::read(uint16_t bank, uint16_t adr) const
 {
-	if (bank > data_.size() || adr > data_[0].size())
+	if (bank >= banks_ || adr >= Bank_size)
 		throw std::out_of_range {"Invalid ROM address"};
-	return data_[bank][adr];
+	return data_[bank * Bank_size + adr];
 }
 	
-std::vector<uint8_t> Rom::dump(uint8_t bank) const
+std::vector<uint8_t> Rom::dump(uint16_t bank) const
 {
-    if (bank > data_.size())
+    if (bank >= banks_)
         throw std::out_of_range {"Invalid bank selection"};
-    return std::vector<uint8_t>(data_[bank].begin(), data_[bank].end());
+    const uint8_t *b {data_ + bank * Bank_size};
+    return std::vector<uint8_t>(b, b + Bank_size);
+}
+
+size_t Rom::size() const
+{
+    return banks_ * Bank_size;
+}
+
+uint64_t Rom::hash() const
+{
+    return hash64(data_, size());
 }
 
 std::vector<uint8_t> Rom::dump() const
 {
-    std::vector<uint8_t> out {};
-    out.reserve(data_.size() * data_[0].size());
-    for (size_t bank {0}; bank < data_.size(); ++bank)
-        out.insert(out.end(), data_[bank].begin(), data_[bank].end());
-    return out;
+    return std::vector<uint8_t>(data_, data_ + size());
 }
 	
 }
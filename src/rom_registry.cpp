@@ -0,0 +1,56 @@
+#include "rom_registry.hpp"
+
+namespace qtboy
+{
+
+namespace fs = std::filesystem;
+
+Rom_registry &Rom_registry::instance()
+{
+    static Rom_registry registry;
+    return registry;
+}
+
+std::shared_ptr<const Rom> Rom_registry::load(const std::string &path)
+{
+    std::error_code ec;
+    const fs::path canonical {fs::canonical(path, ec)};
+    if (ec)
+        return nullptr;
+    const auto mtime = fs::last_write_time(canonical, ec);
+    const auto size = fs::file_size(canonical, ec);
+    if (ec)
+        return nullptr;
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    // drop images nobody uses anymore
+    for (auto it = entries_.begin(); it != entries_.end();)
+        it = it->second.rom.expired() ? entries_.erase(it) : std::next(it);
+
+    Entry &e {entries_[canonical.string()]};
+    if (auto rom = e.rom.lock(); rom && e.mtime == mtime && e.size == size)
+        return rom;
+    auto rom = Rom::open(canonical.string());
+    if (!rom)
+    {
+        entries_.erase(canonical.string());
+        return nullptr;
+    }
+    e = {rom, mtime, size};
+    return rom;
+}
+
+std::vector<Rom_registry::Image_usage> Rom_registry::images() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Image_usage> out {};
+    for (const auto &[path, e] : entries_)
+    {
+        if (auto rom = e.rom.lock())
+            // the shared_ptr taken here isn't a user
+            out.push_back({path, rom->size(), rom.use_count() - 1});
+    }
+    return out;
+}
+
+}
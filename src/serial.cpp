@@ -0,0 +1,152 @@
+#include "serial.hpp"
+#include "processor.hpp"
+#include "state.hpp"
+
+namespace qtboy
+{
+
+Serial::Serial(Processor &p)
+    : cpu_ {p}
+{}
+
+void Serial::update()
+{
+    const uint64_t now {cpu_.cycles()};
+    if (now >= transfer_end_)
+    {
+        transfer_end_ = NEVER;
+        if (link_)
+            master_done_ = true; // the byte coming in is known at the next sync
+        else
+            complete(0xff);
+    }
+    if (now >= sync_at_)
+        sync();
+    schedule();
+}
+
+void Serial::complete(uint8_t in)
+{
+    sb_ = in;
+    sc_ &= 0x7f;
+    transfer_end_ = NEVER;
+    cpu_.request_interrupt(Processor::SERIAL);
+}
+
+void Serial::sync()
+{
+    const Link_message ours {sb_, master_done_, (sc_ & 0x81) == 0x80, (sc_ & 0x80) != 0};
+    Link_message theirs {};
+    if (!link_->sync(ours, theirs))
+    {
+        // interrupted (the emulation is being stopped): meet again at the next update()
+        if (link_->connected())
+            return;
+        // unplugged: continue as if there was never a cable
+        link_.reset();
+        sync_at_ = NEVER;
+        if (master_done_)
+        {
+            master_done_ = false;
+            complete(0xff);
+        }
+        return;
+    }
+    // both ends do this with the same two messages
+    if (master_done_)
+    {
+        master_done_ = false;
+        complete(theirs.sb);
+    }
+    else if (ours.slave_ready && theirs.master_done)
+    {
+        complete(theirs.sb);
+    }
+    sync_at_ += (ours.busy || theirs.busy) ? active_window_ : idle_window_;
+}
+
+uint8_t Serial::read(uint16_t adr) const
+{
+    if (adr == 0xff01)
+        return sb_;
+    // unused bits read as 1
+    return sc_ | (cgb_ ? 0x7c : 0x7e);
+}
+
+void Serial::write(uint8_t b, uint16_t adr)
+{
+    if (adr == 0xff01)
+    {
+        sb_ = b;
+        return;
+    }
+    sc_ = b & (cgb_ ? 0x83 : 0x81);
+    master_done_ = false;
+    transfer_end_ = NEVER;
+    if ((sc_ & 0x81) == 0x81)
+    {
+        // 8 bits at 8192 Hz, or 262144 Hz with the CGB's fast clock (both double in double
+        // speed mode, like the CPU clock)
+        const uint64_t cycles_per_bit {(sc_ & 2) ? 16u : 512u};
+        transfer_end_ = cpu_.cycles() + 8 * cycles_per_bit;
+    }
+    schedule();
+}
+
+void Serial::set_link(std::shared_ptr<Link_cable> link)
+{
+    if (link_)
+        link_->disconnect();
+    link_ = std::move(link);
+    sync_at_ = link_ ? cpu_.cycles() + idle_window_ : NEVER;
+    if (!link_ && master_done_)
+    {
+        master_done_ = false;
+        complete(0xff);
+    }
+    schedule();
+}
+
+void Serial::set_sync_window(uint32_t active, uint32_t idle)
+{
+    active_window_ = active ? active : 1;
+    idle_window_ = idle ? idle : 1;
+}
+
+void Serial::reset()
+{
+    sb_ = 0;
+    sc_ = 0;
+    transfer_end_ = NEVER;
+    master_done_ = false;
+    if (link_)
+        sync_at_ = cpu_.cycles() + idle_window_;
+    schedule();
+}
+
+void Serial::save_state(State_writer &w) const
+{
+    w.put(sb_);
+    w.put(sc_);
+    w.put(transfer_end_);
+    w.put(master_done_);
+}
+
+void Serial::load_state(State_reader &r)
+{
+    r.get(sb_);
+    r.get(sc_);
+    r.get(transfer_end_);
+    r.get(master_done_);
+    // the cable (and when it next syncs) isn't part of the machine state
+    if (link_)
+        sync_at_ = cpu_.cycles() + idle_window_;
+    else if (master_done_)
+    {
+        master_done_ = false;
+        complete(0xff);
+    }
+    schedule();
+}
+
+}
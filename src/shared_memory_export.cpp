@@ -0,0 +1,110 @@
+#include "shared_memory_export.hpp"
+#include "qtboy_shm.h"
+#include "system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace qtboy
+{
+
+#ifdef _WIN32
+
+Shared_memory_export::Shared_memory_export(const std::string &name, const Gameboy &gb,
+                                           Renderer *next)
+    : Frame_tap {next}, name_ {name}, gb_ {gb}
+{
+    throw std::runtime_error {"Shared memory export needs POSIX shm_open()"};
+}
+
+Shared_memory_export::~Shared_memory_export() = default;
+
+void Shared_memory_export::present_screen() {}
+
+#else
+
+namespace
+{
+
+[[noreturn]] void fail(const std::string &what, const std::string &name)
+{
+    throw std::runtime_error {what + " shared memory " + name + ": " + std::strerror(errno)};
+}
+
+}
+
+Shared_memory_export::Shared_memory_export(const std::string &name, const Gameboy &gb,
+                                           Renderer *next)
+    : Frame_tap {next}, name_ {name}, gb_ {gb}
+{
+    const int fd {shm_open(name.c_str(), O_CREAT | O_RDWR, 0644)};
+    if (fd < 0)
+        fail("Could not open", name);
+    if (ftruncate(fd, sizeof(qtboy_shm)) != 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+        fail("Could not size", name);
+    }
+    void *p {mmap(nullptr, sizeof(qtboy_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+    close(fd); // the mapping keeps the region open
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        fail("Could not map", name);
+    }
+    shm_ = static_cast<qtboy_shm *>(p);
+
+    // a reader of a previous run may still be looking: take the region down while it is set up
+    __atomic_store_n(&shm_->magic, 0, __ATOMIC_RELEASE);
+    shm_->version = QTBOY_SHM_VERSION;
+    shm_->width = QTBOY_SHM_WIDTH;
+    shm_->height = QTBOY_SHM_HEIGHT;
+    shm_->wram_size = 0;
+    shm_->hram_size = 0;
+    shm_->frame = 0;
+    __atomic_store_n(&shm_->seq, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm_->magic, QTBOY_SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+Shared_memory_export::~Shared_memory_export()
+{
+    munmap(shm_, sizeof(qtboy_shm));
+    shm_unlink(name_.c_str());
+}
+
+void Shared_memory_export::present_screen()
+{
+    size_t wram_size {0}, hram_size {0};
+    const uint8_t *wram {gb_.work_ram(wram_size)};
+    const uint8_t *hram {gb_.high_ram(hram_size)};
+    wram_size = std::min<size_t>(wram_size, QTBOY_SHM_WRAM_MAX);
+    hram_size = std::min<size_t>(hram_size, QTBOY_SHM_HRAM_MAX);
+
+    // seqlock write: odd while the data changes, and the data only becomes visible in between
+    const uint64_t seq {shm_->seq};
+    __atomic_store_n(&shm_->seq, seq + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(shm_->pixels, back_.data(), sizeof(shm_->pixels));
+    std::memcpy(shm_->wram, wram, wram_size);
+    std::memcpy(shm_->hram, hram, hram_size);
+    shm_->wram_size = static_cast<uint32_t>(wram_size);
+    shm_->hram_size = static_cast<uint32_t>(hram_size);
+    ++shm_->frame;
+    __atomic_store_n(&shm_->seq, seq + 2, __ATOMIC_RELEASE);
+
+    Frame_tap::present_screen();
+}
+
+#endif
+
+}
@@ -0,0 +1,73 @@
+#include "socket.hpp"
+
+#include <cerrno>
+#include <mutex>
+#include <stdexcept>
+
+namespace qtboy
+{
+
+void close_socket(Socket s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+bool set_nonblocking(Socket s)
+{
+#ifdef _WIN32
+    u_long nonblocking {1};
+    return ioctlsocket(s, FIONBIO, &nonblocking) == 0;
+#else
+    const int flags {fcntl(s, F_GETFL)};
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool would_block()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+#ifdef _WIN32
+namespace
+{
+
+// Winsock is started by the first Socket_library and cleaned up with the last one.
+std::mutex library_mutex;
+unsigned library_users {0};
+
+}
+#endif
+
+Socket_library::Socket_library()
+{
+#ifdef _WIN32
+    const std::lock_guard<std::mutex> lock(library_mutex);
+    if (library_users == 0)
+    {
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+            throw std::runtime_error {"Could not initialize Winsock"};
+    }
+    ++library_users;
+#endif
+}
+
+Socket_library::~Socket_library()
+{
+#ifdef _WIN32
+    const std::lock_guard<std::mutex> lock(library_mutex);
+    if (--library_users == 0)
+        WSACleanup();
+#endif
+}
+
+}
@@ -1,4 +1,5 @@
 #include "square_channel.hpp"
+#include "state.hpp"
 #include <cstdint>
 
 using namespace qtboy;
@@ -163,3 +164,43 @@ void Square_channel::restart_sound()
         // check for overflow
         new_sweep_freq();
 }
+
+void Square_channel::save_state(State_writer &w) const
+{
+    w.put(sweep_);
+    w.put(length_);
+    w.put(envelope_);
+    w.put(freq_lo_);
+    w.put(freq_hi_);
+    w.put(volume_);
+    w.put(output_);
+    w.put(duty_ptr_);
+    w.put(timer_);
+    w.put(length_timer_);
+    w.put(envelope_timer_);
+    w.put(sweep_timer_);
+    w.put(sweep_shadow_);
+    w.put(sweep_enable_);
+    w.put(envelope_running_);
+    w.put(enabled_);
+}
+
+void Square_channel::load_state(State_reader &r)
+{
+    r.get(sweep_);
+    r.get(length_);
+    r.get(envelope_);
+    r.get(freq_lo_);
+    r.get(freq_hi_);
+    r.get(volume_);
+    r.get(output_);
+    r.get(duty_ptr_);
+    r.get(timer_);
+    r.get(length_timer_);
+    r.get(envelope_timer_);
+    r.get(sweep_timer_);
+    r.get(sweep_shadow_);
+    r.get(sweep_enable_);
+    r.get(envelope_running_);
+    r.get(enabled_);
+}
@@ -0,0 +1,52 @@
+#include "state_hash.hpp"
+
+#include <stdexcept>
+
+namespace qtboy
+{
+
+static constexpr char HASH_STREAM_MAGIC[8] {'Q', 'B', 'H', 'A', 'S', 'H', '0', '1'};
+
+Hash_recorder::Hash_recorder(const std::string &path)
+    : out_ {path, std::ios::binary | std::ios::trunc}
+{
+    if (!out_.good())
+        throw std::runtime_error {"Could not open " + path + " for writing"};
+    out_.write(HASH_STREAM_MAGIC, sizeof(HASH_STREAM_MAGIC));
+}
+
+void Hash_recorder::record(uint64_t hash)
+{
+    uint8_t bytes[8];
+    for (int i {0}; i < 8; ++i)
+        bytes[i] = static_cast<uint8_t>(hash >> (8 * i));
+    out_.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    ++frames_;
+}
+
+static std::ifstream open_stream(const std::string &path)
+{
+    std::ifstream in {path, std::ios::binary};
+    char magic[sizeof(HASH_STREAM_MAGIC)] {};
+    if (!in.read(magic, sizeof(magic))
+        || std::memcmp(magic, HASH_STREAM_MAGIC, sizeof(magic)) != 0)
+        throw std::runtime_error {path + " is not a state hash stream"};
+    return in;
+}
+
+std::optional<uint64_t> first_divergence(const std::string &path_a, const std::string &path_b)
+{
+    std::ifstream a {open_stream(path_a)}, b {open_stream(path_b)};
+    char ha[8], hb[8];
+    for (uint64_t frame {0};; ++frame)
+    {
+        const bool more_a {static_cast<bool>(a.read(ha, sizeof(ha)))};
+        const bool more_b {static_cast<bool>(b.read(hb, sizeof(hb)))};
+        if (!more_a && !more_b)
+            return std::nullopt;
+        if (more_a != more_b || std::memcmp(ha, hb, sizeof(ha)) != 0)
+            return frame;
+    }
+}
+
+}
@@ -6,13 +6,17 @@
 #include <map>
 #include <thread>
 #include <chrono>
+#include <ctime>
 #include <memory>
 
 #include "system.hpp"
 #include "exception.hpp"
 #include "disassembler.hpp"
-
-#include <SDL.h>
+#include "state.hpp"
+#include "rom_registry.hpp"
+#include "state_hash.hpp"
+#include "movie.hpp"
+#include "trace.hpp"
 
 using std::chrono::duration_cast;
 using std::chrono::nanoseconds;
@@ -20,16 +24,61 @@ using std::chrono::nanoseconds;
 namespace qtboy
 {
 
+// Adds the time since the previous lap to a total, if it was started. The cost of reading
+// the clock is taken out, since it is about as long as a whole CPU instruction.
+class Stopwatch
+{
+    public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Stopwatch(bool on)
+        : on_ {on}
+    {
+        if (on_)
+            last_ = Clock::now();
+    }
+
+    void lap(nanoseconds &total)
+    {
+        if (!on_)
+            return;
+        const auto now = Clock::now();
+        const nanoseconds t {now - last_};
+        if (t > clock_cost())
+            total += t - clock_cost();
+        last_ = now;
+    }
+
+    private:
+    static nanoseconds clock_cost()
+    {
+        static const nanoseconds cost {[]
+        {
+            constexpr int READS {1000};
+            const auto start = Clock::now();
+            for (int i = 0; i < READS; ++i)
+                Clock::now();
+            return duration_cast<nanoseconds>(Clock::now() - start) / READS;
+        }()};
+        return cost;
+    }
+
+    bool on_;
+    Clock::time_point last_ {};
+};
+
 Gameboy::Gameboy()
 {}
 
 Gameboy::~Gameboy()
 {
     stop();
+    // so that the other end doesn't wait for this one forever
+    set_link(nullptr);
     // save data on close
     std::vector<uint8_t> sram(memory_.dump_sram());
     // only save data if any save data was modified
-    if (!memory_.sram_changed())
+    if (secondary_ || save_dir_.empty() || !memory_.sram_changed())
         return;
     try
     {
@@ -53,24 +102,122 @@ std::string stem(const std::string &path)
 
 bool Gameboy::load_cartridge(const std::string &path)
 {
-    std::ifstream rom {path, std::ios::binary};
-    if (!rom.good())
+    // instances loading the same file share one image of it
+    auto rom = Rom_registry::instance().load(path);
+    if (!rom)
         return false;
     rom_title_ = stem(path);
+    rom_path_ = path;
+    insert_rom(std::move(rom));
+    return true;
+}
+
+void Gameboy::insert_rom(std::shared_ptr<const Rom> rom)
+{
     // load the ROM into a cartridge in memory
-    Cartridge *cart {memory_.load_cartridge(rom)};
+    Cartridge *cart {memory_.load_cartridge(std::move(rom))};
+    // the hardware model is chosen once here; it selects the specialized memory and
+    // rendering paths
     cgb_mode_ = (cart->is_cgb() && !force_dmg_);
     ppu_.enable_cgb(cgb_mode_);
     memory_.enable_cgb(cgb_mode_);
-    memory_.load_save(save_dir_ + "/" + rom_title_ + ".sav");
+    serial_.enable_cgb(cgb_mode_);
+    if (!save_dir_.empty())
+        memory_.load_save(save_dir_ + "/" + rom_title_ + ".sav");
     rom_loaded_ = true;
-    return true;
+    // the size of a state only depends on the cartridge, so it only has to be counted once
+    State_writer counter {};
+    write_state(counter);
+    state_size_ = counter.size();
+    create_rewind_buffer();
+    run_ahead_state_.resize(state_size_);
+    if (run_ahead_ && run_ahead_worker_)
+        create_run_ahead_instance();
+}
+
+std::unique_ptr<Gameboy> Gameboy::make_sibling() const
+{
+    auto gb = std::make_unique<Gameboy>();
+    gb->secondary_ = true;
+    gb->force_dmg_ = force_dmg_;
+    gb->catch_up_ = catch_up_;
+    gb->save_dir_ = save_dir_;
+    gb->rom_title_ = rom_title_;
+    gb->rom_path_ = rom_path_;
+    gb->insert_rom(memory_.rom());
+    return gb;
+}
+
+uint64_t Gameboy::state_hash()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return hash_state();
+}
+
+uint64_t Gameboy::hash_state()
+{
+    // the digest stream has the same layout as a save state, with each RAM replaced by the
+    // hash of its pages, so it is never larger than a state
+    if (hash_buf_.size() < state_size_)
+        hash_buf_.resize(state_size_);
+    State_writer w {hash_buf_.data(), hash_buf_.size()};
+    w.set_digest(true);
+    write_state(w);
+    return hash64(hash_buf_.data(), w.size());
+}
+
+void Gameboy::set_hash_recording(const std::string &path)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    hash_recorder_.reset();
+    if (!path.empty())
+        hash_recorder_ = std::make_unique<Hash_recorder>(path);
+}
+
+Gameboy::Memory_usage Gameboy::memory_usage() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    Memory_usage u {};
+    // everything mutable in the machine is in a save state
+    u.private_bytes = sizeof(Gameboy) + state_size_;
+    if (rewind_)
+        u.private_bytes += rewind_budget_ + 4 * state_size_ + rewind_state_.size();
+    u.private_bytes += run_ahead_state_.size() + clone_state_.size();
+    if (ahead_)
+        u.private_bytes += ahead_->memory_usage().private_bytes;
+    if (auto rom = memory_.rom())
+    {
+        u.rom_bytes = rom->size();
+        // the one taken here doesn't count
+        u.rom_users = rom.use_count() - 1;
+    }
+    return u;
+}
+
+std::unique_ptr<Gameboy> Gameboy::clone()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!rom_loaded_)
+        throw std::runtime_error {"Cannot clone a Gameboy with no ROM loaded"};
+    auto gb = make_sibling();
+    gb->apu_.set_audio_output(false);
+    clone_state_.resize(state_size_);
+    State_writer w {clone_state_.data(), state_size_};
+    write_state(w);
+    State_reader r {clone_state_.data(), state_size_};
+    gb->read_state(r);
+    return gb;
 }
 
 void Gameboy::set_renderer(Renderer *r)
 {
     const std::lock_guard<std::mutex> lock(mutex_);
     ppu_.set_renderer(r);
+    if (ahead_)
+    {
+        ahead_thread_->wait();
+        ahead_->ppu_.set_renderer(r);
+    }
 }
 
 void Gameboy::set_speaker(std::shared_ptr<Speaker> s)
@@ -81,6 +228,7 @@ void Gameboy::set_speaker(std::shared_ptr<Speaker> s)
 
 void Gameboy::run()
 {
+    Trace::set_thread_name("emulation");
     emu_paused_ = false;
     emu_stop_ = false;
     while (!emu_stop_)
@@ -89,17 +237,60 @@ void Gameboy::run()
         // wait until the emulator is unpaused
         pause_cv_.wait(lock, [this]{ return !emu_paused_; });
         // only run the CPU when samples are needed => wait if enough samples are already queued
+        Stopwatch sync {metrics_};
         while (apu_.samples_queued() > Apu::SAMPLE_SIZE*4 && throttle_)
         {
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
+        sync.lap(metrics_window_.sync);
 
-        // run the CPU for 1 frame (70224 cycles)
-        execute(70224);
+        const uint64_t presented {metrics_ ? presented_frames() : 0};
+        emulate_frame();
+        if (metrics_)
+            update_metrics(presented);
     }
     emu_paused_ = true;
 }
 
+void Gameboy::emulate_frame()
+{
+    if (movie_state_ != Movie_state::None)
+        movie_frame();
+    if (run_ahead_)
+        run_ahead_frame();
+    else // run the CPU for 1 frame (70224 cycles)
+        execute(70224);
+    if (rewind_)
+        rewind_frame();
+    if (hash_recorder_)
+        hash_recorder_->record(hash_state());
+    Trace::frame_end();
+}
+
+void Gameboy::run_frames(size_t n)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!rom_loaded_)
+        throw std::runtime_error {"Error running Gameboy: No ROM is loaded"};
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i + 1 == n && ppu_.observation_format().width)
+            ppu_.request_observation();
+        emulate_frame();
+    }
+    // frames don't line up with the 70224-cycle slices, so the frame being observed usually
+    // ends after the last one: run on to its end (there is none to wait for with the LCD off)
+    size_t cycles {0};
+    while (ppu_.observation_pending() && ppu_.enabled() && cycles < 2 * 70224 && !debug_break_)
+    {
+        cycles += step(1);
+        if (catch_up_)
+            ppu_.catch_up(cpu_.cycles());
+    }
+    if (catch_up_)
+        apu_.catch_up(cpu_.cycles());
+}
+
 void Gameboy::run_concurrently()
 {
     if (!rom_loaded_)
@@ -113,9 +304,20 @@ void Gameboy::run_concurrently()
 
 void Gameboy::stop()
 {
+    // the emulation thread may be waiting for the other end of the cable, which stays
+    // plugged in
+    interrupt_link(true);
     emu_stop_ = true;
     if (emu_thread_.joinable())
         emu_thread_.join();
+    interrupt_link(false);
+}
+
+void Gameboy::interrupt_link(bool b)
+{
+    const std::lock_guard<std::mutex> lock(link_mutex_);
+    if (link_)
+        link_->set_interrupted(b);
 }
 
 void Gameboy::pause()
@@ -141,8 +343,15 @@ void Gameboy::reset()
     ppu_.reset();
     apu_.reset();
     timer_.reset();
+    serial_.reset();
     joypad_.reset();
+    rewind_.reset();
+    ahead_thread_.reset();
+    ahead_.reset();
+    movie_state_ = Movie_state::None;
+    movie_ = {};
     rom_title_ = {};
+    rom_path_ = {};
     rom_loaded_ = false;
 }
 
@@ -160,34 +369,229 @@ size_t Gameboy::step(size_t n)
             if (debug_break_)
                 break;
         }
+        // time one instruction in PROFILE_INTERVAL while profiling
+        const bool timed {(profiling_ || metrics_) && ++profile_count_ == PROFILE_INTERVAL};
+        if (timed)
+            profile_count_ = 0;
+        Stopwatch watch {timed};
         size_t old_cycles {cpu_.cycles()};
         cpu_.step();
-        cycles_passed += (cpu_.cycles() - old_cycles);
-        ppu_.step(cycles_passed);
-        timer_.update(cycles_passed);
-        apu_.tick(cycles_passed);
+        ++instructions_;
+        const uint64_t now {cpu_.cycles()};
+        cycles_passed += (now - old_cycles);
+        watch.lap(profile_.cpu);
+        if (catch_up_)
+        {
+            // the PPU only has to be on time for its interrupts; memory accesses catch it
+            // (and the APU) up otherwise
+            if (now >= ppu_.next_event())
+                ppu_.catch_up(now);
+            watch.lap(profile_.ppu);
+        }
+        else
+        {
+            ppu_.catch_up(now);
+            watch.lap(profile_.ppu);
+            apu_.catch_up(now);
+            watch.lap(profile_.apu);
+        }
+        // the timer only needs attention when TIMA is due to overflow
+        if (now >= timer_.next_event())
+            timer_.update();
+        if (now >= serial_.next_event())
+            serial_.update();
+        watch.lap(profile_.timers);
+    }
+    return cycles_passed;
+}
+
+size_t Gameboy::run_frame()
+{
+    const Trace_scope probe {"cpu.run_frame"};
+    const uint64_t frame {ppu_.frames()};
+    size_t cycles_passed = 0;
+    while (ppu_.frames() == frame && !debug_break_)
+    {
+        cycles_passed += step(1);
+        // there are no frames with the LCD off
+        if (cycles_passed >= 70224 && (!ppu_.enabled() || cycles_passed >= 2*70224))
+            break;
+    }
+    if (catch_up_)
+    {
+        ppu_.catch_up(cpu_.cycles());
+        apu_.catch_up(cpu_.cycles());
     }
     return cycles_passed;
 }
 
 size_t Gameboy::execute(size_t cyc)
 {
+    const Trace_scope probe {"cpu.execute"};
     size_t cycles_passed = 0;
     // continuously step 1 CPU instruction until the specified number of cycles have
     // passed or until debug_callback_ requests a break
     while (cycles_passed < cyc && !debug_break_)
         cycles_passed += step(1);
+    if (catch_up_)
+    {
+        ppu_.catch_up(cpu_.cycles());
+        apu_.catch_up(cpu_.cycles());
+    }
     return cycles_passed;
 }
 
 void Gameboy::press(Joypad::Input i)
 {
-    joypad_.press(i);
+    live_input_ |= Joypad::mask(i);
+    // while a movie is recorded or played, input only changes between frames
+    if (movie_state_ == Movie_state::None)
+        joypad_.press(i);
 }
 
 void Gameboy::release(Joypad::Input i)
 {
-    joypad_.release(i);
+    live_input_ &= ~Joypad::mask(i);
+    if (movie_state_ == Movie_state::None)
+        joypad_.release(i);
+}
+
+void Gameboy::start_movie_recording()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!rom_loaded_)
+        throw std::runtime_error {"Cannot record a movie: No ROM is loaded"};
+    movie_ = {};
+    movie_.rom_hash = memory_.rom()->hash();
+    movie_.start_time = std::time(nullptr);
+    movie_.start_state.resize(state_size_);
+    State_writer w {movie_.start_state.data(), state_size_};
+    write_state(w);
+    // the real-time clock must not depend on when the movie is played
+    use_emulated_clock(movie_.start_time);
+    movie_state_ = Movie_state::Recording;
+}
+
+Movie Gameboy::stop_movie_recording()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (movie_state_ != Movie_state::Recording)
+        return {};
+    movie_state_ = Movie_state::None;
+    use_emulated_clock(std::nullopt);
+    return std::move(movie_);
+}
+
+void Gameboy::play_movie(const Movie &m)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!rom_loaded_ || m.rom_hash != memory_.rom()->hash())
+        throw std::runtime_error {"Movie was recorded on another ROM"};
+    if (m.start_state.size() != state_size_)
+        throw std::runtime_error {"Save state has the wrong size for the loaded ROM"};
+    State_reader r {m.start_state.data(), m.start_state.size()};
+    read_state(r);
+    movie_ = m;
+    movie_pos_ = 0;
+    // the real-time clock must not depend on when the movie is played
+    use_emulated_clock(movie_.start_time);
+    movie_state_ = Movie_state::Playing;
+}
+
+void Gameboy::set_emulated_rtc(std::optional<int64_t> start_time)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    use_emulated_clock(start_time);
+}
+
+void Gameboy::use_emulated_clock(std::optional<int64_t> start_time)
+{
+    if (!start_time)
+    {
+        memory_.set_clock({});
+        return;
+    }
+    const uint64_t start_cycles {cpu_.cycles()};
+    memory_.set_clock([this, start_cycles, t = *start_time]
+    {
+        return t + static_cast<int64_t>((cpu_.cycles() - start_cycles) / 4194304);
+    });
+}
+
+bool Gameboy::movie_playing() const
+{
+    return movie_state_ == Movie_state::Playing;
+}
+
+void Gameboy::movie_frame()
+{
+    if (movie_state_ == Movie_state::Recording)
+    {
+        const uint8_t input {live_input_};
+        joypad_.set_state(input);
+        movie_.inputs.push_back(input);
+    }
+    else if (movie_pos_ < movie_.inputs.size())
+    {
+        joypad_.set_state(movie_.inputs[movie_pos_++]);
+    }
+    else // the movie is over, hand the joypad back
+    {
+        movie_state_ = Movie_state::None;
+        use_emulated_clock(std::nullopt);
+        movie_ = {};
+        joypad_.set_state(live_input_);
+    }
+}
+
+void Gameboy::set_link(std::shared_ptr<Link_cable> cable)
+{
+    {
+        const std::lock_guard<std::mutex> lock(link_mutex_);
+        // wake up the emulation thread if it's waiting on the old cable
+        if (link_)
+            link_->disconnect();
+        link_ = cable;
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    serial_.set_link(std::move(cable));
+}
+
+void Gameboy::set_link_window(uint32_t active, uint32_t idle)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    serial_.set_sync_window(active, idle);
+}
+
+void Gameboy::set_input(uint8_t s)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    joypad_.set_state(s);
+}
+
+void Gameboy::set_output(bool b)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    ppu_.set_video_output(b);
+    apu_.set_audio_output(b);
+}
+
+void Gameboy::set_observation(const Ppu::Observation_format &f)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    ppu_.set_observation(f);
+}
+
+const uint8_t *Gameboy::observation() const
+{
+    return ppu_.observation();
+}
+
+uint64_t Gameboy::rom_hash() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto rom = memory_.rom();
+    return rom ? rom->hash() : 0;
 }
 
 void Gameboy::set_throttle(bool b)
@@ -201,11 +605,286 @@ void Gameboy::toggle_sound(bool b)
     apu_.toggle_sound(b);
 }
 
+void Gameboy::set_threaded_audio(bool b)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    apu_.set_threaded(b);
+}
+
 void Gameboy::set_force_dmg(bool b)
 {
     force_dmg_ = b;
 }
 
+void Gameboy::set_save_dir(const std::string &dir)
+{
+    save_dir_ = dir;
+}
+
+void Gameboy::set_catch_up(bool b)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    catch_up_ = b;
+}
+
+size_t Gameboy::state_size() const
+{
+    return state_size_;
+}
+
+size_t Gameboy::save_state(uint8_t *buf, size_t size)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (size < state_size_)
+        throw std::runtime_error {"Save state buffer is too small"};
+    State_writer w {buf, size};
+    write_state(w);
+    return w.size();
+}
+
+void Gameboy::load_state(const uint8_t *buf, size_t size)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (size != state_size_)
+        throw std::runtime_error {"Save state has the wrong size for the loaded ROM"};
+    State_reader r {buf, size};
+    read_state(r);
+}
+
+// A save state starts with STATE_MAGIC, STATE_VERSION, the ROM checksum and the model, followed
+// by each component's state.
+static constexpr uint32_t STATE_MAGIC {0x54534251}; // "QBST"
+
+void Gameboy::write_state(State_writer &w)
+{
+    w.put(STATE_MAGIC);
+    w.put(STATE_VERSION);
+    w.put(memory_.rom_checksum());
+    w.put(cgb_mode_);
+    cpu_.save_state(w);
+    memory_.save_state(w);
+    ppu_.save_state(w);
+    timer_.save_state(w);
+    serial_.save_state(w);
+    joypad_.save_state(w);
+    apu_.save_state(w);
+}
+
+void Gameboy::read_state(State_reader &r)
+{
+    if (r.get<uint32_t>() != STATE_MAGIC)
+        throw std::runtime_error {"Not a save state"};
+    if (r.get<uint16_t>() != STATE_VERSION)
+        throw std::runtime_error {"Save state was made by an incompatible version"};
+    if (r.get<uint16_t>() != memory_.rom_checksum())
+        throw std::runtime_error {"Save state was made with a different ROM"};
+    r.get(cgb_mode_);
+    cpu_.load_state(r);
+    memory_.load_state(r);
+    ppu_.load_state(r);
+    timer_.load_state(r);
+    serial_.load_state(r);
+    joypad_.load_state(r);
+    apu_.load_state(r);
+}
+
+void Gameboy::set_rewind(bool b, size_t budget, unsigned interval)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    rewind_enabled_ = b;
+    rewind_budget_ = budget;
+    rewind_interval_ = interval > 0 ? interval : 1;
+    if (rom_loaded_)
+        create_rewind_buffer();
+}
+
+void Gameboy::set_rewinding(bool b)
+{
+    rewinding_ = b;
+}
+
+Rewind_buffer::Stats Gameboy::rewind_stats() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return rewind_ ? rewind_->stats() : Rewind_buffer::Stats {};
+}
+
+void Gameboy::create_rewind_buffer()
+{
+    rewind_.reset();
+    rewind_state_valid_ = false;
+    rewind_frames_ = 0;
+    if (!rewind_enabled_)
+        return;
+    rewind_ = std::make_unique<Rewind_buffer>(state_size_, rewind_budget_, rewind_interval_);
+    rewind_state_.resize(state_size_);
+}
+
+void Gameboy::rewind_frame()
+{
+    if (rewinding_)
+    {
+        // go back one snapshot; the next frame shows it. Once the history runs out, keep
+        // going back to the oldest state.
+        if (rewind_->pop(rewind_state_.data()))
+            rewind_state_valid_ = true;
+        if (rewind_state_valid_)
+        {
+            State_reader r {rewind_state_.data(), state_size_};
+            read_state(r);
+        }
+        rewind_frames_ = 0;
+        return;
+    }
+    rewind_state_valid_ = false;
+    if (++rewind_frames_ < rewind_interval_)
+        return;
+    // if the compressor is still busy with the last snapshot, try again next frame
+    if (uint8_t *buf = rewind_->staging())
+    {
+        State_writer w {buf, state_size_};
+        write_state(w);
+        rewind_->commit();
+        rewind_frames_ = 0;
+    }
+}
+
+void Gameboy::set_run_ahead(unsigned frames, bool on_worker)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    ahead_thread_.reset();
+    ahead_.reset();
+    run_ahead_ = frames;
+    run_ahead_worker_ = on_worker;
+    ppu_.set_video_output(true);
+    if (run_ahead_ && run_ahead_worker_ && rom_loaded_)
+        create_run_ahead_instance();
+}
+
+void Gameboy::create_run_ahead_instance()
+{
+    ahead_thread_.reset();
+    ahead_ = make_sibling();
+    ahead_->ppu_.set_renderer(ppu_.renderer());
+    ahead_->apu_.set_audio_output(false);
+    ahead_thread_ = std::make_unique<Reusable_thread>([this]
+    {
+        Trace::set_thread_name("run-ahead");
+        // ahead_ picks up from the real frame saved in run_ahead_state_
+        State_reader r {run_ahead_state_.data(), state_size_};
+        ahead_->read_state(r);
+        for (unsigned i = 0; i < run_ahead_; ++i)
+        {
+            ahead_->ppu_.set_video_output(i + 1 == run_ahead_);
+            ahead_->run_frame();
+        }
+    });
+}
+
+void Gameboy::run_ahead_frame()
+{
+    // the real frame: its audio is played but the picture is never shown
+    ppu_.set_video_output(false);
+    run_frame();
+    if (ahead_)
+    {
+        // the worker must be done reading the previous state before it is overwritten
+        ahead_thread_->wait();
+        State_writer w {run_ahead_state_.data(), state_size_};
+        write_state(w);
+        ahead_thread_->queue();
+        return;
+    }
+    State_writer w {run_ahead_state_.data(), state_size_};
+    write_state(w);
+    apu_.set_audio_output(false);
+    for (unsigned i = 0; i < run_ahead_; ++i)
+    {
+        ppu_.set_video_output(i + 1 == run_ahead_);
+        run_frame();
+    }
+    apu_.set_audio_output(true);
+    State_reader r {run_ahead_state_.data(), state_size_};
+    read_state(r);
+}
+
+void Gameboy::set_profiling(bool b)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    profiling_ = b;
+    profile_count_ = 0;
+    profile_ = {};
+}
+
+Gameboy::Profile Gameboy::profile() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    Profile p {profile_};
+    p.cpu *= PROFILE_INTERVAL;
+    p.ppu *= PROFILE_INTERVAL;
+    p.apu *= PROFILE_INTERVAL;
+    p.timers *= PROFILE_INTERVAL;
+    return p;
+}
+
+void Gameboy::set_metrics(bool b)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    metrics_ = b;
+    metrics_window_ = {std::chrono::steady_clock::now(), cpu_.cycles(), instructions_, 0,
+                       nanoseconds {0}, profile_};
+    Published_metrics &out {metrics_out_};
+    for (auto *v : {&out.speed, &out.fps, &out.ips, &out.cpu_ms, &out.ppu_ms, &out.apu_ms,
+                    &out.sync_ms})
+        v->store(0, std::memory_order_relaxed);
+    out.audio_queued.store(0, std::memory_order_relaxed);
+    out.frames_skipped.store(0, std::memory_order_relaxed);
+}
+
+Gameboy::Metrics Gameboy::metrics() const
+{
+    const Published_metrics &out {metrics_out_};
+    auto get = [](const auto &v) { return v.load(std::memory_order_relaxed); };
+    return {get(out.speed), get(out.fps), get(out.ips), get(out.cpu_ms), get(out.ppu_ms),
+            get(out.apu_ms), get(out.sync_ms), get(out.audio_queued), get(out.frames_skipped)};
+}
+
+void Gameboy::update_metrics(uint64_t presented)
+{
+    Metrics_window &w {metrics_window_};
+    Published_metrics &out {metrics_out_};
+    ++w.frames;
+    if (presented_frames() == presented)
+        out.frames_skipped.fetch_add(1, std::memory_order_relaxed);
+    out.audio_queued.store(apu_.samples_queued(), std::memory_order_relaxed);
+
+    const auto now = std::chrono::steady_clock::now();
+    const nanoseconds wall {now - w.start};
+    if (wall < METRICS_PERIOD)
+        return;
+    const double seconds {wall.count() / 1e9};
+    // the profile starts over when profiling is switched on or off
+    auto ms_per_frame = [&w](nanoseconds total, nanoseconds start)
+    {
+        const nanoseconds t {total >= start ? total - start : total};
+        return t.count() * static_cast<double>(PROFILE_INTERVAL) / 1e6 / w.frames;
+    };
+    out.speed.store((cpu_.cycles() - w.cycles) / 4194304.0 / seconds, std::memory_order_relaxed);
+    out.fps.store(w.frames / seconds, std::memory_order_relaxed);
+    out.ips.store((instructions_ - w.instructions) / seconds, std::memory_order_relaxed);
+    out.cpu_ms.store(ms_per_frame(profile_.cpu + profile_.timers, w.profile.cpu + w.profile.timers),
+                     std::memory_order_relaxed);
+    out.ppu_ms.store(ms_per_frame(profile_.ppu, w.profile.ppu), std::memory_order_relaxed);
+    out.apu_ms.store(ms_per_frame(profile_.apu, w.profile.apu), std::memory_order_relaxed);
+    out.sync_ms.store(w.sync.count() / 1e6 / w.frames, std::memory_order_relaxed);
+    w = {now, cpu_.cycles(), instructions_, 0, nanoseconds {0}, profile_};
+}
+
+uint64_t Gameboy::presented_frames() const
+{
+    return ppu_.presented() + (ahead_ ? ahead_->ppu_.presented() : 0);
+}
+
 size_t Gameboy::cycles() const
 {
     return cpu_.cycles();
@@ -222,6 +901,18 @@ bool Gameboy::is_running() const
     return !emu_paused_;
 }
 
+const uint8_t *Gameboy::work_ram(size_t &size) const
+{
+    size = memory_.wram_size();
+    return memory_.wram();
+}
+
+const uint8_t *Gameboy::high_ram(size_t &size) const
+{
+    size = memory_.hram_size();
+    return memory_.hram();
+}
+
 // passed as callback function to CPU
 uint8_t Gameboy::memory_read(uint16_t adr)
 {
@@ -326,6 +1017,7 @@ std::array<Texture, 40> Gameboy::dump_sprites() const
 
 void Gameboy::write_save(const std::vector<uint8_t> &sram)
 {
+    const Trace_scope probe {"save.write"};
     const std::string path(save_dir_ + '/' + rom_title_ + ".sav");
     std::ofstream out(path, std::ios::binary);
     if (!out)
@@ -1,5 +1,6 @@
 #include "timer.hpp"
 #include "processor.hpp"
+#include "state.hpp"
 
 using qtboy::Timer;
 
@@ -7,38 +8,50 @@ Timer::Timer(Processor &p)
     : cpu_ {p}
 {}
 
-void Timer::update(std::size_t cycles)
+void Timer::update()
 {
-    div_ticks_ += cycles;
-    if (div_ticks_ >= 0xff)
+    const uint64_t now {cpu_.cycles()};
+    // TIMA may overflow more than once if TMA is close to 0xff
+    while (now >= overflow_cycle_)
     {
-        div_ticks_ -= 0xff;
-        ++div_;
+        tima_ = tma_;
+        tima_base_ = overflow_cycle_;
+        cpu_.request_interrupt(Processor::TIMER);
+        schedule_overflow();
     }
+}
 
+uint64_t Timer::increments(uint64_t from, uint64_t to) const
+{
     // bit 2 is enable bit
-    // bit 0-1 determine update frequency
-    if (tac_ & 4)
-    {
-        tima_ticks_ += cycles;
-        int freq = FREQUENCIES[tac_ & 3];
-        while (tima_ticks_ >= freq)
-        {
-            tima_ticks_ -= freq;
-            ++tima_;
-            if (tima_ == 0)
-            {
-                tima_overflow();
-            }
-        }
-    }
+    if (!(tac_ & 4))
+        return 0;
+    // TIMA increments whenever the divider passes a multiple of the selected period
+    // (bits 0-1 of TAC)
+    const uint64_t freq {FREQUENCIES[tac_ & 3]};
+    return (to - div_base_) / freq - (from - div_base_) / freq;
+}
 
+void Timer::rebase()
+{
+    update();
+    const uint64_t now {cpu_.cycles()};
+    // no overflow is due, so this can't exceed 0xff
+    tima_ = static_cast<uint8_t>(tima_ + increments(tima_base_, now));
+    tima_base_ = now;
 }
 
-void Timer::tima_overflow()
+void Timer::schedule_overflow()
 {
-    tima_ = tma_;
-    cpu_.request_interrupt(Processor::TIMER);
+    if (!(tac_ & 4))
+    {
+        overflow_cycle_ = NEVER;
+        return;
+    }
+    const uint64_t freq {FREQUENCIES[tac_ & 3]};
+    // number of periods completed by the divider at tima_base_
+    const uint64_t periods {(tima_base_ - div_base_) / freq};
+    overflow_cycle_ = div_base_ + (periods + (0x100 - tima_)) * freq;
 }
 
 uint8_t Timer::read(uint16_t adr)
@@ -46,10 +59,11 @@ uint8_t Timer::read(uint16_t adr)
     uint8_t b {0xff};
     switch (adr)
     {
-        case 0xff04: // DIV
-            b = (div_ >> 8); // only upper 8-bits
+        case 0xff04: // DIV: upper 8 bits of the internal divider
+            b = static_cast<uint8_t>((cpu_.cycles() - div_base_) >> 8);
             break;
         case 0xff05: // TIMA
+            rebase();
             b = tima_;
             break;
         case 0xff06: // TMA
@@ -64,10 +78,11 @@ uint8_t Timer::read(uint16_t adr)
 
 void Timer::write(uint8_t b, uint16_t adr)
 {
+    rebase();
     switch (adr)
     {
         case 0xff04: // DIV
-            div_ = 0;
+            div_base_ = cpu_.cycles();
             break;
         case 0xff05: // TIMA
             tima_ = b;
@@ -79,14 +94,35 @@ void Timer::write(uint8_t b, uint16_t adr)
             tac_ = b;
             break;
     }
+    schedule_overflow();
 }
 
 void Timer::reset()
 {
-    div_ticks_ = 0;
-    tima_ticks_ = 0;
+    div_base_ = 0;
+    tima_base_ = 0;
+    overflow_cycle_ = NEVER;
     tima_ = 0;
     tma_ = 0;
     tac_ = 0;
-    div_ = 0;
+}
+
+void Timer::save_state(State_writer &w) const
+{
+    w.put(div_base_);
+    w.put(tima_base_);
+    w.put(overflow_cycle_);
+    w.put(tima_);
+    w.put(tma_);
+    w.put(tac_);
+}
+
+void Timer::load_state(State_reader &r)
+{
+    r.get(div_base_);
+    r.get(tima_base_);
+    r.get(overflow_cycle_);
+    r.get(tima_);
+    r.get(tma_);
+    r.get(tac_);
 }
@@ -0,0 +1,219 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace qtboy
+{
+
+std::atomic<bool> Trace::active_ {false};
+std::atomic<bool> Trace::recording_ {false};
+
+namespace
+{
+
+struct Event
+{
+    const char *name;
+    uint64_t start, end;
+};
+
+// Events of one thread. Only that thread writes to it; write_json() reads up to head.
+struct Ring
+{
+    unsigned tid;
+    const char *name;
+    std::vector<Event> events = std::vector<Event>(Trace::RING_SIZE);
+    std::atomic<uint64_t> head {0}; // events written
+};
+
+// Rings are created on a thread's first event and kept (for the trace) after it exits. Then
+// they go to free_rings, for the next thread with the same name to go on with: threads that
+// are started again and again (e.g. the audio worker) keep one track.
+std::mutex rings_mutex;
+std::vector<std::unique_ptr<Ring>> rings;
+std::vector<Ring *> free_rings;
+
+bool same_name(const char *a, const char *b)
+{
+    return a == b || (a && b && std::strcmp(a, b) == 0);
+}
+
+// The calling thread's ring, handed back when the thread exits.
+struct Ring_owner
+{
+    Ring *ring {nullptr};
+
+    ~Ring_owner()
+    {
+        if (!ring)
+            return;
+        const std::lock_guard<std::mutex> lock(rings_mutex);
+        free_rings.push_back(ring);
+    }
+};
+
+thread_local Ring_owner owner;
+thread_local const char *thread_name {nullptr};
+thread_local uint64_t last_frame_end {0};
+
+std::atomic<int64_t> frames_to_skip {0}, frames_left {0};
+std::atomic<uint64_t> trace_start {0};
+
+// a thread can still finish the event it was in after a trace stops: leave its slot alone
+constexpr uint64_t SLACK {16};
+
+}
+
+void Trace::start(unsigned count, unsigned skip)
+{
+    stop();
+    {
+        const std::lock_guard<std::mutex> lock(rings_mutex);
+        for (auto &r : rings)
+            r->head = 0;
+    }
+    frames_to_skip = skip;
+    frames_left = count ? count : -1;
+    trace_start = now();
+    active_ = true;
+    recording_ = skip == 0;
+}
+
+void Trace::stop()
+{
+    recording_ = false;
+    active_ = false;
+}
+
+void Trace::frame_end()
+{
+    if (!active())
+        return;
+    const uint64_t t {now()};
+    if (frames_to_skip.load(std::memory_order_relaxed) > 0)
+    {
+        if (frames_to_skip.fetch_sub(1) == 1)
+        {
+            trace_start = t;
+            recording_ = true;
+        }
+        last_frame_end = t;
+        return;
+    }
+    if (recording())
+    {
+        const uint64_t start {std::max(last_frame_end, trace_start.load())};
+        record("frame", start, t);
+    }
+    last_frame_end = t;
+    if (frames_left.fetch_sub(1) == 1)
+        stop();
+}
+
+void Trace::set_thread_name(const char *name)
+{
+    thread_name = name;
+    if (owner.ring)
+        owner.ring->name = name;
+}
+
+uint64_t Trace::now()
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+                duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void Trace::record(const char *name, uint64_t start, uint64_t end)
+{
+    Ring *&ring {owner.ring};
+    if (!ring)
+    {
+        const std::lock_guard<std::mutex> lock(rings_mutex);
+        auto it = std::find_if(free_rings.begin(), free_rings.end(),
+                               [](const Ring *r){ return same_name(r->name, thread_name); });
+        if (it != free_rings.end())
+        {
+            ring = *it;
+            free_rings.erase(it);
+        }
+        else
+        {
+            rings.push_back(std::make_unique<Ring>());
+            ring = rings.back().get();
+            ring->tid = static_cast<unsigned>(rings.size());
+            ring->name = thread_name;
+        }
+    }
+    const uint64_t head {ring->head.load(std::memory_order_relaxed)};
+    ring->events[head % RING_SIZE] = {name, start, end};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::write_json(std::ostream &out)
+{
+    const std::lock_guard<std::mutex> lock(rings_mutex);
+    const uint64_t origin {trace_start};
+    // nanoseconds as microseconds
+    auto us = [&out](uint64_t ns)
+    {
+        out << ns / 1000 << '.' << static_cast<char>('0' + ns / 100 % 10)
+            << static_cast<char>('0' + ns / 10 % 10) << static_cast<char>('0' + ns % 10);
+    };
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first {true};
+    auto separate = [&out, &first]
+    {
+        if (!first)
+            out << ",\n";
+        first = false;
+    };
+    for (const auto &r : rings)
+    {
+        const uint64_t head {r->head.load(std::memory_order_acquire)};
+        if (head == 0)
+            continue;
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid
+            << ",\"args\":{\"name\":\"";
+        if (r->name)
+            out << r->name;
+        else
+            out << "thread " << r->tid;
+        out << "\"}}";
+        const uint64_t first_event {head > RING_SIZE ? head - RING_SIZE + SLACK : 0};
+        for (uint64_t i = first_event; i < head; ++i)
+        {
+            const Event &e {r->events[i % RING_SIZE]};
+            if (e.start < origin)
+                continue;
+            separate();
+            out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+                << ",\"ts\":";
+            us(e.start - origin);
+            out << ",\"dur\":";
+            us(e.end - e.start);
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+}
+
+void Trace::write_json(const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error {"Could not open " + path};
+    write_json(out);
+    if (!out)
+        throw std::runtime_error {"Could not write " + path};
+}
+
+}
@@ -1,4 +1,5 @@
 #include "wave_channel.hpp"
+#include "state.hpp"
 
 using namespace qtboy;
 
@@ -100,3 +101,33 @@ void Wave_channel::restart_sound()
     timer_ = freq();
     pattern_index_ = 0;
 }
+
+void Wave_channel::save_state(State_writer &w) const
+{
+    w.put(enable_);
+    w.put(length_);
+    w.put(output_level_);
+    w.put(freq_lo_);
+    w.put(freq_hi_);
+    w.put(pattern_);
+    w.put(pattern_index_);
+    w.put(timer_);
+    w.put(length_timer_);
+    w.put(enabled_);
+    w.put(output_);
+}
+
+void Wave_channel::load_state(State_reader &r)
+{
+    r.get(enable_);
+    r.get(length_);
+    r.get(output_level_);
+    r.get(freq_lo_);
+    r.get(freq_hi_);
+    r.get(pattern_);
+    r.get(pattern_index_);
+    r.get(timer_);
+    r.get(length_timer_);
+    r.get(enabled_);
+    r.get(output_);
+}
@@ -0,0 +1,138 @@
+#include "work_stealing_pool.hpp"
+
+namespace qtboy
+{
+
+Work_stealing_pool::Work_stealing_pool(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (unsigned i = 0; i < threads; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i)
+        workers_.emplace_back([this, i]{ work(i); });
+}
+
+Work_stealing_pool::~Work_stealing_pool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]{ return unfinished_ == 0; });
+        exiting_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &t : workers_)
+        t.join();
+}
+
+void Work_stealing_pool::submit(std::function<void()> task)
+{
+    ++unfinished_;
+    {
+        Queue &q {*queues_[next_queue_++ % queues_.size()]};
+        const std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        ++queued_;
+    }
+    work_cv_.notify_one();
+}
+
+void Work_stealing_pool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]{ return unfinished_ == 0; });
+    if (error_)
+    {
+        auto e = error_;
+        error_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void Work_stealing_pool::work(size_t id)
+{
+    while (true)
+    {
+        // claim a task first, so that another worker woken for the same one goes back to
+        // sleep instead of searching every queue
+        if (!claim())
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this]{ return queued_ > 0 || exiting_; });
+            if (queued_ == 0)
+                return;
+            continue;
+        }
+        // a task was claimed, so one of the queues has it
+        std::function<void()> task;
+        while (!take(id, task))
+            std::this_thread::yield();
+
+        std::exception_ptr error {};
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        if (error)
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = error;
+        }
+        if (--unfinished_ == 0)
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            done_cv_.notify_all();
+        }
+    }
+}
+
+bool Work_stealing_pool::claim()
+{
+    size_t n {queued_};
+    while (n > 0)
+    {
+        if (queued_.compare_exchange_weak(n, n - 1))
+            return true;
+    }
+    return false;
+}
+
+bool Work_stealing_pool::take(size_t id, std::function<void()> &task)
+{
+    {
+        Queue &own {*queues_[id]};
+        const std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i)
+    {
+        Queue &victim {*queues_[(id + i) % queues_.size()]};
+        const std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            ++steals_;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
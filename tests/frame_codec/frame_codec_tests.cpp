@@ -0,0 +1,92 @@
+// Encodes frames with Frame_encoder and checks that decode_frame() gives them back: a key
+// frame, a frame that changed everywhere, one that didn't change at all, one with both kinds
+// of runs, one with too many colours for a palette, and a frame decoded over the previous one.
+//
+// usage: frame_codec_tests
+
+#include <cstdio>
+#include <vector>
+
+#include "frame_codec.hpp"
+
+using namespace qtboy;
+
+using Frame = std::vector<Color>;
+
+constexpr size_t PIXELS {Frame_encoder::PIXELS};
+constexpr size_t WIDTH {160};
+
+// A few coloured stripes, like a Game Boy screen.
+Frame striped(unsigned seed)
+{
+    const Color palette[4] {0x7fff, 0x56b5, 0x294a, 0x0000};
+    Frame f(PIXELS);
+    for (size_t i = 0; i < PIXELS; ++i)
+        f[i] = palette[(i % WIDTH / 8 + i / WIDTH / 16 + seed) % 4];
+    return f;
+}
+
+struct Coder
+{
+    Frame_encoder encoder {};
+    std::vector<uint8_t> data {};
+
+    // Encode frame against prev and decode it back into out (which may be prev).
+    bool round_trip(const Frame &frame, const Frame *prev, Frame &out)
+    {
+        data.clear();
+        encoder.encode(frame.data(), prev ? prev->data() : nullptr, data);
+        return decode_frame(data.data(), data.size(), prev ? prev->data() : nullptr, out.data());
+    }
+};
+
+bool check(const char *name, Coder &coder, const Frame &frame, const Frame *prev, Frame &out)
+{
+    const bool ok {coder.round_trip(frame, prev, out) && out == frame};
+    std::printf("%-18s %6zu bytes  %s\n", name, coder.data.size(), ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main()
+{
+    Coder coder;
+    bool ok {true};
+    Frame out(PIXELS);
+
+    const Frame first {striped(0)};
+    ok &= check("key frame", coder, first, nullptr, out);
+
+    const Frame changed {striped(1)};
+    ok &= check("changed", coder, changed, &first, out);
+    ok &= check("unchanged", coder, changed, &changed, out);
+
+    // a sprite moved and a line of text changed
+    Frame mixed {changed};
+    for (size_t y = 40; y < 56; ++y)
+        for (size_t x = 72; x < 88; ++x)
+            mixed[y * WIDTH + x] = 0x001f;
+    for (size_t x = 0; x < WIDTH; ++x)
+        mixed[130 * WIDTH + x] = x % 3 ? 0x7c00 : 0x03e0;
+    ok &= check("mixed", coder, mixed, &changed, out);
+
+    Frame colourful(PIXELS);
+    for (size_t i = 0; i < PIXELS; ++i)
+        colourful[i] = static_cast<Color>(i * 7 & 0x7fff);
+    ok &= check("over 256 colours", coder, colourful, &mixed, out);
+
+    // decoding in place, as a player keeping one frame does
+    Frame screen {changed};
+    ok &= check("in place", coder, mixed, &screen, screen);
+
+    // malformed data is rejected
+    coder.round_trip(mixed, &changed, out);
+    coder.data.pop_back();
+    const bool rejected {!decode_frame(coder.data.data(), coder.data.size(), changed.data(),
+                                       out.data())};
+    std::printf("%-18s %6zu bytes  %s\n", "truncated", coder.data.size(),
+                rejected ? "ok" : "FAILED");
+    ok &= rejected;
+
+    std::puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+// Connects two machines with a link cable, in the same process and over TCP on the loopback
+// interface, and checks that they meet at sync points, that the cable stays plugged in when
+// they are stopped and started again, and that destroying one machine lets the other go on.
+//
+// usage: link_tests <rom>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "system.hpp"
+#include "link_cable.hpp"
+
+using namespace qtboy;
+
+constexpr uint16_t PORT {47011};
+constexpr std::chrono::milliseconds RUN_TIME {300};
+
+// Passes everything on to a real end, counting the meetings.
+class Counting_end : public Link_cable
+{
+    public:
+    explicit Counting_end(std::shared_ptr<Link_cable> end)
+        : end_ {std::move(end)}
+    {}
+
+    bool sync(const Link_message &ours, Link_message &theirs) override
+    {
+        const bool met {end_->sync(ours, theirs)};
+        if (met)
+            ++meetings_;
+        return met;
+    }
+
+    void disconnect() override { end_->disconnect(); }
+    bool connected() const override { return end_->connected(); }
+    void set_interrupted(bool b) override { end_->set_interrupted(b); }
+
+    uint64_t meetings() const { return meetings_; }
+
+    private:
+    std::shared_ptr<Link_cable> end_;
+    std::atomic<uint64_t> meetings_ {0};
+};
+
+std::unique_ptr<Gameboy> make_gameboy(const char *rom)
+{
+    auto gb = std::make_unique<Gameboy>();
+    gb->set_save_dir("");
+    gb->set_throttle(false);
+    if (!gb->load_cartridge(rom))
+        throw std::runtime_error {std::string {"Could not load "} + rom};
+    return gb;
+}
+
+bool check(bool ok, const char *what)
+{
+    std::printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+bool test(const char *name, std::shared_ptr<Link_cable> a, std::shared_ptr<Link_cable> b,
+          const char *rom)
+{
+    std::printf("%s\n", name);
+    auto end_a = std::make_shared<Counting_end>(std::move(a));
+    auto end_b = std::make_shared<Counting_end>(std::move(b));
+    auto gb_a = make_gameboy(rom);
+    auto gb_b = make_gameboy(rom);
+    bool ok {true};
+
+    // plugged in before starting: run_concurrently() must not unplug it
+    gb_a->set_link(end_a);
+    gb_b->set_link(end_b);
+    gb_a->run_concurrently();
+    gb_b->run_concurrently();
+    std::this_thread::sleep_for(RUN_TIME);
+    gb_a->stop();
+    gb_b->stop();
+    const uint64_t first_a {end_a->meetings()}, first_b {end_b->meetings()};
+    ok &= check(first_a > 0 && first_b > 0, "meets after run_concurrently()");
+    ok &= check(end_a->connected() && end_b->connected(), "still plugged in after stop()");
+    ok &= check(first_a <= first_b + 1 && first_b <= first_a + 1, "both ends met as often");
+
+    gb_a->run_concurrently();
+    gb_b->run_concurrently();
+    std::this_thread::sleep_for(RUN_TIME);
+    ok &= check(end_a->meetings() > first_a && end_b->meetings() > first_b,
+                "meets again after restarting");
+
+    // b may be waiting for a at a sync point right now
+    gb_a.reset();
+    std::this_thread::sleep_for(RUN_TIME);
+    gb_b->stop();
+    ok &= check(!end_b->connected(), "unplugged when the other machine is destroyed");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <rom>\n", argv[0]);
+        return 2;
+    }
+    bool ok {true};
+    try
+    {
+        auto [a, b] = make_local_link();
+        ok &= test("local", a, b, argv[1]);
+
+        std::shared_ptr<Link_cable> host;
+        std::thread listener {[&host]
+        {
+            try
+            {
+                host = listen_link(PORT);
+            }
+            catch (const std::runtime_error &e)
+            {
+                std::fprintf(stderr, "%s\n", e.what());
+            }
+        }};
+        std::shared_ptr<Link_cable> guest;
+        // the listener may not be up yet
+        for (int tries {0}; !guest; ++tries)
+        {
+            try
+            {
+                guest = connect_link("127.0.0.1", PORT);
+            }
+            catch (const std::runtime_error &)
+            {
+                if (tries == 50)
+                    throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+        listener.join();
+        if (!host)
+            return 2;
+        ok &= test("tcp", host, guest, argv[1]);
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+    std::puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
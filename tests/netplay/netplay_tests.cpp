@@ -0,0 +1,139 @@
+// Runs a rollback netplay session between two processes over the loopback interface, with
+// simulated latency, jitter and packet loss, and checks that both machines end up in the same
+// state as a machine that was given both players' inputs directly.
+//
+// usage: netplay_tests <rom> [frames] [latency ms] [jitter ms] [loss]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "system.hpp"
+#include "netplay.hpp"
+
+using namespace qtboy;
+
+constexpr uint16_t HOST_PORT {47001};
+constexpr uint16_t GUEST_PORT {47002};
+constexpr unsigned MAX_ROLLBACK {12};
+constexpr unsigned INPUT_DELAY {2};
+
+// Made up input of a player: a button or direction held for a few frames at a time.
+uint8_t scripted_input(int player, uint64_t frame)
+{
+    uint64_t x {(frame / 9 + 1) * 0x9e3779b97f4a7c15ull ^ (player + 1) * 0xc2b2ae3d27d4eb4full};
+    x ^= x >> 29;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 32;
+    return (x & 3) ? static_cast<uint8_t>(1 << (x >> 8) % 8) : 0;
+}
+
+struct Result
+{
+    uint64_t hash;
+    Rollback_session::Stats stats;
+    int64_t start_time;
+};
+
+Result run_peer(Gameboy &gb, bool host, uint64_t frames, unsigned latency, unsigned jitter,
+                double loss, std::unique_ptr<Gameboy> *start)
+{
+    Udp_transport net {host ? HOST_PORT : GUEST_PORT, "127.0.0.1", host ? GUEST_PORT : HOST_PORT};
+    net.set_conditions(latency, jitter, loss);
+    Rollback_session session {gb, net, host, MAX_ROLLBACK, INPUT_DELAY};
+    while (!session.synchronize())
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    if (start)
+        *start = gb.clone();
+
+    // run at about 60 FPS
+    auto next = std::chrono::steady_clock::now();
+    const int player {host ? 0 : 1};
+    for (uint64_t f {0}; f < frames;)
+    {
+        if (session.advance(scripted_input(player, f)))
+            ++f;
+        next += std::chrono::microseconds(16742);
+        std::this_thread::sleep_until(next);
+    }
+    // wait for the last inputs, and keep sending ours for a while in case they were lost
+    const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(4 * latency + 500);
+    while (session.stats().confirmed_frame < frames || std::chrono::steady_clock::now() < until)
+    {
+        session.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return {gb.state_hash(), session.stats(), session.start_time()};
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <rom> [frames] [latency ms] [jitter ms] [loss]\n", argv[0]);
+        return 2;
+    }
+    const uint64_t frames {argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 600};
+    const unsigned latency {argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 40};
+    const unsigned jitter {argc > 4 ? static_cast<unsigned>(std::atoi(argv[4])) : 15};
+    const double loss {argc > 5 ? std::atof(argv[5]) : 0.05};
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 2;
+    const pid_t pid {fork()};
+    if (pid == 0) // the guest
+    {
+        Gameboy gb;
+        if (!gb.load_cartridge(argv[1]))
+            return 2;
+        const Result r {run_peer(gb, false, frames, latency, jitter, loss, nullptr)};
+        if (write(fds[1], &r, sizeof(r)) != sizeof(r))
+            return 2;
+        return 0;
+    }
+
+    // the host runs some frames first so the guest really needs its state
+    Gameboy gb;
+    if (!gb.load_cartridge(argv[1]))
+    {
+        std::fprintf(stderr, "Could not load %s\n", argv[1]);
+        return 2;
+    }
+    gb.run_frames(120);
+    std::unique_ptr<Gameboy> reference;
+    const Result host {run_peer(gb, true, frames, latency, jitter, loss, &reference)};
+    Result guest {};
+    const bool got_guest {read(fds[0], &guest, sizeof(guest)) == sizeof(guest)};
+    int status {0};
+    waitpid(pid, &status, 0);
+
+    // the same frames without the network
+    reference->set_emulated_rtc(host.start_time);
+    for (uint64_t f {0}; f < frames; ++f)
+    {
+        const uint8_t p1 {f < INPUT_DELAY ? uint8_t {0} : scripted_input(0, f - INPUT_DELAY)};
+        const uint8_t p2 {f < INPUT_DELAY ? uint8_t {0} : scripted_input(1, f - INPUT_DELAY)};
+        reference->set_input(p1 | p2);
+        reference->run_frames(1);
+    }
+    const uint64_t expected {reference->state_hash()};
+
+    for (const auto &[name, r] : {std::pair {"host", host}, std::pair {"guest", guest}})
+    {
+        std::printf("%-5s hash %016llx rollbacks %llu resimulated %llu max depth %u stalls %llu%s\n",
+                    name, static_cast<unsigned long long>(r.hash),
+                    static_cast<unsigned long long>(r.stats.rollbacks),
+                    static_cast<unsigned long long>(r.stats.resimulated_frames),
+                    r.stats.max_rollback_depth, static_cast<unsigned long long>(r.stats.stalls),
+                    r.stats.desynced ? " DESYNCED" : "");
+    }
+    std::printf("expected hash %016llx\n", static_cast<unsigned long long>(expected));
+    const bool ok {got_guest && host.hash == expected && guest.hash == expected
+                   && !host.stats.desynced && !guest.stats.desynced};
+    std::puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Pushes states through a Rewind_buffer with a small budget, so that the ring wraps and old
+// deltas are evicted, and checks that every state pop() gives back is the one pushed, byte for
+// byte, in reverse order.
+//
+// usage: rewind_tests
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "rewind_buffer.hpp"
+
+using namespace qtboy;
+
+using State = std::vector<uint8_t>;
+
+constexpr std::size_t STATE_SIZE {4096};
+// a delta changing one run of n bytes compresses to n + 8 bytes: a token for the zeros and
+// changed bytes before it, and one for the zeros after
+constexpr std::size_t TOKENS {8};
+
+// The state before it with len bytes from start changed (none of them to the same value).
+State next_state(const State &prev, std::size_t start, std::size_t len, unsigned seed)
+{
+    State s {prev};
+    for (std::size_t i = 0; i < len; ++i)
+        s[start + i] ^= static_cast<uint8_t>((seed * 31 + i) % 255 + 1);
+    return s;
+}
+
+void push(Rewind_buffer &buffer, const State &s)
+{
+    uint8_t *staging;
+    // the worker may still be compressing the previous state
+    while (!(staging = buffer.staging()))
+        std::this_thread::yield();
+    std::memcpy(staging, s.data(), s.size());
+    buffer.commit();
+}
+
+// Pop states until the buffer is empty, checking them against the end of pushed. Returns
+// false on a mismatch; popped states are removed from pushed.
+bool pop_all(Rewind_buffer &buffer, std::vector<State> &pushed, std::size_t &popped)
+{
+    State out(STATE_SIZE);
+    popped = 0;
+    while (buffer.pop(out.data()))
+    {
+        if (pushed.empty() || out != pushed.back())
+            return false;
+        pushed.pop_back();
+        ++popped;
+    }
+    return popped > 0;
+}
+
+bool check(bool ok, const char *name, std::size_t popped, std::size_t pushed)
+{
+    std::printf("%-28s %3zu of %3zu states  %s\n", name, popped, pushed, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Deltas of the given sizes in a ring of budget bytes.
+bool test_sizes(const char *name, std::size_t budget, const std::vector<std::size_t> &sizes)
+{
+    Rewind_buffer buffer {STATE_SIZE, budget, 1};
+    std::vector<State> pushed {State(STATE_SIZE)};
+    push(buffer, pushed.back());
+    for (std::size_t i = 0; i < sizes.size(); ++i)
+    {
+        const std::size_t len {sizes[i] - TOKENS};
+        pushed.push_back(next_state(pushed.back(), (i * 613) % (STATE_SIZE - len), len,
+                                    static_cast<unsigned>(i)));
+        push(buffer, pushed.back());
+    }
+    const std::size_t total {pushed.size()};
+    std::size_t popped {0};
+    const bool ok {pop_all(buffer, pushed, popped)};
+    return check(ok, name, popped, total);
+}
+
+// Pseudo random sizes, popping some of the states now and then.
+bool test_random(std::size_t budget, unsigned rounds)
+{
+    Rewind_buffer buffer {STATE_SIZE, budget, 1};
+    std::vector<State> pushed {State(STATE_SIZE)};
+    push(buffer, pushed.back());
+    uint32_t x {12345};
+    auto random = [&x](uint32_t n)
+    {
+        x = x * 1103515245 + 12345;
+        return (x >> 16) % n;
+    };
+    bool ok {true};
+    std::size_t total {1};
+    for (unsigned i = 0; i < rounds && ok; ++i)
+    {
+        const std::size_t len {1 + random(budget / 2)};
+        pushed.push_back(next_state(pushed.back(), random(STATE_SIZE - len), len, i));
+        push(buffer, pushed.back());
+        ++total;
+        // step back a few states, as rewinding does (the state stepped back to stays the latest)
+        if (random(16) == 0)
+        {
+            State out(STATE_SIZE);
+            for (uint32_t n = 1 + random(4); n > 0 && ok && buffer.stats().snapshots > 1; --n)
+            {
+                ok = buffer.pop(out.data()) && out == pushed.back();
+                pushed.pop_back();
+            }
+        }
+    }
+    std::size_t popped {0};
+    ok = ok && pop_all(buffer, pushed, popped);
+    return check(ok, "random sizes, some popped", popped, total);
+}
+
+int main()
+{
+    bool ok {true};
+    ok &= test_sizes("even sizes", 1000, {300, 300, 300, 300, 300, 300, 300});
+    // wraps with the newest entries at the start of the ring: the write of 500 covers them
+    ok &= test_sizes("wrap over the newest", 1000, {300, 300, 300, 200, 350, 500, 100});
+    ok &= test_sizes("delta as big as the ring", 1000, {400, 1000, 300, 300});
+    ok &= test_sizes("delta bigger than the ring", 1000, {400, 1200, 300, 300});
+    ok &= test_random(1000, 2000);
+    ok &= test_random(3000, 2000);
+    std::puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
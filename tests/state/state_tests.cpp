@@ -0,0 +1,122 @@
+// Saves a state, loads it into a second machine and checks that both hash the same and keep
+// running the same, in each synchronisation mode. Frames are run with output toggled off the
+// way netplay resimulates them, and every mode must end up with the state of the lock-step run.
+//
+// usage: state_tests <rom> [frames]
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "system.hpp"
+
+using namespace qtboy;
+
+constexpr int64_t START_TIME {1000000000};
+constexpr uint64_t FRAMES_AFTER {120};
+
+struct Mode
+{
+    const char *name;
+    bool catch_up;
+    bool threaded_audio;
+};
+
+// Made up input: a button or direction held for a few frames at a time.
+uint8_t scripted_input(uint64_t frame)
+{
+    uint64_t x {(frame / 7 + 1) * 0x9e3779b97f4a7c15ull};
+    x ^= x >> 29;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 32;
+    return (x & 3) ? static_cast<uint8_t>(1 << (x >> 8) % 8) : 0;
+}
+
+std::unique_ptr<Gameboy> make_gameboy(const Mode &mode, const char *rom)
+{
+    auto gb = std::make_unique<Gameboy>();
+    gb->set_save_dir("");
+    gb->set_emulated_rtc(START_TIME);
+    gb->set_catch_up(mode.catch_up);
+    gb->set_threaded_audio(mode.threaded_audio);
+    if (!gb->load_cartridge(rom))
+        return nullptr;
+    return gb;
+}
+
+// Frames first..last, with output off for stretches of them.
+void run(Gameboy &gb, uint64_t first, uint64_t last)
+{
+    for (uint64_t f {first}; f < last; ++f)
+    {
+        gb.set_output(f / 30 % 3 != 1);
+        gb.set_input(scripted_input(f));
+        gb.run_frames(1);
+    }
+    gb.set_output(true);
+}
+
+struct Result
+{
+    uint64_t saved; // hash of the state saved
+    uint64_t loaded; // hash after loading it into another machine
+    uint64_t after; // after running on from there
+    uint64_t after_loaded;
+};
+
+bool test(const Mode &mode, const char *rom, uint64_t frames, Result &r)
+{
+    auto gb = make_gameboy(mode, rom);
+    auto copy = make_gameboy(mode, rom);
+    if (!gb || !copy)
+        return false;
+    run(*gb, 0, frames);
+    r.saved = gb->state_hash();
+    std::vector<uint8_t> state(gb->state_size());
+    gb->save_state(state.data(), state.size());
+    copy->load_state(state.data(), state.size());
+    r.loaded = copy->state_hash();
+    run(*gb, frames, frames + FRAMES_AFTER);
+    run(*copy, frames, frames + FRAMES_AFTER);
+    r.after = gb->state_hash();
+    r.after_loaded = copy->state_hash();
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <rom> [frames]\n", argv[0]);
+        return 2;
+    }
+    const uint64_t frames {argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 600};
+    const Mode modes[] {{"lock-step", false, false},
+                        {"catch-up", true, false},
+                        {"threaded audio", false, true}};
+
+    bool ok {true};
+    Result expected {};
+    for (const Mode &mode : modes)
+    {
+        Result r {};
+        if (!test(mode, argv[1], frames, r))
+        {
+            std::fprintf(stderr, "Could not load %s\n", argv[1]);
+            return 2;
+        }
+        if (&mode == modes)
+            expected = r;
+        const bool mode_ok {r.loaded == r.saved && r.after_loaded == r.after
+                            && r.saved == expected.saved && r.after == expected.after};
+        std::printf("%-14s saved %016llx loaded %016llx after %016llx %016llx%s\n", mode.name,
+                    static_cast<unsigned long long>(r.saved),
+                    static_cast<unsigned long long>(r.loaded),
+                    static_cast<unsigned long long>(r.after),
+                    static_cast<unsigned long long>(r.after_loaded), mode_ok ? "" : " MISMATCH");
+        ok = ok && mode_ok;
+    }
+    std::puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}